@@ -9,10 +9,12 @@
 #include "renderer.h"
 #include "scene.h"
 #include "model.h"
+#include "mesh.h"
 #include "extension.h"
 #include "shader.h"
 #include "camera.h"
 #include <sstream>
+#include <cstdio>
 #include "geometry_helper.h"
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
@@ -20,16 +22,19 @@
 #include "vk_command_pool.h"
 #include "vk_command_buffer.h"
 #include "vk_descriptor_pool.h"
+#include "job_system.h"
 
-App::App()
+App::App(bool visible)
 {
-    p_window = new Window { "vulkan_tutorial", this };
+    // Created first so the main thread becomes thread 0 of the job system.
+    p_jobSystem = new JobSystem { 0 };
+    p_window = new Window { "vulkan_tutorial", this, visible };
     p_instance = new Instance { m_requiredLayers, m_requiredLayerExtensions };
     p_surface = new Surface { p_window, p_instance };
     p_device = new Device { p_instance, p_surface, m_requiredDeviceExtensions };
-    p_swapChain = new SwapChain { p_window, p_surface, p_device };
+    p_swapChain = new SwapChain { p_window, p_surface, p_device, nullptr };
     p_pipeline = new Pipeline { p_device, p_swapChain };
-    p_renderer = new Renderer { p_device, p_swapChain, p_pipeline };
+    p_renderer = new Renderer { p_device, p_swapChain, p_pipeline, p_jobSystem };
 
     SetupDebugMessenger();
 
@@ -37,18 +42,19 @@ App::App()
 
     p_scene = new Scene { new Camera { aspectRatio } };
 
-    auto cube1 = new Model(p_device, Geometry::CreateCube());
+    // One cube mesh, every cube model is an instance of it.
+    auto cubeMesh = new Mesh(p_renderer->GetGeometryPool(), Geometry::CreateCube());
+    p_scene->AddMesh(cubeMesh);
+
+    auto cube1 = new Model(cubeMesh, p_scene->GetTransforms());
+    cube1->m_animated = true;
     p_scene->AddModel(cube1);
 
-    // auto cube2 = new Model(p_device, Geometry::CreateCube());
-    // cube2->m_transform.m_position.x = -1.0f;
-    // cube2->m_transform.m_position.y = -2.0f;
-    // cube2->m_transform.m_position.z = -3.0f;
+    // auto cube2 = new Model(cubeMesh, p_scene->GetTransforms());
+    // cube2->m_transform.SetPosition(Vec3 { -1.0f, -2.0f, -3.0f });
     // p_scene->AddModel(cube2);
-    // auto cube3 = new Model(p_device, Geometry::CreateCube());
-    // cube3->m_transform.m_position.x = 1.0f;
-    // cube3->m_transform.m_position.y = 2.0f;
-    // cube3->m_transform.m_position.z = 3.0f;
+    // auto cube3 = new Model(cubeMesh, p_scene->GetTransforms());
+    // cube3->m_transform.SetPosition(Vec3 { 1.0f, 2.0f, 3.0f });
     // p_scene->AddModel(cube3);
 
     p_renderer->SetScene(p_scene);
@@ -71,21 +77,117 @@ App::~App()
     delete p_surface;
     delete p_instance;
     delete p_window;
+    delete p_jobSystem;
 }
 
 void App::Run()
 {
     while (!p_window->ShouldClose()) {
-        if (m_resized) {
-            HandleResize();
-        } else {
-            glfwPollEvents();
-            p_renderer->Update(ImGui::GetIO().DeltaTime);
-            p_renderer->Render();
-        }
+        RunFrame();
+    }
+
+    vkDeviceWaitIdle(p_device->GetDevice());
+}
+
+int App::RunVariantProfile()
+{
+    if (!p_renderer->IsGpuTimerSupported()) {
+        std::cerr << "variant profile: the graphics queue has no timestamps\n";
+        return 1;
+    }
+
+    p_renderer->StartVariantProfile();
+
+    if (!RenderUntilProfiled("variant profile")) {
+        return 1;
+    }
+
+    // The unlit, untextured variant comes first, the last column is relative to it.
+    const char* lightingModels[] = { "Phong", "Blinn-Phong", "Lambert" };
+    const std::vector<VariantProfile>& profiles = p_renderer->GetVariantProfiles();
+
+    printf("%-10s %6s %-12s %12s %10s\n", "texture", "lights", "lighting", "scene ms", "delta ms");
+    for (const VariantProfile& profile : profiles) {
+        printf("%-10s %6u %-12s %12.4f %+10.4f\n", profile.variant.useTexture ? "yes" : "no", profile.variant.lightCount, lightingModels[static_cast<uint32_t>(profile.variant.lightingModel)], profile.gpuMs, profile.gpuMs - profiles[0].gpuMs);
+    }
+
+    return 0;
+}
+
+int App::RunVertexProfile()
+{
+    if (!p_renderer->IsGpuTimerSupported()) {
+        std::cerr << "vertex profile: the graphics queue has no timestamps\n";
+        return 1;
+    }
+
+    p_renderer->StartVertexProfile();
+
+    if (!RenderUntilProfiled("vertex profile")) {
+        return 1;
+    }
+
+    // Derived first, so the delta is what precomputing the matrices saves.
+    const std::vector<VariantProfile>& profiles = p_renderer->GetVariantProfiles();
+
+    printf("%-12s %12s %10s\n", "matrices", "scene ms", "delta ms");
+    for (const VariantProfile& profile : profiles) {
+        printf("%-12s %12.4f %+10.4f\n", profile.vertex.deriveMatrices ? "derived" : "precomputed", profile.gpuMs, profile.gpuMs - profiles[0].gpuMs);
+    }
+
+    return 0;
+}
+
+int App::RunDrawProfile()
+{
+    if (!p_renderer->IsGpuTimerSupported()) {
+        std::cerr << "draw profile: the graphics queue has no timestamps\n";
+        return 1;
+    }
+
+    p_renderer->StartDrawProfile();
+
+    if (!RenderUntilProfiled("draw profile")) {
+        return 1;
+    }
+
+    // Instanced first, the deltas are what one draw per model costs on top.
+    const std::vector<VariantProfile>& profiles = p_renderer->GetVariantProfiles();
+
+    printf("%-15s %12s %10s %12s %10s\n", "draws", "scene ms", "delta ms", "record ms", "delta ms");
+    for (const VariantProfile& profile : profiles) {
+        printf("%-15s %12.4f %+10.4f %12.4f %+10.4f\n", profile.pushConstantDraws ? "push constants" : "instanced", profile.gpuMs, profile.gpuMs - profiles[0].gpuMs,
+            profile.recordMs, profile.recordMs - profiles[0].recordMs);
+    }
+
+    return 0;
+}
+
+bool App::RenderUntilProfiled(const char* name)
+{
+    while (!p_renderer->IsVariantProfileDone() && !p_window->ShouldClose()) {
+        RunFrame();
     }
 
     vkDeviceWaitIdle(p_device->GetDevice());
+
+    if (!p_renderer->IsVariantProfileDone()) {
+        std::cerr << name << ": window closed before every variant was measured\n";
+        return false;
+    }
+
+    return true;
+}
+
+void App::RunFrame()
+{
+    if (m_resized) {
+        HandleResize();
+    } else {
+        glfwPollEvents();
+        p_renderer->Update(ImGui::GetIO().DeltaTime);
+        p_renderer->Render();
+    }
 }
 
 void App::SetupDebugMessenger()
@@ -108,13 +210,13 @@ void App::HandleResize()
         glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(p_device->GetDevice());
-
     p_window->SetWidth(width);
     p_window->SetHeight(height);
 
-    delete p_swapChain;
-    p_swapChain = new SwapChain { p_window, p_surface, p_device };
+    // No device idle here, the retired swapchain's objects go through the deletion queue.
+    SwapChain* pOldSwapChain = p_swapChain;
+    p_swapChain = new SwapChain { p_window, p_surface, p_device, pOldSwapChain };
+    delete pOldSwapChain;
     p_pipeline->UpdateSwapChain(p_swapChain);
     p_renderer->UpdateSwapChain(p_swapChain);
 
@@ -159,6 +261,7 @@ void App::InitGui()
 
     ImGui_ImplVulkan_Init(&info, p_pipeline->GetRenderPass());
 
+    // The backend records graphics stage barriers, so the font upload cannot go through the transfer queue.
     commandBuffer.Begin();
     ImGui_ImplVulkan_CreateFontsTexture(commandBuffer.GetHandle());
     commandBuffer.End();
@@ -169,10 +272,12 @@ void App::InitGui()
         submitInfo.pCommandBuffers = commandBuffer.GetPtr();
     }
 
-    CHECK_VK(vkQueueSubmit(p_device->GetQueue(), 1, &submitInfo, VK_NULL_HANDLE));
-    CHECK_VK(vkQueueWaitIdle(p_device->GetQueue()));
+    VkResult result = vkQueueSubmit(p_device->GetQueue(), 1, &submitInfo, VK_NULL_HANDLE);
+    CHECK_VK(result);
+
+    result = vkQueueWaitIdle(p_device->GetQueue());
+    CHECK_VK(result);
 
-    vkDeviceWaitIdle(p_device->GetDevice());
     ImGui_ImplVulkan_DestroyFontUploadObjects();
 
     delete p_command;
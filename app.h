@@ -9,17 +9,23 @@ class Pipeline;
 class Renderer;
 class Scene;
 class DescriptorPool;
+class JobSystem;
 
 class App {
 public:
-    App();
+    App(bool visible = true);
     ~App();
 
 public:
     void Run();
+    int RunVariantProfile(); // renders until every fragment variant is measured, prints them, 0 on success
+    int RunVertexProfile(); // same for the derived and the precomputed matrices of simple.vert on the high-poly sphere
+    int RunDrawProfile(); // same for instanced and push constant draws of 10000 cubes, with CPU record time
     void SetResizedTrue() { m_resized = true; }
 
 private:
+    void RunFrame();
+    bool RenderUntilProfiled(const char* name); // false if the window closed first
     void SetupDebugMessenger();
     void HandleResize();
     void InitGui();
@@ -37,6 +43,7 @@ private:
     VkDebugUtilsMessengerEXT m_debugMessenger;
 
 private:
+    JobSystem* p_jobSystem;
     Window* p_window;
     Instance* p_instance;
     Surface* p_surface;
@@ -0,0 +1,289 @@
+#include "job_system.h"
+#include "bvh.h"
+#include "draw_item.h"
+#include "transform_array.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/*
+ * Console front end for the CPU benchmarks. They run here rather than from the Settings window, where
+ * they would stall the frame being recorded.
+ *
+ *   cpu_benchmark jobs [jobCount] [maxThreads]   scheduling overhead and scaling for 1, 2, 4 .. maxThreads
+ *   cpu_benchmark stress [rounds] [maxThreads]   nested jobs, dependencies and ParallelFor, checked every round
+ *   cpu_benchmark bvh [maxCount] [threads]       build, refit and queries for 100k, 250k, 500k .. maxCount boxes
+ *   cpu_benchmark transforms [maxCount]          glm vs SSE world and normal matrices for 10k, 100k .. maxCount
+ *   cpu_benchmark scene [maxCount]               by-value model list vs packed draw items for 512, 1024 .. maxCount
+ *
+ * maxThreads defaults to the hardware threads, stress uses at least MIN_STRESS_THREADS so stealing and
+ * sleeping workers are exercised on small machines too.
+ *
+ * stress exits with 1 on the first wrong result, build with -DCPU_BENCHMARK_SANITIZER=address to run it
+ * under AddressSanitizer.
+ */
+
+namespace {
+enum { DEFAULT_JOB_COUNT = 100000 };
+enum { DEFAULT_STRESS_ROUNDS = 200 };
+enum { MIN_STRESS_THREADS = 8 };
+enum { DEFAULT_BVH_COUNT = 1000000 };
+enum { DEFAULT_TRANSFORM_COUNT = 1000000 };
+enum { DEFAULT_SCENE_COUNT = 4096 };
+
+struct SceneBenchmark {
+    uint32_t count;
+    float copyMs; // N accesses through a by-value model list, the old recording loop
+    float inPlaceMs; // one pass over the draw items
+};
+
+std::vector<uint32_t> GetThreadCounts(uint32_t maxThreads)
+{
+    std::vector<uint32_t> counts;
+
+    for (uint32_t count = 1; count < maxThreads; count *= 2) {
+        counts.push_back(count);
+    }
+    counts.push_back(maxThreads);
+
+    return counts;
+}
+
+void RunJobBenchmark(uint32_t jobCount, uint32_t maxThreads)
+{
+    printf("job system, %u jobs, %u hardware threads\n", jobCount, std::thread::hardware_concurrency());
+    printf("%8s %14s %12s %12s %9s\n", "threads", "ns/empty job", "serial ms", "parallel ms", "speedup");
+
+    for (uint32_t threadCount : GetThreadCounts(maxThreads)) {
+        JobSystem* pJobSystem = new JobSystem { threadCount };
+        JobBenchmark benchmark = pJobSystem->Benchmark(jobCount);
+        delete pJobSystem;
+
+        printf("%8u %14.1f %12.2f %12.2f %8.2fx\n", threadCount, benchmark.nsPerEmptyJob, benchmark.serialMs, benchmark.parallelMs, benchmark.speedup);
+    }
+}
+
+// One round: jobs that start jobs, a stage that depends on another, and ParallelFor with odd grain sizes.
+bool RunStressRound(JobSystem* pJobSystem, uint32_t round)
+{
+    enum { OUTER_JOBS = 64 };
+    enum { INNER_JOBS = 96 }; // OUTER_JOBS * INNER_JOBS overflows a single queue, so Push has to fall back
+    enum { ITEM_COUNT = 50000 };
+
+    std::vector<uint32_t> produced(OUTER_JOBS * INNER_JOBS, 0);
+    std::vector<uint32_t> consumed(OUTER_JOBS * INNER_JOBS, 0);
+    std::atomic<uint32_t> lateReads { 0 };
+
+    JobCounter produceCounter;
+    JobCounter consumeCounter;
+
+    for (uint32_t outer = 0; outer < OUTER_JOBS; outer++) {
+        pJobSystem->Run([pJobSystem, outer, round, &produced]() {
+            JobCounter innerCounter;
+
+            for (uint32_t inner = 0; inner < INNER_JOBS; inner++) {
+                pJobSystem->Run([outer, inner, round, &produced]() { produced[outer * INNER_JOBS + inner] = outer * INNER_JOBS + inner + round; }, &innerCounter);
+            }
+            pJobSystem->Wait(&innerCounter); // a worker waiting inside a job runs other jobs meanwhile
+        },
+            &produceCounter);
+    }
+
+    // Held back until every producer, and with it every inner job, has finished.
+    for (uint32_t outer = 0; outer < OUTER_JOBS; outer++) {
+        pJobSystem->Run([outer, &produced, &consumed, &lateReads]() {
+            for (uint32_t inner = 0; inner < INNER_JOBS; inner++) {
+                uint32_t index = outer * INNER_JOBS + inner;
+
+                if (produced[index] == 0 && index != 0) {
+                    lateReads.fetch_add(1, std::memory_order_relaxed);
+                }
+                consumed[index] = produced[index] * 2;
+            }
+        },
+            &consumeCounter, &produceCounter);
+    }
+
+    pJobSystem->Wait(&consumeCounter);
+
+    if (!produceCounter.IsDone() || lateReads.load() != 0) {
+        printf("round %u: a dependent job ran before its dependency finished\n", round);
+        return false;
+    }
+
+    for (uint32_t index = 0; index < OUTER_JOBS * INNER_JOBS; index++) {
+        if (consumed[index] != (index + round) * 2) {
+            printf("round %u: item %u is %u, expected %u\n", round, index, consumed[index], (index + round) * 2);
+            return false;
+        }
+    }
+
+    // Every item exactly once, whatever the grain size.
+    std::vector<std::atomic<uint32_t>> visits(ITEM_COUNT);
+    uint32_t grainSize = 1 + (round * 37) % 1000;
+    pJobSystem->ParallelFor(ITEM_COUNT, grainSize, [&visits](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            visits[i].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    for (uint32_t i = 0; i < ITEM_COUNT; i++) {
+        if (visits[i].load() != 1) {
+            printf("round %u: ParallelFor visited item %u %u times (grain %u)\n", round, i, visits[i].load(), grainSize);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int RunStress(uint32_t rounds, uint32_t maxThreads)
+{
+    for (uint32_t threadCount : GetThreadCounts(maxThreads)) {
+        JobSystem* pJobSystem = new JobSystem { threadCount };
+        auto start = std::chrono::steady_clock::now();
+        bool passed = true;
+
+        for (uint32_t round = 0; round < rounds && passed; round++) {
+            passed = RunStressRound(pJobSystem, round);
+        }
+
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        JobStats stats = pJobSystem->GetStats();
+        delete pJobSystem;
+
+        printf("stress, %2u threads : %s, %u rounds in %.0f ms, %llu jobs, %llu stolen\n", threadCount, passed ? "passed" : "FAILED", rounds, ms,
+            static_cast<unsigned long long>(stats.executedCount), static_cast<unsigned long long>(stats.stealCount));
+
+        if (!passed) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void RunBvhBenchmark(uint32_t maxCount, uint32_t threadCount)
+{
+    JobSystem* pJobSystem = new JobSystem { threadCount };
+
+    printf("bvh, built on %u threads\n", pJobSystem->GetThreadCount());
+    printf("%9s %9s %10s %10s %11s %11s %9s %10s %10s\n", "boxes", "nodes", "build ms", "refit ms", "frustum ms", "linear ms", "hits", "10k rays", "10k boxes");
+
+    std::vector<uint32_t> counts = { 100000, 250000, 500000 };
+    counts.erase(std::remove_if(counts.begin(), counts.end(), [maxCount](uint32_t count) { return count >= maxCount; }), counts.end());
+    counts.push_back(maxCount);
+
+    for (uint32_t count : counts) {
+        BvhBenchmark benchmark = Bvh::Benchmark(count, pJobSystem);
+
+        printf("%9u %9u %10.1f %10.2f %11.3f %11.3f %9u %10.2f %10.2f\n", benchmark.count, benchmark.nodeCount, benchmark.buildMs, benchmark.refitMs,
+            benchmark.frustumMs, benchmark.linearFrustumMs, benchmark.frustumHits, benchmark.rayMs, benchmark.boxMs);
+    }
+
+    delete pJobSystem;
+}
+
+void RunTransformBenchmark(uint32_t maxCount)
+{
+    printf("transforms, one thread\n");
+    printf("%9s %10s %10s %9s %11s\n", "count", "glm ms", "simd ms", "speedup", "max error");
+
+    for (uint32_t count = 10000; count < maxCount; count *= 10) {
+        TransformBenchmark benchmark = TransformArray::Benchmark(count);
+        printf("%9u %10.2f %10.2f %8.2fx %11.2g\n", benchmark.count, benchmark.glmMs, benchmark.simdMs, benchmark.speedup, benchmark.maxError);
+    }
+
+    TransformBenchmark benchmark = TransformArray::Benchmark(maxCount);
+    printf("%9u %10.2f %10.2f %8.2fx %11.2g\n", benchmark.count, benchmark.glmMs, benchmark.simdMs, benchmark.speedup, benchmark.maxError);
+}
+
+// Only the containers are measured, the model pointers are never dereferenced.
+SceneBenchmark BenchmarkSceneIteration(uint32_t count)
+{
+    SceneBenchmark benchmark {};
+    benchmark.count = count;
+
+    std::vector<const void*> models(count, nullptr);
+    std::vector<DrawItem> drawItems(count);
+    for (uint32_t i = 0; i < count; i++) {
+        drawItems[i].mesh.indexCount = i;
+    }
+
+    auto getModels = [&models]() { return models; };
+    uintptr_t copySum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < getModels().size(); i++) {
+        copySum += reinterpret_cast<uintptr_t>(getModels()[i]);
+    }
+    benchmark.copyMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t inPlaceSum = 0;
+
+    start = std::chrono::steady_clock::now();
+    for (const DrawItem& item : drawItems) {
+        inPlaceSum += item.mesh.indexCount;
+    }
+    benchmark.inPlaceMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Keeps both loops from being optimized away.
+    if (copySum + inPlaceSum == 1) {
+        benchmark.count++;
+    }
+
+    return benchmark;
+}
+
+// The old by-value GetModels grew with the square of the model count, ns per item should stay flat now.
+void RunSceneBenchmark(uint32_t maxCount)
+{
+    printf("scene iteration\n");
+    printf("%9s %16s %22s\n", "models", "copy ns/item", "in place ns/item");
+
+    for (uint32_t count = 512; count <= maxCount; count *= 2) {
+        SceneBenchmark benchmark = BenchmarkSceneIteration(count);
+        printf("%9u %16.1f %22.2f\n", benchmark.count, benchmark.copyMs * 1e6f / benchmark.count, benchmark.inPlaceMs * 1e6f / benchmark.count);
+    }
+}
+
+uint32_t GetArgument(int argc, char** argv, int index, uint32_t defaultValue)
+{
+    return index < argc ? static_cast<uint32_t>(strtoul(argv[index], nullptr, 10)) : defaultValue;
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "jobs";
+    uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    if (mode == "jobs") {
+        RunJobBenchmark(GetArgument(argc, argv, 2, DEFAULT_JOB_COUNT), std::max(GetArgument(argc, argv, 3, hardwareThreads), 1u));
+        return 0;
+    }
+    if (mode == "stress") {
+        uint32_t maxThreads = GetArgument(argc, argv, 3, std::max<uint32_t>(hardwareThreads, MIN_STRESS_THREADS));
+        return RunStress(GetArgument(argc, argv, 2, DEFAULT_STRESS_ROUNDS), std::max(maxThreads, 1u));
+    }
+
+    if (mode == "bvh") {
+        RunBvhBenchmark(std::max(GetArgument(argc, argv, 2, DEFAULT_BVH_COUNT), 1u), GetArgument(argc, argv, 3, 0));
+        return 0;
+    }
+
+    if (mode == "transforms") {
+        RunTransformBenchmark(std::max(GetArgument(argc, argv, 2, DEFAULT_TRANSFORM_COUNT), 1u));
+        return 0;
+    }
+
+    if (mode == "scene") {
+        RunSceneBenchmark(GetArgument(argc, argv, 2, DEFAULT_SCENE_COUNT));
+        return 0;
+    }
+
+    printf("usage: cpu_benchmark jobs [jobCount] [maxThreads] | stress [rounds] [maxThreads] | bvh [maxCount] [threads] | transforms [maxCount] | scene [maxCount]\n");
+    return 1;
+}
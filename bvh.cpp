@@ -0,0 +1,523 @@
+// No pch.h, the BVH builds without a window or Vulkan (see benchmarks/).
+#include "bvh.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace {
+enum Containment { OUTSIDE,
+    INTERSECTING,
+    INSIDE };
+
+float HalfArea(const Vec3& min, const Vec3& max)
+{
+    Vec3 extent = max - min;
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+Containment Classify(const Frustum& frustum, const Vec3& min, const Vec3& max)
+{
+    Containment result = INSIDE;
+
+    for (const Vec4& plane : frustum.planes) {
+        // Corner furthest along the plane normal, and the one furthest against it.
+        Vec3 positive { plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z };
+        Vec3 negative { plane.x >= 0.0f ? min.x : max.x, plane.y >= 0.0f ? min.y : max.y, plane.z >= 0.0f ? min.z : max.z };
+
+        if (glm::dot(Vec3 { plane }, positive) + plane.w < 0.0f) {
+            return OUTSIDE;
+        }
+        if (glm::dot(Vec3 { plane }, negative) + plane.w < 0.0f) {
+            result = INTERSECTING;
+        }
+    }
+
+    return result;
+}
+
+bool Overlaps(const Aabb& a, const Vec3& min, const Vec3& max)
+{
+    return a.min.x <= max.x && a.max.x >= min.x && a.min.y <= max.y && a.max.y >= min.y && a.min.z <= max.z && a.max.z >= min.z;
+}
+
+bool Contains(const Aabb& a, const Vec3& min, const Vec3& max)
+{
+    return a.min.x <= min.x && a.max.x >= max.x && a.min.y <= min.y && a.max.y >= max.y && a.min.z <= min.z && a.max.z >= max.z;
+}
+
+// Entry distance of the ray into the box, or a negative value when it misses within [0, maxDistance].
+float IntersectRay(const Vec3& origin, const Vec3& inverseDirection, float maxDistance, const Vec3& min, const Vec3& max)
+{
+    Vec3 t0 = (min - origin) * inverseDirection;
+    Vec3 t1 = (max - origin) * inverseDirection;
+    Vec3 tNear = glm::min(t0, t1);
+    Vec3 tFar = glm::max(t0, t1);
+
+    float enter = std::max({ tNear.x, tNear.y, tNear.z, 0.0f });
+    float exit = std::min({ tFar.x, tFar.y, tFar.z, maxDistance });
+
+    return enter <= exit ? enter : -1.0f;
+}
+
+uint32_t NextRandom(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+float RandomFloat(uint32_t& state, float min, float max)
+{
+    return min + (max - min) * (NextRandom(state) & 0xFFFFFF) / static_cast<float>(0xFFFFFF);
+}
+}
+
+void Bvh::Build(const std::vector<Aabb>& bounds, JobSystem* pJobSystem)
+{
+    Clear();
+
+    uint32_t count = static_cast<uint32_t>(bounds.size());
+
+    if (count == 0) {
+        return;
+    }
+
+    m_primitives.resize(count);
+    m_centroids.resize(count);
+    m_primitiveLeaves.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        m_primitives[i] = i;
+        m_centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+    }
+
+    // A binary tree with at least one primitive per leaf never needs more than 2n - 1 nodes,
+    // so the array is sized once and threads can take node pairs with an atomic add.
+    m_nodes.resize(2 * count - 1);
+    m_parents.resize(2 * count - 1);
+    m_parents[0] = UINT32_MAX;
+    m_nodeCount.store(1);
+
+    BuildNode(0, 0, count, bounds, pJobSystem);
+
+    m_nodes.resize(GetNodeCount());
+    m_parents.resize(GetNodeCount());
+
+    m_primitiveBounds.resize(count);
+    m_primitiveOrder.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        m_primitiveBounds[i] = bounds[m_primitives[i]];
+        m_primitiveOrder[m_primitives[i]] = i;
+    }
+    m_refitFlags.assign(GetNodeCount(), 0);
+
+    m_centroids.clear();
+    m_centroids.shrink_to_fit();
+}
+
+void Bvh::Refit(const std::vector<Aabb>& bounds, const std::vector<uint32_t>& changed)
+{
+    // Every node above a moved primitive is collected once, the walk up stops at a node already taken.
+    for (uint32_t primitive : changed) {
+        m_primitiveBounds[m_primitiveOrder[primitive]] = bounds[primitive];
+
+        for (uint32_t node = m_primitiveLeaves[primitive]; node != UINT32_MAX && !m_refitFlags[node]; node = m_parents[node]) {
+            m_refitFlags[node] = 1;
+            m_refitNodes.push_back(node);
+        }
+    }
+
+    // Children have larger indices than their parents, so descending order refits bottom up.
+    std::sort(m_refitNodes.begin(), m_refitNodes.end(), std::greater<uint32_t>());
+
+    for (uint32_t node : m_refitNodes) {
+        UpdateNodeBounds(node);
+        m_refitFlags[node] = 0;
+    }
+
+    m_refitNodes.clear();
+}
+
+void Bvh::Clear()
+{
+    m_nodes.clear();
+    m_parents.clear();
+    m_primitives.clear();
+    m_primitiveBounds.clear();
+    m_primitiveLeaves.clear();
+    m_primitiveOrder.clear();
+    m_refitFlags.clear();
+    m_nodeCount.store(0);
+}
+
+void Bvh::QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& hits) const
+{
+    if (m_nodes.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> stack { 0 };
+
+    while (!stack.empty()) {
+        uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+
+        const BvhNode& node = m_nodes[nodeIndex];
+        Containment containment = Classify(frustum, node.min, node.max);
+
+        if (containment == OUTSIDE) {
+            continue;
+        }
+
+        if (containment == INSIDE) {
+            AppendSubtree(nodeIndex, hits);
+        } else if (node.IsLeaf()) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (Classify(frustum, m_primitiveBounds[i].min, m_primitiveBounds[i].max) != OUTSIDE) {
+                    hits.push_back(m_primitives[i]);
+                }
+            }
+        } else {
+            stack.push_back(node.first + 1);
+            stack.push_back(node.first);
+        }
+    }
+}
+
+void Bvh::QueryBox(const Aabb& box, std::vector<uint32_t>& hits) const
+{
+    if (m_nodes.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> stack { 0 };
+
+    while (!stack.empty()) {
+        uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+
+        const BvhNode& node = m_nodes[nodeIndex];
+
+        if (!Overlaps(box, node.min, node.max)) {
+            continue;
+        }
+
+        if (Contains(box, node.min, node.max)) {
+            AppendSubtree(nodeIndex, hits);
+        } else if (node.IsLeaf()) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (Overlaps(box, m_primitiveBounds[i].min, m_primitiveBounds[i].max)) {
+                    hits.push_back(m_primitives[i]);
+                }
+            }
+        } else {
+            stack.push_back(node.first + 1);
+            stack.push_back(node.first);
+        }
+    }
+}
+
+uint32_t Bvh::Raycast(const Vec3& origin, const Vec3& direction, float maxDistance, float* pDistance) const
+{
+    uint32_t hit = UINT32_MAX;
+
+    if (m_nodes.empty()) {
+        return hit;
+    }
+
+    // Division by a zero component gives an infinity, which the slab test handles.
+    Vec3 inverseDirection { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+    float nearest = maxDistance;
+
+    std::vector<uint32_t> stack { 0 };
+
+    while (!stack.empty()) {
+        uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+
+        const BvhNode& node = m_nodes[nodeIndex];
+
+        if (IntersectRay(origin, inverseDirection, nearest, node.min, node.max) < 0.0f) {
+            continue;
+        }
+
+        if (!node.IsLeaf()) {
+            // The nearer child goes on top, its hits shrink the range the other one is tested with.
+            const BvhNode& left = m_nodes[node.first];
+            const BvhNode& right = m_nodes[node.first + 1];
+            float leftDistance = IntersectRay(origin, inverseDirection, nearest, left.min, left.max);
+            float rightDistance = IntersectRay(origin, inverseDirection, nearest, right.min, right.max);
+
+            bool leftFirst = leftDistance >= 0.0f && (rightDistance < 0.0f || leftDistance <= rightDistance);
+            stack.push_back(leftFirst ? node.first + 1 : node.first);
+            stack.push_back(leftFirst ? node.first : node.first + 1);
+            continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            float distance = IntersectRay(origin, inverseDirection, nearest, m_primitiveBounds[i].min, m_primitiveBounds[i].max);
+            if (distance >= 0.0f && distance <= nearest) {
+                nearest = distance;
+                hit = m_primitives[i];
+            }
+        }
+    }
+
+    if (pDistance != nullptr && hit != UINT32_MAX) {
+        *pDistance = nearest;
+    }
+
+    return hit;
+}
+
+void Bvh::BuildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, const std::vector<Aabb>& bounds, JobSystem* pJobSystem)
+{
+    BvhNode& node = m_nodes[nodeIndex];
+    uint32_t count = end - begin;
+
+    Vec3 centroidMin { std::numeric_limits<float>::max() };
+    Vec3 centroidMax { std::numeric_limits<float>::lowest() };
+    node.min = Vec3 { std::numeric_limits<float>::max() };
+    node.max = Vec3 { std::numeric_limits<float>::lowest() };
+
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t primitive = m_primitives[i];
+        node.min = glm::min(node.min, bounds[primitive].min);
+        node.max = glm::max(node.max, bounds[primitive].max);
+        centroidMin = glm::min(centroidMin, m_centroids[primitive]);
+        centroidMax = glm::max(centroidMax, m_centroids[primitive]);
+    }
+
+    auto makeLeaf = [&]() {
+        node.first = begin;
+        node.count = count;
+        for (uint32_t i = begin; i < end; i++) {
+            m_primitiveLeaves[m_primitives[i]] = nodeIndex;
+        }
+    };
+
+    if (count == 1) {
+        makeLeaf();
+        return;
+    }
+
+    // Binned SAH, cost of a split = traversal + sum of child area * child count, relative to this node's area.
+    struct Bin {
+        Vec3 min { std::numeric_limits<float>::max() };
+        Vec3 max { std::numeric_limits<float>::lowest() };
+        uint32_t count { 0 };
+    };
+
+    float parentArea = std::max(HalfArea(node.min, node.max), std::numeric_limits<float>::min());
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+
+        if (extent <= 0.0f) {
+            continue;
+        }
+
+        float scale = BIN_COUNT / extent;
+        Bin bins[BIN_COUNT];
+
+        for (uint32_t i = begin; i < end; i++) {
+            uint32_t primitive = m_primitives[i];
+            uint32_t b = std::min(static_cast<uint32_t>((m_centroids[primitive][axis] - centroidMin[axis]) * scale), static_cast<uint32_t>(BIN_COUNT - 1));
+            bins[b].min = glm::min(bins[b].min, bounds[primitive].min);
+            bins[b].max = glm::max(bins[b].max, bounds[primitive].max);
+            bins[b].count++;
+        }
+
+        // Sweep from the right to get the cost of everything right of each split, then from the left.
+        float rightCost[BIN_COUNT] {};
+        Bin right;
+        for (uint32_t b = BIN_COUNT - 1; b > 0; b--) {
+            right.min = glm::min(right.min, bins[b].min);
+            right.max = glm::max(right.max, bins[b].max);
+            right.count += bins[b].count;
+            rightCost[b] = right.count > 0 ? HalfArea(right.min, right.max) * right.count : 0.0f;
+        }
+
+        Bin left;
+        for (uint32_t b = 0; b < BIN_COUNT - 1; b++) {
+            left.min = glm::min(left.min, bins[b].min);
+            left.max = glm::max(left.max, bins[b].max);
+            left.count += bins[b].count;
+
+            if (left.count == 0 || left.count == count) {
+                continue;
+            }
+
+            float cost = 1.0f + (HalfArea(left.min, left.max) * left.count + rightCost[b + 1]) / parentArea;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b + 1;
+            }
+        }
+    }
+
+    if (count <= MAX_LEAF_SIZE && static_cast<float>(count) <= bestCost) {
+        makeLeaf();
+        return;
+    }
+
+    uint32_t* pBegin = m_primitives.data() + begin;
+    uint32_t* pEnd = m_primitives.data() + end;
+    uint32_t* pMid = pBegin;
+
+    if (bestAxis >= 0) {
+        float scale = BIN_COUNT / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        pMid = std::partition(pBegin, pEnd, [&](uint32_t primitive) {
+            return std::min(static_cast<uint32_t>((m_centroids[primitive][bestAxis] - centroidMin[bestAxis]) * scale), static_cast<uint32_t>(BIN_COUNT - 1)) < bestSplit;
+        });
+    }
+
+    // All centroids in one point, or no split left both sides non-empty: halve the range instead.
+    if (pMid == pBegin || pMid == pEnd) {
+        pMid = pBegin + count / 2;
+    }
+
+    uint32_t mid = static_cast<uint32_t>(pMid - m_primitives.data());
+    uint32_t left = m_nodeCount.fetch_add(2, std::memory_order_relaxed);
+
+    node.first = left;
+    node.count = 0;
+    m_parents[left] = nodeIndex;
+    m_parents[left + 1] = nodeIndex;
+
+    if (pJobSystem != nullptr && count >= PARALLEL_BUILD_SIZE) {
+        JobCounter counter;
+        pJobSystem->Run([=, &bounds]() { BuildNode(left, begin, mid, bounds, pJobSystem); }, &counter);
+        BuildNode(left + 1, mid, end, bounds, pJobSystem);
+        pJobSystem->Wait(&counter);
+    } else {
+        BuildNode(left, begin, mid, bounds, pJobSystem);
+        BuildNode(left + 1, mid, end, bounds, pJobSystem);
+    }
+}
+
+void Bvh::AppendSubtree(uint32_t nodeIndex, std::vector<uint32_t>& hits) const
+{
+    std::vector<uint32_t> stack { nodeIndex };
+
+    while (!stack.empty()) {
+        const BvhNode& node = m_nodes[stack.back()];
+        stack.pop_back();
+
+        if (node.IsLeaf()) {
+            hits.insert(hits.end(), m_primitives.begin() + node.first, m_primitives.begin() + node.first + node.count);
+        } else {
+            stack.push_back(node.first + 1);
+            stack.push_back(node.first);
+        }
+    }
+}
+
+void Bvh::UpdateNodeBounds(uint32_t nodeIndex)
+{
+    BvhNode& node = m_nodes[nodeIndex];
+
+    if (node.IsLeaf()) {
+        node.min = Vec3 { std::numeric_limits<float>::max() };
+        node.max = Vec3 { std::numeric_limits<float>::lowest() };
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            node.min = glm::min(node.min, m_primitiveBounds[i].min);
+            node.max = glm::max(node.max, m_primitiveBounds[i].max);
+        }
+        return;
+    }
+
+    const BvhNode& left = m_nodes[node.first];
+    const BvhNode& right = m_nodes[node.first + 1];
+    node.min = glm::min(left.min, right.min);
+    node.max = glm::max(left.max, right.max);
+}
+
+BvhBenchmark Bvh::Benchmark(uint32_t count, JobSystem* pJobSystem)
+{
+    BvhBenchmark benchmark {};
+    benchmark.count = count;
+
+    // Unit-ish boxes spread so the density stays the same for every count.
+    uint32_t seed = 0x9E3779B9u;
+    float halfSize = std::cbrt(static_cast<float>(count)) * 2.0f;
+    std::vector<Aabb> bounds(count);
+
+    for (Aabb& box : bounds) {
+        Vec3 center { RandomFloat(seed, -halfSize, halfSize), RandomFloat(seed, -halfSize, halfSize), RandomFloat(seed, -halfSize, halfSize) };
+        Vec3 extent { RandomFloat(seed, 0.25f, 1.0f), RandomFloat(seed, 0.25f, 1.0f), RandomFloat(seed, 0.25f, 1.0f) };
+        box = Aabb { center - extent, center + extent };
+    }
+
+    Bvh bvh;
+
+    auto start = std::chrono::steady_clock::now();
+    bvh.Build(bounds, pJobSystem);
+    benchmark.buildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    benchmark.nodeCount = bvh.GetNodeCount();
+
+    std::vector<uint32_t> moved;
+    for (uint32_t i = 0; i < count; i += 10) {
+        Vec3 offset { RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f) };
+        bounds[i].min += offset;
+        bounds[i].max += offset;
+        moved.push_back(i);
+    }
+
+    start = std::chrono::steady_clock::now();
+    bvh.Refit(bounds, moved);
+    benchmark.refitMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // A camera in the middle of the volume looking down +z.
+    Mat4 view = glm::lookAt(Vec3 { 0.0f }, Vec3 { 0.0f, 0.0f, 1.0f }, Vec3 { 0.0f, 1.0f, 0.0f });
+    Mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, halfSize);
+    Frustum frustum = Culling::ExtractFrustum(proj * view);
+
+    std::vector<uint32_t> hits;
+    hits.reserve(count);
+
+    start = std::chrono::steady_clock::now();
+    bvh.QueryFrustum(frustum, hits);
+    benchmark.frustumMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    benchmark.frustumHits = static_cast<uint32_t>(hits.size());
+
+    hits.clear();
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++) {
+        if (Classify(frustum, bounds[i].min, bounds[i].max) != OUTSIDE) {
+            hits.push_back(i);
+        }
+    }
+    benchmark.linearFrustumMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t rayHits = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < RAY_QUERIES; i++) {
+        Vec3 origin { RandomFloat(seed, -halfSize, halfSize), RandomFloat(seed, -halfSize, halfSize), RandomFloat(seed, -halfSize, halfSize) };
+        Vec3 direction = glm::normalize(Vec3 { RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f) + 0.001f });
+        rayHits += bvh.Raycast(origin, direction, halfSize * 2.0f) != UINT32_MAX;
+    }
+    benchmark.rayMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BOX_QUERIES; i++) {
+        Vec3 center { RandomFloat(seed, -halfSize, halfSize), RandomFloat(seed, -halfSize, halfSize), RandomFloat(seed, -halfSize, halfSize) };
+        hits.clear();
+        bvh.QueryBox(Aabb { center - Vec3 { 4.0f }, center + Vec3 { 4.0f } }, hits);
+    }
+    benchmark.boxMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Keeps the ray loop from being optimized away.
+    if (rayHits > RAY_QUERIES) {
+        benchmark.count = 0;
+    }
+
+    return benchmark;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "culling.h"
+
+#include <atomic>
+
+class JobSystem;
+
+/*
+ * 32 bytes, two nodes per cache line. Siblings are stored next to each other, so an inner node
+ * only keeps the index of its left child. A child always has a larger index than its parent.
+ */
+struct BvhNode {
+    Vec3 min;
+    uint32_t first; // leaf: first entry in the primitive list, inner: left child, the right child is first + 1
+    Vec3 max;
+    uint32_t count; // primitives in a leaf, 0 for inner nodes
+
+    bool IsLeaf() const { return count > 0; }
+};
+
+struct BvhBenchmark {
+    uint32_t count;
+    uint32_t nodeCount;
+    float buildMs;
+    float refitMs; // after moving a tenth of the primitives
+    float frustumMs;
+    float linearFrustumMs; // the same frustum against every box, for comparison
+    uint32_t frustumHits;
+    float rayMs; // RAY_QUERIES nearest-hit rays
+    float boxMs; // BOX_QUERIES overlap queries
+};
+
+/*
+ * Bounding volume hierarchy over axis-aligned boxes. Primitives are referred to by their index in the
+ * bounds array given to Build. Build splits with a binned surface area heuristic and hands large subtrees
+ * to the job system, Refit only walks the paths above primitives that moved.
+ */
+class Bvh {
+public:
+    Bvh() = default;
+    ~Bvh() = default;
+    Bvh(const Bvh&) = delete;
+    Bvh(Bvh&&) = delete;
+    Bvh& operator=(const Bvh&) = delete;
+    Bvh& operator=(Bvh&&) = delete;
+
+public:
+    void Build(const std::vector<Aabb>& bounds, JobSystem* pJobSystem = nullptr); // nullptr builds on the calling thread
+    void Refit(const std::vector<Aabb>& bounds, const std::vector<uint32_t>& changed); // same primitives as the last Build
+    void Clear();
+
+    // Subtrees entirely inside the frustum are taken without testing their children.
+    void QueryFrustum(const Frustum&, std::vector<uint32_t>& hits) const;
+    void QueryBox(const Aabb&, std::vector<uint32_t>& hits) const;
+    // Nearest primitive box hit by the ray within [0, maxDistance], UINT32_MAX when nothing is hit.
+    uint32_t Raycast(const Vec3& origin, const Vec3& direction, float maxDistance, float* pDistance = nullptr) const;
+
+    static BvhBenchmark Benchmark(uint32_t count, JobSystem*);
+
+public: // getter
+    uint32_t GetNodeCount() const { return m_nodeCount.load(std::memory_order_relaxed); }
+    uint32_t GetPrimitiveCount() const { return static_cast<uint32_t>(m_primitives.size()); }
+    const std::vector<BvhNode>& GetNodes() const { return m_nodes; }
+
+private:
+    void BuildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, const std::vector<Aabb>& bounds, JobSystem*);
+    void AppendSubtree(uint32_t nodeIndex, std::vector<uint32_t>& hits) const;
+    void UpdateNodeBounds(uint32_t nodeIndex);
+
+private:
+    enum { BIN_COUNT = 12 };
+    enum { MAX_LEAF_SIZE = 4 };
+    enum { PARALLEL_BUILD_SIZE = 8192 }; // smaller subtrees are built by the job that reached them
+    enum { RAY_QUERIES = 10000 };
+    enum { BOX_QUERIES = 10000 };
+
+    std::vector<BvhNode> m_nodes;
+    std::vector<uint32_t> m_parents; // per node, UINT32_MAX for the root
+    std::vector<uint32_t> m_primitives; // primitive indices, every leaf owns a contiguous range
+    std::vector<Aabb> m_primitiveBounds; // in m_primitives order, so a leaf reads its boxes contiguously
+    std::vector<uint32_t> m_primitiveLeaves; // leaf of each primitive
+    std::vector<uint32_t> m_primitiveOrder; // position of each primitive in m_primitives
+    std::vector<Vec3> m_centroids; // only valid during Build
+    std::vector<uint8_t> m_refitFlags; // per node, scratch for Refit
+    std::vector<uint32_t> m_refitNodes;
+    std::atomic<uint32_t> m_nodeCount { 0 };
+};
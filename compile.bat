@@ -4,7 +4,7 @@ set GLSLC=%VULKAN_SDK%\Bin\glslc.exe
 
 set SHADERS_DIR=shaders
 
-for %%f in (%SHADERS_DIR%\*.vert %SHADERS_DIR%\*.frag) do (
+for %%f in (%SHADERS_DIR%\*.vert %SHADERS_DIR%\*.frag %SHADERS_DIR%\*.comp) do (
     %GLSLC% "%%f" -o "%%f.spv"
 )
 
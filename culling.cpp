@@ -0,0 +1,94 @@
+// No pch.h, culling builds without a window or Vulkan (see benchmarks/).
+#include "culling.h"
+
+#include <emmintrin.h>
+
+namespace {
+// Lanes whose sphere is not entirely behind any plane, as the low four bits.
+int TestSpheres(const Frustum& frustum, __m128 x, __m128 y, __m128 z, __m128 radius)
+{
+    __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+    __m128 outside = _mm_setzero_ps();
+
+    for (const Vec4& plane : frustum.planes) {
+        __m128 distance = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+        distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+        distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+    }
+
+    return ~_mm_movemask_ps(outside) & 0xF;
+}
+
+void AppendLanes(int mask, uint32_t base, std::vector<uint32_t>& visible)
+{
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        if (mask & (1 << lane)) {
+            visible.push_back(base + lane);
+        }
+    }
+}
+}
+
+Frustum Culling::ExtractFrustum(const Mat4& viewProj)
+{
+    // Gribb-Hartmann, glm is column major so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+    Vec4 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = Vec4 { viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i] };
+    }
+
+    Frustum frustum {};
+    frustum.planes[0] = row[3] + row[0];
+    frustum.planes[1] = row[3] - row[0];
+    frustum.planes[2] = row[3] + row[1];
+    frustum.planes[3] = row[3] - row[1];
+    frustum.planes[4] = row[2]; // 0 <= z, not -w <= z
+    frustum.planes[5] = row[3] - row[2];
+
+    for (Vec4& plane : frustum.planes) {
+        plane /= glm::length(Vec3 { plane });
+    }
+
+    return frustum;
+}
+
+Aabb Culling::TransformAabb(const Aabb& box, const Mat4& matrix)
+{
+    Vec3 center = Vec3 { matrix * Vec4 { (box.min + box.max) * 0.5f, 1.0f } };
+    Vec3 halfExtent = (box.max - box.min) * 0.5f;
+
+    Vec3 extent {};
+    for (int c = 0; c < 3; c++) {
+        extent += glm::abs(Vec3 { matrix[c] }) * halfExtent[c];
+    }
+
+    return Aabb { center - extent, center + extent };
+}
+
+void Culling::CullSpheres(const Frustum& frustum, const float* pCenterX, const float* pCenterY, const float* pCenterZ, const float* pRadius, uint32_t count, std::vector<uint32_t>& visible)
+{
+    uint32_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        int mask = TestSpheres(frustum, _mm_loadu_ps(pCenterX + i), _mm_loadu_ps(pCenterY + i), _mm_loadu_ps(pCenterZ + i), _mm_loadu_ps(pRadius + i));
+        AppendLanes(mask, i, visible);
+    }
+
+    if (i == count) {
+        return;
+    }
+
+    // The tail is padded with copies of its first sphere, the padded lanes are masked off.
+    float x[4], y[4], z[4], radius[4];
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        uint32_t index = i + lane < count ? i + lane : i;
+        x[lane] = pCenterX[index];
+        y[lane] = pCenterY[index];
+        z[lane] = pCenterZ[index];
+        radius[lane] = pRadius[index];
+    }
+
+    int mask = TestSpheres(frustum, _mm_loadu_ps(x), _mm_loadu_ps(y), _mm_loadu_ps(z), _mm_loadu_ps(radius));
+    AppendLanes(mask & ((1 << (count - i)) - 1), i, visible);
+}
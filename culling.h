@@ -0,0 +1,35 @@
+#pragma once
+
+#include "math_types.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct Aabb {
+    Vec3 min;
+    Vec3 max;
+};
+
+// Planes face inward, a point p is on the inner side of a plane when dot(plane.xyz, p) + plane.w >= 0.
+struct Frustum {
+    std::array<Vec4, 6> planes; // left, right, bottom, top, near, far
+};
+
+struct CullStats {
+    uint32_t visibleCount;
+    uint32_t culledCount;
+    float cullMs;
+};
+
+class Culling {
+public:
+    // Planes of a view-projection matrix with a [0, 1] depth range, normalized so distances are in world units.
+    static Frustum ExtractFrustum(const Mat4& viewProj);
+
+    // Box around the transformed box, from the center and the absolute rotation-scale part of the matrix.
+    static Aabb TransformAabb(const Aabb&, const Mat4&);
+
+    // Tests four spheres per SSE iteration and appends the index of every sphere that touches the frustum.
+    static void CullSpheres(const Frustum&, const float* pCenterX, const float* pCenterY, const float* pCenterZ, const float* pRadius, uint32_t count, std::vector<uint32_t>& visible);
+};
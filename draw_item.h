@@ -0,0 +1,24 @@
+#pragma once
+
+#include "math_types.h"
+
+#include <cstdint>
+
+// Indices and vertices of one mesh in a GeometryPool page.
+struct MeshRange {
+    uint32_t page { UINT32_MAX };
+    uint32_t firstIndex { 0 };
+    uint32_t indexCount { 0 };
+    int32_t vertexOffset { 0 };
+    uint32_t vertexCount { 0 };
+
+    bool IsValid() const { return page != UINT32_MAX; }
+};
+
+// What recording needs per draw, packed in draw order.
+struct DrawItem {
+    MeshRange mesh;
+    uint32_t meshId; // draws with the same mesh are instanced together
+    uint32_t objectSlot; // transform slot, also the uniform slot
+    Vec4 localBounds; // xyz center and w radius, model space
+};
@@ -92,4 +92,37 @@ public:
 
         return out;
     }
+
+    /*
+     * vertex : POSITION + NORMAL + TEXCOORD
+     * UV sphere of radius 1, (segments + 1) * (rings + 1) vertices with a seam column for the texture.
+     */
+    static MeshData CreateSphere(uint32_t segments, uint32_t rings)
+    {
+        MeshData out;
+        const float pi = glm::pi<float>();
+
+        for (uint32_t r = 0; r <= rings; r++) {
+            float theta = pi * r / rings;
+
+            for (uint32_t s = 0; s <= segments; s++) {
+                float phi = 2.0f * pi * s / segments;
+                Vec3 normal { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+                out.vertices.push_back({ normal, normal, { static_cast<float>(s) / segments, static_cast<float>(r) / rings } });
+            }
+        }
+
+        // Same winding as CreateCube, clockwise seen from outside in model space.
+        for (uint32_t r = 0; r < rings; r++) {
+            for (uint32_t s = 0; s < segments; s++) {
+                uint32_t a = r * (segments + 1) + s;
+                uint32_t b = a + 1;
+                uint32_t c = a + segments + 1;
+                uint32_t d = c + 1;
+                out.indices.insert(out.indices.end(), { a, c, b, b, c, d });
+            }
+        }
+
+        return out;
+    }
 };
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "pch.h"
+#include "geometry_pool.h"
+#include "vk_device.h"
+#include "vk_buffer.h"
+#include "vk_upload_context.h"
+#include "vk_deletion_queue.h"
+
+RangeAllocator::RangeAllocator(uint32_t capacity)
+    : m_capacity { capacity }
+{
+    m_freeRanges[0] = capacity;
+}
+
+bool RangeAllocator::Allocate(uint32_t count, uint32_t* pOffset)
+{
+    if (count == 0) {
+        *pOffset = 0;
+        return true;
+    }
+
+    for (auto it = m_freeRanges.begin(); it != m_freeRanges.end(); it++) {
+        if (it->second < count) {
+            continue;
+        }
+
+        uint32_t offset = it->first;
+        uint32_t remaining = it->second - count;
+        m_freeRanges.erase(it);
+
+        if (remaining > 0) {
+            m_freeRanges[offset + count] = remaining;
+        }
+
+        m_used += count;
+        *pOffset = offset;
+        return true;
+    }
+
+    return false;
+}
+
+void RangeAllocator::Free(uint32_t offset, uint32_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    m_used -= count;
+
+    auto next = m_freeRanges.lower_bound(offset);
+
+    // Merge with the following range.
+    if (next != m_freeRanges.end() && offset + count == next->first) {
+        count += next->second;
+        next = m_freeRanges.erase(next);
+    }
+
+    // Merge with the preceding range.
+    if (next != m_freeRanges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += count;
+            return;
+        }
+    }
+
+    m_freeRanges[offset] = count;
+}
+
+GeometryPool::GeometryPool(const Device* pDevice)
+    : p_device { pDevice }
+{
+}
+
+GeometryPool::~GeometryPool()
+{
+    for (Page* page : m_pages) {
+        delete page->p_vertexBuffer;
+        delete page->p_indexBuffer;
+        delete page;
+    }
+}
+
+MeshRange GeometryPool::Allocate(const MeshData& data)
+{
+    uint32_t vertexCount = static_cast<uint32_t>(data.vertices.size());
+    uint32_t indexCount = static_cast<uint32_t>(data.indices.size());
+
+    MeshRange range {};
+    range.vertexCount = vertexCount;
+    range.indexCount = indexCount;
+
+    uint32_t vertexOffset = 0;
+    uint32_t firstIndex = 0;
+
+    for (uint32_t i = 0; i < m_pages.size() && !range.IsValid(); i++) {
+        Page* page = m_pages[i];
+
+        if (!page->vertices.Allocate(vertexCount, &vertexOffset)) {
+            continue;
+        }
+
+        if (!page->indices.Allocate(indexCount, &firstIndex)) {
+            page->vertices.Free(vertexOffset, vertexCount);
+            continue;
+        }
+
+        range.page = i;
+    }
+
+    if (!range.IsValid()) {
+        // A mesh larger than a default page gets a page of its own size.
+        Page* page = CreatePage(std::max(static_cast<uint32_t>(PAGE_VERTEX_COUNT), vertexCount), std::max(static_cast<uint32_t>(PAGE_INDEX_COUNT), indexCount));
+        m_pages.push_back(page);
+
+        page->vertices.Allocate(vertexCount, &vertexOffset);
+        page->indices.Allocate(indexCount, &firstIndex);
+        range.page = static_cast<uint32_t>(m_pages.size() - 1);
+    }
+
+    range.vertexOffset = static_cast<int32_t>(vertexOffset);
+    range.firstIndex = firstIndex;
+
+    Page* page = m_pages[range.page];
+    UploadContext* uploadContext = p_device->GetUploadContext();
+    uploadContext->UploadBuffer(page->p_vertexBuffer->GetBuffer(), sizeof(Vertex) * vertexOffset, data.vertices.data(), sizeof(Vertex) * vertexCount);
+    uploadContext->UploadBuffer(page->p_indexBuffer->GetBuffer(), sizeof(uint32_t) * firstIndex, data.indices.data(), sizeof(uint32_t) * indexCount);
+
+    m_meshCount++;
+
+    return range;
+}
+
+void GeometryPool::Free(const MeshRange& range)
+{
+    if (!range.IsValid()) {
+        return;
+    }
+
+    // In-flight frames may still draw from the range, it becomes reusable once they retire.
+    p_device->GetDeletionQueue()->Push([this, range]() { Release(range); });
+}
+
+void GeometryPool::Release(const MeshRange& range)
+{
+    Page* page = m_pages[range.page];
+    page->vertices.Free(static_cast<uint32_t>(range.vertexOffset), range.vertexCount);
+    page->indices.Free(range.firstIndex, range.indexCount);
+
+    m_meshCount--;
+}
+
+void GeometryPool::Bind(VkCommandBuffer commandBuffer, uint32_t page) const
+{
+    VkBuffer buffers[] = { m_pages[page]->p_vertexBuffer->GetBuffer() };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, m_pages[page]->p_indexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+}
+
+GeometryStats GeometryPool::GetStats() const
+{
+    GeometryStats stats {};
+    stats.pageCount = static_cast<uint32_t>(m_pages.size());
+    stats.meshCount = m_meshCount;
+
+    for (const Page* page : m_pages) {
+        stats.usedVertices += page->vertices.GetUsed();
+        stats.vertexCapacity += page->vertices.GetCapacity();
+        stats.usedIndices += page->indices.GetUsed();
+        stats.indexCapacity += page->indices.GetCapacity();
+    }
+
+    return stats;
+}
+
+GeometryPool::Page* GeometryPool::CreatePage(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    VkBufferCreateInfo vertexBufferCreateInfo { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    {
+        vertexBufferCreateInfo.size = sizeof(Vertex) * static_cast<VkDeviceSize>(vertexCapacity);
+        vertexBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        vertexBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    VkBufferCreateInfo indexBufferCreateInfo { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    {
+        indexBufferCreateInfo.size = sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCapacity);
+        indexBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        indexBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    VkMemoryPropertyFlags memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    return new Page {
+        new Buffer { p_device, vertexBufferCreateInfo, memoryPropertyFlags },
+        new Buffer { p_device, indexBufferCreateInfo, memoryPropertyFlags },
+        RangeAllocator { vertexCapacity },
+        RangeAllocator { indexCapacity },
+    };
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "draw_item.h"
+
+class Device;
+class Buffer;
+
+struct GeometryStats {
+    uint32_t pageCount;
+    uint32_t meshCount;
+    uint32_t usedVertices;
+    uint32_t vertexCapacity;
+    uint32_t usedIndices;
+    uint32_t indexCapacity;
+};
+
+/*
+ * First-fit free list over [0, capacity) in elements, adjacent free ranges are merged on release.
+ */
+class RangeAllocator {
+public:
+    RangeAllocator(uint32_t capacity);
+
+public:
+    bool Allocate(uint32_t count, uint32_t* pOffset);
+    void Free(uint32_t offset, uint32_t count);
+
+public: // getter
+    uint32_t GetCapacity() const { return m_capacity; }
+    uint32_t GetUsed() const { return m_used; }
+
+private:
+    uint32_t m_capacity;
+    uint32_t m_used { 0 };
+    std::map<uint32_t, uint32_t> m_freeRanges; // offset -> count
+};
+
+/*
+ * Shared vertex and index buffers that meshes are sub-allocated from.
+ * Growth adds a page instead of reallocating, so ranges handed out never move and no GPU copy is needed.
+ * Draws of the same page share one vertex/index buffer bind.
+ */
+class GeometryPool {
+public:
+    GeometryPool(const Device*);
+    ~GeometryPool();
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool(GeometryPool&&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+    GeometryPool& operator=(GeometryPool&&) = delete;
+
+public:
+    MeshRange Allocate(const MeshData&);
+    void Free(const MeshRange&);
+    void Bind(VkCommandBuffer, uint32_t page) const;
+
+public: // getter
+    uint32_t GetPageCount() const { return static_cast<uint32_t>(m_pages.size()); }
+    GeometryStats GetStats() const;
+
+private:
+    struct Page {
+        Buffer* p_vertexBuffer;
+        Buffer* p_indexBuffer;
+        RangeAllocator vertices;
+        RangeAllocator indices;
+    };
+
+private:
+    Page* CreatePage(uint32_t vertexCapacity, uint32_t indexCapacity);
+    void Release(const MeshRange&);
+
+private:
+    const Device* p_device;
+
+private:
+    enum { PAGE_VERTEX_COUNT = 1 << 20 };
+    enum { PAGE_INDEX_COUNT = 1 << 22 };
+
+    std::vector<Page*> m_pages;
+    uint32_t m_meshCount { 0 };
+};
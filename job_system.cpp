@@ -0,0 +1,303 @@
+// No pch.h, the job system builds without a window or Vulkan (see benchmarks/).
+#include "job_system.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+namespace {
+thread_local uint32_t s_threadIndex = UINT32_MAX;
+}
+
+bool WorkStealingQueue::Push(Job* job)
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_acquire);
+
+    if (bottom - top >= CAPACITY) {
+        return false;
+    }
+
+    m_jobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+    return true;
+}
+
+Job* WorkStealingQueue::Pop()
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = m_jobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+    if (top == bottom) {
+        // Last job left, a thief may be taking it at the same time.
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+Job* WorkStealingQueue::Steal()
+{
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    Job* job = m_jobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    return job;
+}
+
+JobSystem::JobSystem(uint32_t threadCount)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    for (uint32_t i = 0; i < threadCount; i++) {
+        m_queues.push_back(new WorkStealingQueue {});
+    }
+
+    s_threadIndex = 0;
+
+    for (uint32_t i = 1; i < threadCount; i++) {
+        m_workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    m_quit.store(true);
+    {
+        std::lock_guard<std::mutex> lock { m_sleepMutex };
+    }
+    m_wakeCondition.notify_all();
+
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+
+    for (WorkStealingQueue* queue : m_queues) {
+        delete queue;
+    }
+}
+
+void JobSystem::Run(std::function<void()> function, JobCounter* pCounter, JobCounter* pDependency)
+{
+    Job* job = new Job { std::move(function), pCounter };
+
+    if (pCounter != nullptr) {
+        pCounter->value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (pDependency != nullptr) {
+        std::lock_guard<std::mutex> lock { pDependency->mutex };
+
+        // The job that finishes the dependency pushes its continuations, see Execute.
+        if (!pDependency->IsDone()) {
+            pDependency->continuations.push_back(job);
+            return;
+        }
+    }
+
+    Push(job);
+}
+
+void JobSystem::Wait(JobCounter* pCounter)
+{
+    uint32_t threadIndex = GetThreadIndex();
+
+    while (!pCounter->IsDone()) {
+        Job* job = GetJob(threadIndex);
+
+        if (job != nullptr) {
+            Execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    // The counter usually lives on the caller's stack, see Execute.
+    std::lock_guard<std::mutex> lock { pCounter->mutex };
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)>& function)
+{
+    grainSize = std::max(grainSize, 1u);
+
+    JobCounter counter;
+
+    for (uint32_t begin = 0; begin < count; begin += grainSize) {
+        uint32_t end = std::min(begin + grainSize, count);
+        Run([&function, begin, end]() { function(begin, end); }, &counter);
+    }
+
+    Wait(&counter);
+}
+
+JobBenchmark JobSystem::Benchmark(uint32_t jobCount)
+{
+    JobBenchmark benchmark {};
+    benchmark.jobCount = jobCount;
+
+    {
+        JobCounter counter;
+        auto start = std::chrono::steady_clock::now();
+
+        for (uint32_t i = 0; i < jobCount; i++) {
+            Run([]() {}, &counter);
+        }
+        Wait(&counter);
+
+        benchmark.nsPerEmptyJob = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - start).count() / std::max(jobCount, 1u);
+    }
+
+    // A fixed amount of arithmetic per item, the same work runs once serially and once spread over the workers.
+    std::vector<float> results(jobCount);
+    auto work = [&results](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            float value = static_cast<float>(i);
+            for (uint32_t k = 0; k < 4096; k++) {
+                value = value * 0.999f + std::sqrt(value + static_cast<float>(k));
+            }
+            results[i] = value;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    work(0, jobCount);
+    benchmark.serialMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    ParallelFor(jobCount, 16, work);
+    benchmark.parallelMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    benchmark.speedup = benchmark.parallelMs > 0.0f ? benchmark.serialMs / benchmark.parallelMs : 0.0f;
+
+    return benchmark;
+}
+
+JobStats JobSystem::GetStats() const
+{
+    JobStats stats {};
+    stats.threadCount = GetThreadCount();
+    stats.executedCount = m_executedCount.load(std::memory_order_relaxed);
+    stats.stealCount = m_stealCount.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+uint32_t JobSystem::GetThreadIndex()
+{
+    return s_threadIndex;
+}
+
+void JobSystem::WorkerLoop(uint32_t threadIndex)
+{
+    s_threadIndex = threadIndex;
+
+    while (!m_quit.load()) {
+        Job* job = GetJob(threadIndex);
+
+        if (job != nullptr) {
+            Execute(job);
+            continue;
+        }
+
+        // Push checks m_sleepingCount after publishing its job, so either it sees this thread asleep
+        // and notifies under the mutex, or the predicate below already sees the job.
+        std::unique_lock<std::mutex> lock { m_sleepMutex };
+        m_sleepingCount.fetch_add(1);
+        m_wakeCondition.wait(lock, [this]() { return m_quit.load() || m_queuedCount.load() > 0; });
+        m_sleepingCount.fetch_sub(1);
+    }
+}
+
+void JobSystem::Push(Job* job)
+{
+    uint32_t threadIndex = GetThreadIndex();
+    assert(threadIndex < GetThreadCount() && "jobs must be started from a thread of the job system");
+
+    if (!m_queues[threadIndex]->Push(job)) {
+        Execute(job);
+        return;
+    }
+
+    m_queuedCount.fetch_add(1);
+
+    if (m_sleepingCount.load() > 0) {
+        {
+            std::lock_guard<std::mutex> lock { m_sleepMutex };
+        }
+        m_wakeCondition.notify_one();
+    }
+}
+
+Job* JobSystem::GetJob(uint32_t threadIndex)
+{
+    Job* job = m_queues[threadIndex]->Pop();
+
+    for (uint32_t i = 1; job == nullptr && i < GetThreadCount(); i++) {
+        job = m_queues[(threadIndex + i) % GetThreadCount()]->Steal();
+
+        if (job != nullptr) {
+            m_stealCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (job != nullptr) {
+        m_queuedCount.fetch_sub(1);
+    }
+
+    return job;
+}
+
+void JobSystem::Execute(Job* job)
+{
+    job->function();
+
+    JobCounter* pCounter = job->p_counter;
+    delete job;
+
+    m_executedCount.fetch_add(1, std::memory_order_relaxed);
+
+    if (pCounter == nullptr) {
+        return;
+    }
+
+    // The counter drops under its mutex, so a waiter that locks it after seeing zero knows this thread is done with it.
+    std::vector<Job*> continuations;
+    {
+        std::lock_guard<std::mutex> lock { pCounter->mutex };
+
+        if (pCounter->value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            continuations.swap(pCounter->continuations);
+        }
+    }
+
+    for (Job* continuation : continuations) {
+        Push(continuation);
+    }
+}
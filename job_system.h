@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+
+/*
+ * Counts jobs that have not finished yet. Jobs started with a dependency are held back
+ * until the counter they depend on drops to zero.
+ */
+struct JobCounter {
+    std::atomic<uint32_t> value { 0 };
+    std::mutex mutex;
+    std::vector<Job*> continuations;
+
+    bool IsDone() const { return value.load(std::memory_order_acquire) == 0; }
+};
+
+struct Job {
+    std::function<void()> function;
+    JobCounter* p_counter;
+};
+
+struct JobStats {
+    uint32_t threadCount;
+    uint64_t executedCount;
+    uint64_t stealCount;
+};
+
+struct JobBenchmark {
+    uint32_t jobCount;
+    float nsPerEmptyJob; // scheduling overhead of Run + Wait
+    float serialMs;
+    float parallelMs;
+    float speedup;
+};
+
+/*
+ * Chase-Lev deque. Only the owning thread pushes and pops at the bottom, any thread steals from the top.
+ * The capacity is fixed, Push fails when the deque is full and the caller runs the job itself.
+ */
+class WorkStealingQueue {
+public:
+    WorkStealingQueue() = default;
+    ~WorkStealingQueue() = default;
+    WorkStealingQueue(const WorkStealingQueue&) = delete;
+    WorkStealingQueue(WorkStealingQueue&&) = delete;
+    WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+    WorkStealingQueue& operator=(WorkStealingQueue&&) = delete;
+
+public:
+    bool Push(Job*);
+    Job* Pop();
+    Job* Steal();
+
+private:
+    enum { CAPACITY = 4096 };
+
+    std::atomic<int64_t> m_top { 0 };
+    std::atomic<int64_t> m_bottom { 0 };
+    std::atomic<Job*> m_jobs[CAPACITY];
+};
+
+/*
+ * Fixed-size pool of workers with one WorkStealingQueue each. The thread that creates the system is
+ * thread 0 and runs jobs while it waits, so jobs may only be started from threads of the system.
+ * Uses nothing but the standard library, so it runs without a window or a Vulkan device.
+ */
+class JobSystem {
+public:
+    JobSystem(uint32_t threadCount); // 0 picks one thread per hardware thread
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem(JobSystem&&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+    JobSystem& operator=(JobSystem&&) = delete;
+
+public:
+    void Run(std::function<void()>, JobCounter* pCounter = nullptr, JobCounter* pDependency = nullptr);
+    void Wait(JobCounter*); // executes other jobs until the counter reaches zero
+    void ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)>&);
+    JobBenchmark Benchmark(uint32_t jobCount);
+
+public: // getter
+    uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_queues.size()); }
+    JobStats GetStats() const;
+    static uint32_t GetThreadIndex();
+
+private:
+    void WorkerLoop(uint32_t threadIndex);
+    void Push(Job*);
+    Job* GetJob(uint32_t threadIndex);
+    void Execute(Job*);
+
+private:
+    std::vector<WorkStealingQueue*> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<uint32_t> m_queuedCount { 0 };
+    std::atomic<uint32_t> m_sleepingCount { 0 };
+    std::atomic<uint64_t> m_executedCount { 0 };
+    std::atomic<uint64_t> m_stealCount { 0 };
+    std::atomic<bool> m_quit { false };
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeCondition;
+};
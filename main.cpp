@@ -1,11 +1,29 @@
 #include "pch.h"
 #include "app.h"
+#include <cstring>
 
-int main()
+int main(int argc, char** argv)
 {
-    App* app = new App {};
-    app->Run();
+    // --profile-variants renders with a hidden window, prints the GPU time of every fragment variant and exits.
+    // --profile-vertex does the same for the two matrix paths of simple.vert on the high-poly sphere.
+    // --profile-draws does the same for instanced and push constant draws, with the CPU record time.
+    bool profileVariants = argc > 1 && strcmp(argv[1], "--profile-variants") == 0;
+    bool profileVertex = argc > 1 && strcmp(argv[1], "--profile-vertex") == 0;
+    bool profileDraws = argc > 1 && strcmp(argv[1], "--profile-draws") == 0;
+
+    App* app = new App { !profileVariants && !profileVertex && !profileDraws };
+    int exitCode = 0;
+
+    if (profileVariants) {
+        exitCode = app->RunVariantProfile();
+    } else if (profileVertex) {
+        exitCode = app->RunVertexProfile();
+    } else if (profileDraws) {
+        exitCode = app->RunDrawProfile();
+    } else {
+        app->Run();
+    }
     delete app;
 
-    return 0;
+    return exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,33 @@
+#include "pch.h"
+#include "mesh.h"
+
+Mesh::Mesh(GeometryPool* pGeometryPool, const MeshData& data)
+    : p_geometryPool { pGeometryPool }
+{
+    m_range = p_geometryPool->Allocate(data);
+
+    // Sphere around the center of the vertex box, loose but cheap and enough for culling.
+    Vec3 minPos { std::numeric_limits<float>::max() };
+    Vec3 maxPos { std::numeric_limits<float>::lowest() };
+    for (const Vertex& vertex : data.vertices) {
+        minPos = glm::min(minPos, vertex.pos);
+        maxPos = glm::max(maxPos, vertex.pos);
+    }
+
+    if (data.vertices.empty()) {
+        minPos = maxPos = Vec3 { 0.0f };
+    }
+    m_localAabb = Aabb { minPos, maxPos };
+
+    Vec3 center = (minPos + maxPos) * 0.5f;
+    float radius = 0.0f;
+    for (const Vertex& vertex : data.vertices) {
+        radius = std::max(radius, glm::length(vertex.pos - center));
+    }
+    m_localBounds = Vec4 { center, radius };
+}
+
+Mesh::~Mesh()
+{
+    p_geometryPool->Free(m_range);
+}
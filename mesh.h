@@ -0,0 +1,32 @@
+#pragma once
+
+#include "geometry_pool.h"
+#include "culling.h"
+
+/*
+ * Geometry shared by every model drawn with it. Models that point at the same Mesh are
+ * grouped into one instanced draw by the renderer.
+ */
+class Mesh {
+public:
+    Mesh(GeometryPool*, const MeshData&);
+    ~Mesh();
+    Mesh(const Mesh&) = delete;
+    Mesh(Mesh&&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh& operator=(Mesh&&) = delete;
+
+public: // getter
+    const MeshRange& GetRange() const { return m_range; }
+    uint32_t GetIndexCount() const { return m_range.indexCount; }
+    const Vec4& GetLocalBounds() const { return m_localBounds; }
+    const Aabb& GetLocalAabb() const { return m_localAabb; }
+
+private:
+    GeometryPool* p_geometryPool;
+
+private:
+    MeshRange m_range;
+    Vec4 m_localBounds; // bounding sphere in model space, xyz center and w radius
+    Aabb m_localAabb; // vertex box in model space
+};
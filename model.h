@@ -1,48 +1,52 @@
 #pragma once
 
 #include "transform.h"
-class Device;
-class Buffer;
+#include "mesh.h"
 
 class Model {
 public:
-    Model(const Device*, const MeshData&);
-    ~Model();
+    Model(const Mesh*, TransformArray*);
+    ~Model() = default;
     Model(const Model&) = delete;
     Model(Model&&) = delete;
     Model& operator=(const Model&) = delete;
     Model& operator=(Model&&) = delete;
 
 public: // getter
-    uint32_t GetIndexCount() const { return m_indexCount; }
+    const Mesh* GetMesh() const { return p_mesh; }
+    const Vec4& GetLocalBounds() const { return p_mesh->GetLocalBounds(); }
+    const Aabb& GetLocalAabb() const { return p_mesh->GetLocalAabb(); }
 
 public:
     void Update(float dt);
-    void Bind(VkCommandBuffer) const;
-    void Draw(VkCommandBuffer) const;
+    void WriteMaterial(PhongModel*) const; // world and normal matrix are written by TransformArray::ComputeWorldMatrices
     Mat4 GetWorldMatrix() const;
-    void SetDescriptorSet(VkDescriptorSet, VkImageView, VkSampler);
 
-private:
-    void CreateVertexBuffer(const std::vector<Vertex>&);
-    void CreateIndexBuffer(const std::vector<uint32_t>&);
-    void CreateUniformbuffer();
-    void UpdateUniformBuffer();
+public: // material, setters mark the uniform slot dirty
+    const Vec3& GetAmbient() const { return ambient; }
+    const Vec3& GetDiffuse() const { return diffuse; }
+    const Vec3& GetSpecular() const { return specular; }
+    float GetShininess() const { return shininess; }
+    void SetAmbient(const Vec3&);
+    void SetDiffuse(const Vec3&);
+    void SetSpecular(const Vec3&);
+    void SetShininess(float);
+    uint32_t GetTextureIndex() const { return textureIndex; }
+    uint32_t GetSamplerIndex() const { return samplerIndex; }
+    void SetTexture(uint32_t texture, uint32_t sampler); // indices into the device's BindlessTable
 
 private:
-    const Device* p_device;
+    const Mesh* p_mesh; // owned by the scene, shared with every other instance
 
 public:
     Transform m_transform;
-    uint32_t m_indexCount;
-    Buffer* m_vertexBuffer;
-    Buffer* m_index;
-    Buffer* m_uniform;
-    VkDescriptorSet m_descriptorSet;
+    bool m_animated { false }; // spun by Update every frame, must be set before Scene::AddModel
 
-public: // material
+private: // material
     Vec3 ambient { Vec3 { 0.3f } };
     Vec3 diffuse { Vec3 { 0.7f } };
     Vec3 specular { Vec3 { 1.0f } };
     float shininess { 256.0f };
+    uint32_t textureIndex { 0 }; // 0 is the renderer's default texture and sampler
+    uint32_t samplerIndex { 0 };
 };
@@ -8,25 +8,28 @@
 #include <iostream>
 #include <array>
 #include <set>
+#include <map>
+#include <unordered_map>
+#include <deque>
+#include <functional>
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 
 #define VK_USE_PLATFORM_WIN32_KHR
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
-#define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
+#include "math_types.h"
 
 #define CHECK_VK(RESULT) assert(RESULT == VK_SUCCESS)
 
-using Vec2 = glm::vec2;
-using Vec3 = glm::vec3;
-using Vec4 = glm::vec4;
-using Mat4 = glm::mat4;
-
 struct Vertex {
     Vec3 pos;
     Vec3 normal;
@@ -70,17 +73,22 @@ struct MeshData {
     std::vector<uint32_t> indices;
 };
 
-struct ModelUniform {
-    Mat4 world;
+#include "transform_array.h" // ModelUniform
+
+enum { MAX_LIGHTS = 4 }; // simple.frag reads the first LIGHT_COUNT of them
+
+struct LightData {
+    alignas(16) Vec3 position;
+    alignas(16) Vec3 color;
 };
 
 struct CommonUniform {
     Mat4 view;
     Mat4 proj;
+    Mat4 viewProj; // proj * view, once per frame instead of per vertex
     alignas(16) Vec3 eyePos;
-    alignas(16) Vec3 lightPos;
     alignas(16) Vec3 lightDir;
-    alignas(16) Vec3 lightColor;
+    LightData lights[MAX_LIGHTS];
 };
 
 struct PhongModel : ModelUniform {
@@ -88,4 +96,11 @@ struct PhongModel : ModelUniform {
     alignas(16) Vec3 diffuse;
     alignas(16) Vec3 specular;
     float shininess;
+    uint32_t textureIndex; // into the bindless texture table
+    uint32_t samplerIndex;
+};
+
+// Push constants of simple.vert.
+struct DrawConstants {
+    uint32_t objectSlot; // UINT32_MAX for instanced draws, they read their slot from the instance buffer
 };
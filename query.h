@@ -53,4 +53,16 @@ public:
 
         return presentModes;
     }
+
+    static std::vector<VkExtensionProperties> GetDeviceExtensions(VkPhysicalDevice physicalDevice)
+    {
+        uint32_t count = 0;
+
+        CHECK_VK(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, nullptr));
+
+        std::vector<VkExtensionProperties> extensions { count };
+        CHECK_VK(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, extensions.data()));
+
+        return extensions;
+    }
 };
\ No newline at end of file
@@ -3,8 +3,12 @@
 #include "vk_device.h"
 #include "vk_swap_chain.h"
 #include "vk_pipeline.h"
+#include "vk_compute_pipeline.h"
+#include "vk_bindless_table.h"
 #include "scene.h"
 #include "model.h"
+#include "mesh.h"
+#include "geometry_helper.h"
 #include "camera.h"
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
@@ -12,107 +16,197 @@
 #include "vk_command_pool.h"
 #include "vk_command_buffer.h"
 #include "vk_buffer.h"
-#include "vk_descriptor_pool.h"
+#include "vk_descriptor_allocator.h"
+#include "vk_descriptor_update_template.h"
+#include "vk_pipeline_cache.h"
+#include "vk_pipeline_variant_cache.h"
+#include "vk_gpu_timer.h"
 #include "vk_image.h"
-
-Renderer::Renderer(Device* pDevice, SwapChain* pSwapChain, const Pipeline* pPipeline)
+#include "vk_memory_allocator.h"
+#include "vk_ring_buffer.h"
+#include "vk_upload_context.h"
+#include "geometry_pool.h"
+#include "vk_deletion_queue.h"
+#include "job_system.h"
+#include "transform_array.h"
+
+Renderer::Renderer(Device* pDevice, SwapChain* pSwapChain, const Pipeline* pPipeline, JobSystem* pJobSystem)
     : p_device { pDevice }
     , p_swapChain { pSwapChain }
     , p_pipeline { pPipeline }
+    , p_jobSystem { pJobSystem }
 {
     p_swapChain->CreateFrameBuffer(p_pipeline->GetRenderPass());
+    m_recordTimes.resize(p_jobSystem->GetThreadCount(), 0.0f);
+    m_recordDrawCounts.resize(p_jobSystem->GetThreadCount(), 0);
+
     InitPerFrame();
+    p_gpuTimer = new GpuTimer { p_device, MAX_FRAMES_IN_FLIGHT };
+    p_device->GetDeletionQueue()->SetFrame(m_frameNumber);
     CreateTextureImage();
     CreateSampler();
-    CreateCommonUniform();
+
+    // First entries of the table, index 0 is what Model defaults to.
+    p_device->GetBindlessTable()->AddTexture(imageView);
+    p_device->GetBindlessTable()->AddSampler(textureSampler);
+    CreateUniformRing();
+    CreateCullPipeline();
+    CreateDescriptorSets();
+    p_geometryPool = new GeometryPool { p_device };
 }
 
 Renderer::~Renderer()
 {
+    // App::Run leaves the device idle, release deferred objects while the geometry pool still exists.
+    p_device->GetDeletionQueue()->Flush();
+
     vkDestroySampler(p_device->GetDevice(), textureSampler, nullptr);
     vkDestroyImageView(p_device->GetDevice(), imageView, nullptr);
 
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         delete m_frames[i].p_commandPool;
+        delete m_frames[i].p_transientDescriptors;
+        for (ThreadCommands& threadCommands : m_frames[i].threadCommands) {
+            delete threadCommands.p_commandPool;
+        }
         vkDestroySemaphore(p_device->GetDevice(), m_frames[i].imageAvailableSemaphore, nullptr);
         vkDestroySemaphore(p_device->GetDevice(), m_frames[i].renderFinishedSemaphore, nullptr);
         vkDestroyFence(p_device->GetDevice(), m_frames[i].inFlightFence, nullptr);
     }
 
-    m_uniform->UnmapMemory();
-    delete m_uniform;
+    delete p_uniformRing;
+    delete p_objectBuffer;
+    delete p_instanceBuffer;
+    delete p_cullDrawBuffer;
+    delete p_indirectBuffer;
+    delete p_cullPipeline;
+    delete p_geometryPool;
     delete p_image;
-    delete p_descriptorPool;
+    delete p_descriptorAllocator;
+    delete p_gpuTimer;
 }
 
 void Renderer::SetScene(Scene* pScene)
 {
+    // The descriptor sets only reference renderer buffers, a new scene needs none of them rebuilt.
     p_scene = pScene;
+}
 
-    if (p_descriptorPool != nullptr) {
-        delete p_descriptorPool;
-    }
+void Renderer::CreateDescriptorSets()
+{
+    // Shaders find their object through the instance buffer and its texture through the bindless table,
+    // so one model set with per-frame dynamic offsets covers every draw. The cull set has four more storage buffers.
+    std::vector<PoolSizeRatio> ratios {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2.0f },
+    };
 
-    uint32_t numModels = static_cast<uint32_t>(p_scene->GetModels().size());
+    p_descriptorAllocator = new DescriptorAllocator { p_device, ratios, 4 };
 
-    std::vector<VkDescriptorPoolSize> poolSizes {
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, numModels + 1 },
-        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, numModels },
-    };
+    m_modelDescriptorSet = p_descriptorAllocator->Allocate(p_pipeline->GetModelDescriptorSetLayouts());
+    m_commonDescriptorSet = p_descriptorAllocator->Allocate(p_pipeline->GetCommonDescriptorSetLayouts());
+    m_cullDescriptorSet = p_descriptorAllocator->Allocate(p_cullPipeline->GetDescriptorSetLayout());
 
-    p_descriptorPool = new DescriptorPool { p_device, poolSizes, numModels + 1 };
+    VkDescriptorBufferInfo modelBufferInfo { p_objectBuffer->GetBuffer(), 0, p_objectBuffer->GetFrameSize() };
+    VkDescriptorBufferInfo instanceBufferInfo { p_instanceBuffer->GetBuffer(), 0, p_instanceBuffer->GetFrameSize() };
+    VkDescriptorBufferInfo commonBufferInfo { p_uniformRing->GetBuffer(), 0, sizeof(CommonUniform) };
 
-    for (auto& model : p_scene->GetModels()) {
-        VkDescriptorSet dstSet = p_descriptorPool->AllocateDescriptorSet(p_pipeline->GetModelDescriptorSetLayouts());
-        model->SetDescriptorSet(dstSet, imageView, textureSampler);
+    // Each layout comes with an update template, a set is written from its descriptors in binding order.
+    // Every range is a whole frame segment, the dynamic offsets pick the frame.
+    // The layouts come from shader reflection, a shader that declares more than this would read garbage.
+    if (p_pipeline->GetModelUpdateTemplate()->GetDescriptorCount() != 2 || p_pipeline->GetCommonUpdateTemplate()->GetDescriptorCount() != 1) {
+        throw std::runtime_error("shader descriptor sets do not match what the renderer writes!");
     }
 
-    m_commonDescriptorSet = p_descriptorPool->AllocateDescriptorSet(p_pipeline->GetCommonDescriptorSetLayouts());
-
-    VkDescriptorBufferInfo bufferInfo {};
+    std::array<DescriptorInfo, 2> modelInfos {};
     {
-        bufferInfo.buffer = m_uniform->GetBuffer();
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(CommonUniform);
+        modelInfos[0].buffer = modelBufferInfo;
+        modelInfos[1].buffer = instanceBufferInfo;
     }
+    p_pipeline->GetModelUpdateTemplate()->Update(m_modelDescriptorSet, modelInfos.data());
 
-    VkWriteDescriptorSet uniformDS {};
+    std::array<DescriptorInfo, 1> commonInfos {};
     {
-        uniformDS.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        uniformDS.dstSet = m_commonDescriptorSet;
-        uniformDS.dstBinding = 0;
-        uniformDS.dstArrayElement = 0;
-        uniformDS.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uniformDS.descriptorCount = 1;
-        uniformDS.pBufferInfo = &bufferInfo;
+        commonInfos[0].buffer = commonBufferInfo;
     }
+    p_pipeline->GetCommonUpdateTemplate()->Update(m_commonDescriptorSet, commonInfos.data());
 
-    vkUpdateDescriptorSets(p_device->GetDevice(), 1, &uniformDS, 0, nullptr);
+    // Binding order of cull.comp : objects, draws, counts and commands, instances.
+    std::array<DescriptorInfo, 4> cullInfos {};
+    {
+        cullInfos[0].buffer = modelBufferInfo;
+        cullInfos[1].buffer = VkDescriptorBufferInfo { p_cullDrawBuffer->GetBuffer(), 0, p_cullDrawBuffer->GetFrameSize() };
+        cullInfos[2].buffer = VkDescriptorBufferInfo { p_indirectBuffer->GetBuffer(), 0, p_indirectBuffer->GetFrameSize() };
+        cullInfos[3].buffer = instanceBufferInfo;
+    }
+    p_cullPipeline->GetUpdateTemplate()->Update(m_cullDescriptorSet, cullInfos.data());
 }
 
 void Renderer::Update(float dt)
 {
+    // Before anything reads the scene this frame, never while the GUI records.
+    ApplySceneRequests();
+
+    // Requested from the GUI, run here so its descriptor writes stay out of command recording.
+    if (m_descriptorBenchmarkRequested) {
+        m_descriptorBenchmark = DescriptorUpdateTemplate::Benchmark(p_device, p_objectBuffer->GetBuffer(), 10000);
+        m_descriptorBenchmarkRequested = false;
+    }
+
+    // Wait before writing uniforms, the GPU may still be reading this frame's ring segment.
+    vkWaitForFences(p_device->GetDevice(), 1, &m_frames[currentFrame].inFlightFence, VK_TRUE, UINT64_MAX);
+
+    float gpuMs = 0.0f;
+    if (p_gpuTimer->Read(currentFrame, &gpuMs)) {
+        m_gpuFrameMs = gpuMs;
+        RecordVariantProfile(m_frames[currentFrame].profileIndex, gpuMs, m_frames[currentFrame].recordMs);
+    }
+
+    // Frames retire in submission order, so everything up to this frame's last submit is idle.
+    p_device->GetDeletionQueue()->Collect(m_frames[currentFrame].frameNumber);
+
+    // Shader edits reach the variants without a restart, a replaced pipeline goes through the deletion queue.
+    p_pipeline->GetVariants()->PollShaderChanges();
+
+    // Transient sets of this frame are no longer referenced, every pool goes back in one call.
+    m_frames[currentFrame].p_transientDescriptors->Reset();
+
+    // Textures added since the last frame reach the table in one update.
+    p_device->GetBindlessTable()->Flush();
+
+    p_uniformRing->BeginFrame(currentFrame);
+
     CommonUniform uniformData {};
     uniformData.view = p_scene->p_camera->GetViewMatrix();
     uniformData.proj = p_scene->p_camera->GetProjectionMatrix();
+    uniformData.viewProj = uniformData.proj * uniformData.view;
     uniformData.eyePos = p_scene->p_camera->m_position;
-    uniformData.lightPos = p_scene->lightPos;
     uniformData.lightDir = p_scene->lightDir;
-    uniformData.lightColor = p_scene->lightColor;
+    std::copy(p_scene->lights.begin(), p_scene->lights.end(), uniformData.lights);
 
-    m_uniform->InvalidateMappedMemory();
-    memcpy(m_uniform->GetMappedPtr(), &uniformData, sizeof(CommonUniform));
-    m_uniform->FlushMappedMemory();
+    m_commonUniformOffset = p_uniformRing->Push(uniformData);
 
-    for (auto& model : p_scene->GetModels()) {
+    for (Model* model : p_scene->GetAnimatedModels()) {
         model->Update(dt);
     }
+
+    UpdateObjectUniforms();
+    p_scene->UpdateWorldBounds(m_dirtyObjects);
+    p_scene->UpdateSpatialIndex(p_jobSystem);
+    m_frustum = Culling::ExtractFrustum(uniformData.viewProj);
+
+    // The GPU path tests every draw in cull.comp, the CPU cull and batching are skipped.
+    if (m_gpuCulling) {
+        PrepareGpuCulling();
+    } else {
+        CullScene();
+    }
+
+    FlushFrameMemory();
 }
 
 void Renderer::Render()
 {
-    vkWaitForFences(p_device->GetDevice(), 1, &m_frames[currentFrame].inFlightFence, VK_TRUE, UINT64_MAX);
-
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(p_device->GetDevice(), p_swapChain->GetSwapChain(), UINT64_MAX, m_frames[currentFrame].imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
 
@@ -126,25 +220,39 @@ void Renderer::Render()
 
     vkResetFences(p_device->GetDevice(), 1, &m_frames[currentFrame].inFlightFence);
 
+    // Uploads recorded since the last frame are submitted first, so this frame can acquire them.
+    p_device->GetUploadContext()->Submit();
+
     VkCommandBuffer commandBuffer = m_frames[currentFrame].commandBuffer;
 
+    m_uploadSemaphores.clear();
     RecordCommandBuffer(commandBuffer, imageIndex);
 
-    VkSemaphore waitSemaphores[] = { m_frames[currentFrame].imageAvailableSemaphore };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    // Uploads only hold back the stages that read them, not the whole frame.
+    std::vector<VkSemaphore> waitSemaphores { m_frames[currentFrame].imageAvailableSemaphore };
+    std::vector<VkPipelineStageFlags> waitStages { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+
+    for (VkSemaphore semaphore : m_uploadSemaphores) {
+        waitSemaphores.push_back(semaphore);
+        waitStages.push_back(UploadContext::CONSUMER_STAGES);
+    }
 
     VkSubmitInfo submitInfo { VK_STRUCTURE_TYPE_SUBMIT_INFO };
     {
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
+        submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+        submitInfo.pWaitSemaphores = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffer;
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = &m_frames[currentFrame].renderFinishedSemaphore;
     }
 
-    CHECK_VK(vkQueueSubmit(p_device->GetQueue(), 1, &submitInfo, m_frames[currentFrame].inFlightFence));
+    result = vkQueueSubmit(p_device->GetQueue(), 1, &submitInfo, m_frames[currentFrame].inFlightFence);
+    CHECK_VK(result);
+
+    m_frames[currentFrame].frameNumber = m_frameNumber++;
+    p_device->GetDeletionQueue()->SetFrame(m_frameNumber);
 
     VkSwapchainKHR swapChains[] = { p_swapChain->GetSwapChain() };
     VkPresentInfoKHR presentInfo { VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
@@ -172,18 +280,262 @@ void Renderer::UpdateSwapChain(SwapChain* pSwapChain)
     p_swapChain->CreateFrameBuffer(p_pipeline->GetRenderPass());
 }
 
-void Renderer::CreateCommonUniform()
+void Renderer::CreateUniformRing()
 {
-    VkBufferCreateInfo createInfo { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-    {
-        createInfo.size = sizeof(CommonUniform);
-        createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    p_uniformRing = new RingBuffer { p_device, UNIFORM_RING_FRAME_SIZE, MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT };
+
+    // Objects are indexed in the shader rather than bound one by one, so they are packed at the std430 array stride.
+    m_objectStride = sizeof(PhongModel);
+    p_objectBuffer = new RingBuffer { p_device, static_cast<VkDeviceSize>(m_objectStride) * MAX_OBJECTS, MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+    p_instanceBuffer = new RingBuffer { p_device, sizeof(uint32_t) * MAX_OBJECTS, MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+    p_cullDrawBuffer = new RingBuffer { p_device, sizeof(uint32_t) * 2 * MAX_OBJECTS, MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+
+    // Draw counts first, the commands follow at COMMAND_OFFSET, both are read by the indirect draws.
+    p_indirectBuffer = new RingBuffer { p_device, COMMAND_OFFSET + sizeof(GpuDrawCommand) * MAX_MESHES, MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT };
+}
+
+void Renderer::CreateCullPipeline()
+{
+    // objects, draws, counts and commands, instances. Four is the smallest maxDescriptorSetStorageBuffersDynamic allowed.
+    std::vector<VkDescriptorSetLayoutBinding> bindings(4);
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    p_cullPipeline = new ComputePipeline { p_device, "shaders/cull.comp.spv", bindings, sizeof(CullConstants) };
+}
+
+void Renderer::UpdateObjectUniforms()
+{
+    TransformArray* transforms = p_scene->GetTransforms();
+
+    if (transforms->GetCount() > MAX_OBJECTS) {
+        throw std::runtime_error("too many objects for the object buffer!");
+    }
+
+    p_objectBuffer->BeginFrame(currentFrame);
+    m_objectFrameOffset = static_cast<uint32_t>(p_objectBuffer->GetFrameOffset());
+    uint8_t* pObjects = p_objectBuffer->GetFrameData();
+
+    // Each frame in flight keeps its own copy of the slots, a change stays pending until every copy has it.
+    // A bit per copy rather than a countdown: Render can return before advancing currentFrame, and the
+    // next Update then writes the same copy again.
+    m_dirtyObjects.clear();
+    transforms->ConsumeDirty(m_dirtyObjects);
+    m_objectPendingCopies.resize(transforms->GetCount(), 0);
+
+    for (uint32_t index : m_dirtyObjects) {
+        if (m_objectPendingCopies[index] == 0) {
+            m_pendingObjects.push_back(index);
+        }
+        m_objectPendingCopies[index] = ALL_FRAME_COPIES;
+    }
+
+    // Sorted slots let neighbouring writes merge into one flush range.
+    std::sort(m_pendingObjects.begin(), m_pendingObjects.end());
+
+    auto start = std::chrono::steady_clock::now();
+    // The ModelUniform part comes first in PhongModel, so a slot's address is also where its matrices go.
+    p_jobSystem->ParallelFor(static_cast<uint32_t>(m_pendingObjects.size()), TRANSFORM_BATCH_SIZE, [&](uint32_t begin, uint32_t end) { transforms->ComputeWorldMatricesAt(&m_pendingObjects[begin], end - begin, pObjects, m_objectStride); });
+
+    for (uint32_t index : m_pendingObjects) {
+        Model* model = p_scene->GetModelBySlot(index);
+
+        if (model != nullptr) {
+            model->WriteMaterial(reinterpret_cast<PhongModel*>(pObjects + index * m_objectStride));
+        }
+        p_objectBuffer->MarkDirty(m_objectFrameOffset + index * m_objectStride, sizeof(PhongModel));
+    }
+    m_transformMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_uploadedObjectCount = static_cast<uint32_t>(m_pendingObjects.size());
+
+    uint8_t writtenCopy = static_cast<uint8_t>(1u << currentFrame);
+    auto retired = std::remove_if(m_pendingObjects.begin(), m_pendingObjects.end(), [this, writtenCopy](uint32_t index) { return (m_objectPendingCopies[index] &= ~writtenCopy) == 0; });
+    m_pendingObjects.erase(retired, m_pendingObjects.end());
+}
+
+void Renderer::CullScene()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t drawCount = static_cast<uint32_t>(p_scene->GetDrawItems().size());
+    m_visibleDraws.clear();
+
+    if (m_frustumCulling && m_hierarchyCulling) {
+        p_scene->CullHierarchy(m_frustum, m_visibleDraws);
+    } else if (m_frustumCulling) {
+        p_scene->Cull(m_frustum, m_visibleDraws);
+    } else {
+        for (uint32_t i = 0; i < drawCount; i++) {
+            m_visibleDraws.push_back(i);
+        }
+    }
+
+    m_cullStats.visibleCount = static_cast<uint32_t>(m_visibleDraws.size());
+    m_cullStats.culledCount = drawCount - m_cullStats.visibleCount;
+    m_cullStats.cullMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    BuildBatches();
+}
+
+void Renderer::BuildBatches()
+{
+    const std::vector<DrawItem>& drawItems = p_scene->GetDrawItems();
+    const std::vector<Mesh*>& meshes = p_scene->GetMeshes();
+
+    // Counting sort of the visible draws by mesh, every mesh with a visible instance becomes one draw.
+    m_meshInstanceCounts.assign(meshes.size(), 0);
+    for (uint32_t drawIndex : m_visibleDraws) {
+        m_meshInstanceCounts[drawItems[drawIndex].meshId]++;
+    }
+
+    m_drawBatches.clear();
+    uint32_t firstInstance = 0;
+
+    for (uint32_t meshId = 0; meshId < meshes.size(); meshId++) {
+        uint32_t instanceCount = m_meshInstanceCounts[meshId];
+
+        if (instanceCount == 0) {
+            continue;
+        }
+
+        m_drawBatches.push_back(DrawBatch { meshes[meshId]->GetRange(), firstInstance, instanceCount });
+        m_meshInstanceCounts[meshId] = firstInstance; // from here on the next free instance of the mesh
+        firstInstance += instanceCount;
     }
-    VkMemoryPropertyFlags memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
 
-    m_uniform = new Buffer { p_device, createInfo, memoryPropertyFlags };
-    m_uniform->MapMemory();
+    // The slots are scattered into a host copy, which push constant draws read back,
+    // then go to mapped memory in one sequential copy.
+    m_instanceSlots.resize(firstInstance);
+    for (uint32_t drawIndex : m_visibleDraws) {
+        const DrawItem& item = drawItems[drawIndex];
+        m_instanceSlots[m_meshInstanceCounts[item.meshId]++] = item.objectSlot;
+    }
+
+    // gl_InstanceIndex starts at firstInstance, so the slots of a batch are found relative to the bound offset.
+    p_instanceBuffer->BeginFrame(currentFrame);
+    uint32_t* pSlots = nullptr;
+    m_instanceOffset = p_instanceBuffer->Allocate(sizeof(uint32_t) * std::max(firstInstance, 1u), reinterpret_cast<void**>(&pSlots));
+    memcpy(pSlots, m_instanceSlots.data(), sizeof(uint32_t) * firstInstance);
+}
+
+void Renderer::PrepareGpuCulling()
+{
+    if (p_scene->GetStructureVersion() != m_indirectVersion) {
+        m_indirectVersion = p_scene->GetStructureVersion();
+        RebuildIndirectCommands();
+    }
+
+    const std::vector<DrawItem>& drawItems = p_scene->GetDrawItems();
+
+    // The draw list only changes when models are added or removed. Each frame copy remembers the structure
+    // version it was written for, cull.comp reads drawItems.size() entries and must never see an old list.
+    p_cullDrawBuffer->BeginFrame(currentFrame);
+    m_cullDrawOffset = static_cast<uint32_t>(p_cullDrawBuffer->GetFrameOffset());
+
+    if (m_frames[currentFrame].cullDrawVersion != m_indirectVersion) {
+        uint32_t* pDraws = reinterpret_cast<uint32_t*>(p_cullDrawBuffer->GetFrameData());
+
+        for (size_t i = 0; i < drawItems.size(); i++) {
+            pDraws[i * 2] = drawItems[i].objectSlot;
+            pDraws[i * 2 + 1] = m_meshCommands[drawItems[i].meshId];
+        }
+        p_cullDrawBuffer->MarkDirty(m_cullDrawOffset, sizeof(uint32_t) * 2 * drawItems.size());
+        m_frames[currentFrame].cullDrawVersion = m_indirectVersion;
+    }
+
+    // Instance and draw counts start at zero every frame, cull.comp counts them up.
+    p_indirectBuffer->BeginFrame(currentFrame);
+    m_countOffset = static_cast<uint32_t>(p_indirectBuffer->GetFrameOffset());
+    m_commandOffset = m_countOffset + COMMAND_OFFSET;
+
+    uint8_t* pFrame = p_indirectBuffer->GetFrameData();
+    memset(pFrame, 0, sizeof(uint32_t) * m_indirectRuns.size());
+    memcpy(pFrame + COMMAND_OFFSET, m_commandTemplate.data(), sizeof(GpuDrawCommand) * m_commandTemplate.size());
+    p_indirectBuffer->MarkDirty(m_countOffset, sizeof(uint32_t) * m_indirectRuns.size());
+    p_indirectBuffer->MarkDirty(m_commandOffset, sizeof(GpuDrawCommand) * m_commandTemplate.size());
+
+    // Only the shader writes instance slots, nothing is allocated so nothing gets flushed.
+    p_instanceBuffer->BeginFrame(currentFrame);
+    m_instanceOffset = static_cast<uint32_t>(p_instanceBuffer->GetFrameOffset());
+}
+
+void Renderer::RebuildIndirectCommands()
+{
+    const std::vector<DrawItem>& drawItems = p_scene->GetDrawItems();
+    const std::vector<Mesh*>& meshes = p_scene->GetMeshes();
+
+    if (meshes.size() > MAX_MESHES) {
+        throw std::runtime_error("too many meshes for the indirect buffer!");
+    }
+
+    m_meshInstanceCounts.assign(meshes.size(), 0);
+    for (const DrawItem& item : drawItems) {
+        m_meshInstanceCounts[item.meshId]++;
+    }
+
+    // Commands of a page sit next to each other, so every page is one bind and one indirect call.
+    std::vector<uint32_t> meshOrder(meshes.size());
+    for (uint32_t meshId = 0; meshId < meshes.size(); meshId++) {
+        meshOrder[meshId] = meshId;
+    }
+    std::stable_sort(meshOrder.begin(), meshOrder.end(), [&](uint32_t a, uint32_t b) { return meshes[a]->GetRange().page < meshes[b]->GetRange().page; });
+
+    m_commandTemplate.clear();
+    m_indirectRuns.clear();
+    m_meshCommands.assign(meshes.size(), 0);
+    uint32_t firstInstance = 0;
+
+    for (uint32_t meshId : meshOrder) {
+        const MeshRange& range = meshes[meshId]->GetRange();
+
+        if (m_indirectRuns.empty() || m_indirectRuns.back().page != range.page) {
+            m_indirectRuns.push_back(IndirectRun { range.page, static_cast<uint32_t>(m_commandTemplate.size()), 0 });
+        }
+        IndirectRun& run = m_indirectRuns.back();
+
+        // Any instance may survive, so the mesh reserves an instance range for all of its draws.
+        GpuDrawCommand command {};
+        command.command.indexCount = range.indexCount;
+        command.command.instanceCount = 0;
+        command.command.firstIndex = range.firstIndex;
+        command.command.vertexOffset = range.vertexOffset;
+        command.command.firstInstance = firstInstance;
+        command.countSlot = static_cast<uint32_t>(m_indirectRuns.size()) - 1;
+        command.drawInSlot = run.commandCount++;
+        command.localBounds = meshes[meshId]->GetLocalBounds();
+
+        m_meshCommands[meshId] = static_cast<uint32_t>(m_commandTemplate.size());
+        m_commandTemplate.push_back(command);
+        firstInstance += m_meshInstanceCounts[meshId];
+    }
+}
+
+void Renderer::FlushFrameMemory()
+{
+    // Every host write of the frame goes out in one call, coherent buffers contribute no ranges.
+    m_flushRanges.clear();
+    p_uniformRing->CollectDirtyRanges(m_flushRanges);
+    p_objectBuffer->CollectDirtyRanges(m_flushRanges);
+    p_instanceBuffer->CollectDirtyRanges(m_flushRanges);
+    p_cullDrawBuffer->CollectDirtyRanges(m_flushRanges);
+    p_indirectBuffer->CollectDirtyRanges(m_flushRanges);
+
+    m_flushedBytes = 0;
+    for (const VkMappedMemoryRange& range : m_flushRanges) {
+        m_flushedBytes += range.size;
+    }
+
+    if (m_flushRanges.empty()) {
+        return;
+    }
+
+    VkResult result = vkFlushMappedMemoryRanges(p_device->GetDevice(), static_cast<uint32_t>(m_flushRanges.size()), m_flushRanges.data());
+    CHECK_VK(result);
 }
 
 void Renderer::InitPerFrame()
@@ -192,8 +544,27 @@ void Renderer::InitPerFrame()
         CommandPool* cmdPool = new CommandPool { p_device };
         CommandBuffer cmdBuffer = cmdPool->AllocateCommandBuffer();
 
+        m_frames[i].frameNumber = 0;
+        m_frames[i].profileIndex = UINT32_MAX;
+        m_frames[i].recordMs = 0.0f;
+        m_frames[i].cullDrawVersion = UINT64_MAX;
         m_frames[i].p_commandPool = cmdPool;
         m_frames[i].commandBuffer = cmdBuffer.GetHandle();
+        m_frames[i].guiCommandBuffer = cmdPool->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY).GetHandle();
+
+        // Command pools are externally synchronized, each recording thread gets its own.
+        m_frames[i].threadCommands.resize(p_jobSystem->GetThreadCount());
+        for (ThreadCommands& threadCommands : m_frames[i].threadCommands) {
+            threadCommands.p_commandPool = new CommandPool { p_device };
+            threadCommands.usedCount = 0;
+        }
+
+        std::vector<PoolSizeRatio> transientRatios {
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f },
+        };
+        m_frames[i].p_transientDescriptors = new DescriptorAllocator { p_device, transientRatios, TRANSIENT_SETS_PER_POOL };
 
         VkSemaphoreCreateInfo semaphoreInfo {};
         {
@@ -212,6 +583,160 @@ void Renderer::InitPerFrame()
     }
 }
 
+void Renderer::ApplySceneRequests()
+{
+    // Instances of the first mesh on a grid behind the origin, they all end up in the same draw.
+    if (m_addCubesRequested && !p_scene->GetMeshes().empty() && p_scene->GetTransforms()->GetCount() + SPAWN_COUNT <= MAX_OBJECTS) {
+        uint32_t first = p_scene->GetModelCount();
+
+        for (uint32_t i = first; i < first + SPAWN_COUNT; i++) {
+            Model* cube = new Model { p_scene->GetMeshes()[0], p_scene->GetTransforms() };
+            cube->m_transform.SetPosition(Vec3 { (i % 100) * 2.0f - 100.0f, (i / 100 % 100) * 2.0f - 100.0f, -10.0f - (i / 10000) * 2.0f });
+            p_scene->AddModel(cube);
+        }
+    }
+    if (m_addSphereRequested && p_scene->GetTransforms()->GetCount() < MAX_OBJECTS) {
+        AddHighPolySphere();
+    }
+
+    m_addCubesRequested = false;
+    m_addSphereRequested = false;
+}
+
+void Renderer::AddHighPolySphere()
+{
+    if (p_sphereMesh == nullptr) {
+        p_sphereMesh = new Mesh { p_geometryPool, Geometry::CreateSphere(512, 256) };
+        p_scene->AddMesh(p_sphereMesh);
+    }
+    Model* sphere = new Model { p_sphereMesh, p_scene->GetTransforms() };
+    sphere->m_transform.SetPosition(Vec3 { 0.0f, 0.0f, -2.0f });
+    sphere->m_transform.SetScale(Vec3 { 2.0f });
+    p_scene->AddModel(sphere);
+}
+
+PipelineKey Renderer::MakeDrawKey(const VertexVariant& vertex, const FragmentVariant& fragment) const
+{
+    // Render state switches in the settings stand in for materials, each combination is one variant.
+    PipelineKey key = p_pipeline->GetDefaultKey();
+    key.vertex = vertex;
+    key.fragment = fragment;
+
+    if (m_wireframe) {
+        key.polygonMode = VK_POLYGON_MODE_LINE;
+    }
+    if (m_doubleSided) {
+        key.cullMode = VK_CULL_MODE_NONE;
+    }
+    if (m_additiveBlend) {
+        key.blendEnable = VK_TRUE;
+        key.srcBlend = VK_BLEND_FACTOR_ONE;
+        key.dstBlend = VK_BLEND_FACTOR_ONE;
+        key.depthWrite = VK_FALSE;
+    }
+
+    return key;
+}
+
+void Renderer::SelectDrawPipeline()
+{
+    bool profiling = m_profileIndex < m_variantProfiles.size();
+    FragmentVariant fragment = profiling ? m_variantProfiles[m_profileIndex].variant : m_fragmentVariant;
+    VertexVariant vertex = profiling ? m_variantProfiles[m_profileIndex].vertex : p_pipeline->GetDefaultKey().vertex;
+
+    VkPipeline pipeline = p_pipeline->GetVariants()->Get(MakeDrawKey(vertex, fragment), VK_NULL_HANDLE);
+    m_drawPipeline = pipeline != VK_NULL_HANDLE ? pipeline : p_pipeline->GetPipeline();
+
+    // Frames drawn with the fallback say nothing about the variant.
+    m_frames[currentFrame].profileIndex = profiling && pipeline != VK_NULL_HANDLE ? m_profileIndex : UINT32_MAX;
+}
+
+bool Renderer::IsGpuTimerSupported() const
+{
+    return p_gpuTimer->IsSupported();
+}
+
+void Renderer::StartVariantProfile()
+{
+    m_variantProfiles.clear();
+
+    // Without lights the lighting model is never evaluated, one unlit variant per texture setting is enough.
+    for (VkBool32 useTexture : { VK_FALSE, VK_TRUE }) {
+        m_variantProfiles.push_back(VariantProfile { FragmentVariant { useTexture, 0, LightingModel::Lambert } });
+
+        for (uint32_t lightCount : { 1u, static_cast<uint32_t>(MAX_LIGHTS) }) {
+            for (LightingModel lightingModel : { LightingModel::Phong, LightingModel::BlinnPhong, LightingModel::Lambert }) {
+                m_variantProfiles.push_back(VariantProfile { FragmentVariant { useTexture, lightCount, lightingModel } });
+            }
+        }
+    }
+
+    // Queued all at once, they compile while the first ones are measured.
+    for (const VariantProfile& profile : m_variantProfiles) {
+        p_pipeline->GetVariants()->Get(MakeDrawKey(profile.vertex, profile.variant), VK_NULL_HANDLE);
+    }
+
+    m_profileIndex = 0;
+}
+
+void Renderer::StartVertexProfile()
+{
+    // The sphere's vertices outweigh everything else in the scene, so the difference is the vertex shader.
+    m_addSphereRequested = true;
+
+    m_variantProfiles.clear();
+    for (VkBool32 deriveMatrices : { VK_TRUE, VK_FALSE }) {
+        m_variantProfiles.push_back(VariantProfile { m_fragmentVariant, VertexVariant { deriveMatrices } });
+    }
+
+    for (const VariantProfile& profile : m_variantProfiles) {
+        p_pipeline->GetVariants()->Get(MakeDrawKey(profile.vertex, profile.variant), VK_NULL_HANDLE);
+    }
+
+    m_profileIndex = 0;
+}
+
+void Renderer::StartDrawProfile()
+{
+    // Many small draws of one mesh, where a draw call per model costs the most against one instanced batch.
+    // Both paths record from the CPU cull, the GPU culling path ignores the draw mode.
+    m_addCubesRequested = true;
+    m_gpuCulling = false;
+
+    m_variantProfiles.clear();
+    for (bool pushConstantDraws : { false, true }) {
+        m_variantProfiles.push_back(VariantProfile { m_fragmentVariant, p_pipeline->GetDefaultKey().vertex, pushConstantDraws });
+    }
+
+    // Both use the same pipeline, queued in case the settings picked a variant that is not built yet.
+    p_pipeline->GetVariants()->Get(MakeDrawKey(m_variantProfiles[0].vertex, m_variantProfiles[0].variant), VK_NULL_HANDLE);
+
+    m_profileIndex = 0;
+}
+
+void Renderer::RecordVariantProfile(uint32_t index, float gpuMs, float recordMs)
+{
+    // Frames still in flight when the profile moved on belong to a finished variant.
+    if (index != m_profileIndex || index >= m_variantProfiles.size()) {
+        return;
+    }
+
+    // The first frames after a switch may still pay for the pipeline's first use.
+    VariantProfile& profile = m_variantProfiles[index];
+    profile.frameCount++;
+
+    if (profile.frameCount <= PROFILE_WARMUP_FRAMES) {
+        return;
+    }
+
+    profile.gpuMs += gpuMs / PROFILE_FRAMES;
+    profile.recordMs += recordMs / PROFILE_FRAMES;
+
+    if (profile.frameCount == PROFILE_WARMUP_FRAMES + PROFILE_FRAMES) {
+        m_profileIndex++;
+    }
+}
+
 void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
     // vkResetCommandBuffer(commandBuffer, 0);
@@ -223,6 +748,62 @@ void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
 
     VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
     CHECK_VK(result);
+
+    p_device->GetUploadContext()->RecordAcquireBarriers(commandBuffer, m_frames[currentFrame].inFlightFence, m_uploadSemaphores);
+
+    if (m_gpuCulling) {
+        RecordGpuCulling(commandBuffer);
+    }
+
+    SelectDrawPipeline();
+
+    VkCommandBufferInheritanceInfo inheritanceInfo { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+    {
+        inheritanceInfo.renderPass = p_pipeline->GetRenderPass();
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = p_swapChain->GetFrameBuffer(imageIndex);
+    }
+
+    // No job uses the pools between frames, so they are recycled here rather than by each thread.
+    for (ThreadCommands& threadCommands : m_frames[currentFrame].threadCommands) {
+        threadCommands.p_commandPool->Reset();
+        threadCommands.usedCount = 0;
+    }
+    std::fill(m_recordTimes.begin(), m_recordTimes.end(), 0.0f);
+    std::fill(m_recordDrawCounts.begin(), m_recordDrawCounts.end(), 0);
+
+    // The draw list is cut into a few slices per thread so stealing can even out the load.
+    // Every slice gets its own secondary command buffer and they execute in draw order.
+    // Only batches of draws that survived CullScene are recorded.
+    // The GPU path records one indirect call per geometry page, not worth spreading over threads.
+    bool profiling = m_profileIndex < m_variantProfiles.size();
+    bool pushConstantDraws = profiling ? m_variantProfiles[m_profileIndex].pushConstantDraws : m_pushConstantDraws;
+
+    if (m_gpuCulling) {
+        RecordIndirectDraws(inheritanceInfo);
+    } else if (pushConstantDraws) {
+        uint32_t instanceCount = static_cast<uint32_t>(m_instanceSlots.size());
+        uint32_t sliceTarget = p_jobSystem->GetThreadCount() * 2;
+        uint32_t grainSize = std::max(static_cast<uint32_t>(MIN_DRAWS_PER_SLICE), (instanceCount + sliceTarget - 1) / sliceTarget);
+
+        m_sliceCommandBuffers.assign((instanceCount + grainSize - 1) / grainSize, VK_NULL_HANDLE);
+        p_jobSystem->ParallelFor(instanceCount, grainSize, [&](uint32_t begin, uint32_t end) { RecordPushConstantDraws(begin / grainSize, begin, end, inheritanceInfo); });
+    } else {
+        uint32_t batchCount = static_cast<uint32_t>(m_drawBatches.size());
+        uint32_t sliceTarget = p_jobSystem->GetThreadCount() * 2;
+        uint32_t grainSize = std::max(static_cast<uint32_t>(MIN_DRAWS_PER_SLICE), (batchCount + sliceTarget - 1) / sliceTarget);
+
+        m_sliceCommandBuffers.assign((batchCount + grainSize - 1) / grainSize, VK_NULL_HANDLE);
+        p_jobSystem->ParallelFor(batchCount, grainSize, [&](uint32_t begin, uint32_t end) { RecordDraws(begin / grainSize, begin, end, inheritanceInfo); });
+    }
+
+    m_frames[currentFrame].recordMs = 0.0f;
+    for (float ms : m_recordTimes) {
+        m_frames[currentFrame].recordMs += ms;
+    }
+
+    RecordGui(m_frames[currentFrame].guiCommandBuffer, inheritanceInfo);
+
     std::array<VkClearValue, 2> clearValues {};
     clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
     clearValues[1].depthStencil = { 1.0f, 0 };
@@ -238,8 +819,105 @@ void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
         renderPassInfo.pClearValues = clearValues.data();
     }
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->GetPipeline());
+    std::vector<VkCommandBuffer> secondaries = m_sliceCommandBuffers;
+    secondaries.push_back(m_frames[currentFrame].guiCommandBuffer);
+
+    // The timer stops at the start of the GUI secondary, so it only covers the scene draws.
+    p_gpuTimer->Begin(commandBuffer, currentFrame);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+    vkCmdEndRenderPass(commandBuffer);
+
+    result = vkEndCommandBuffer(commandBuffer);
+    CHECK_VK(result);
+}
+
+void Renderer::RecordGpuCulling(VkCommandBuffer commandBuffer)
+{
+    uint32_t drawCount = static_cast<uint32_t>(p_scene->GetDrawItems().size());
+
+    if (drawCount == 0) {
+        return;
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, p_cullPipeline->GetPipeline());
+
+    // Dynamic offsets in binding order : objects, draws, counts and commands, instances.
+    std::array<uint32_t, 4> cullOffsets { m_objectFrameOffset, m_cullDrawOffset, m_countOffset, m_instanceOffset };
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, p_cullPipeline->GetPipelineLayout(), 0, 1, &m_cullDescriptorSet, static_cast<uint32_t>(cullOffsets.size()), cullOffsets.data());
+
+    CullConstants constants {};
+    for (uint32_t i = 0; i < m_frustum.planes.size(); i++) {
+        constants.planes[i] = m_frustum.planes[i];
+    }
+    constants.drawCount = drawCount;
+    vkCmdPushConstants(commandBuffer, p_cullPipeline->GetPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+
+    vkCmdDispatch(commandBuffer, (drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // The draws read the commands and counts as indirect parameters and the instance slots in the vertex shader.
+    VkMemoryBarrier barrier { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    {
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Renderer::RecordIndirectDraws(const VkCommandBufferInheritanceInfo& inheritanceInfo)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    VkCommandBuffer commandBuffer = BeginDrawSecondary(inheritanceInfo);
+    m_sliceCommandBuffers.assign(1, commandBuffer);
+
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = p_device->GetCmdDrawIndexedIndirectCount();
+    VkBuffer indirectBuffer = p_indirectBuffer->GetBuffer();
+    uint32_t stride = sizeof(GpuDrawCommand);
+
+    for (uint32_t i = 0; i < m_indirectRuns.size(); i++) {
+        const IndirectRun& run = m_indirectRuns[i];
+        VkDeviceSize commandOffset = m_commandOffset + static_cast<VkDeviceSize>(run.firstCommand) * stride;
+
+        p_geometryPool->Bind(commandBuffer, run.page);
+
+        // The count stops a run after its last mesh with a visible instance. Without it every command is issued
+        // and culled meshes draw zero instances, one call per command if the device lacks multiDrawIndirect.
+        if (drawIndexedIndirectCount != nullptr) {
+            drawIndexedIndirectCount(commandBuffer, indirectBuffer, commandOffset, indirectBuffer, m_countOffset + i * sizeof(uint32_t), run.commandCount, stride);
+        } else if (p_device->GetFeatures().multiDrawIndirect) {
+            vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, commandOffset, run.commandCount, stride);
+        } else {
+            for (uint32_t c = 0; c < run.commandCount; c++) {
+                vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, commandOffset + c * stride, 1, stride);
+            }
+        }
+    }
+
+    VkResult result = vkEndCommandBuffer(commandBuffer);
+    CHECK_VK(result);
+
+    uint32_t threadIndex = JobSystem::GetThreadIndex();
+    m_recordTimes[threadIndex] += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_recordDrawCounts[threadIndex] += static_cast<uint32_t>(m_indirectRuns.size());
+}
+
+VkCommandBuffer Renderer::BeginDrawSecondary(const VkCommandBufferInheritanceInfo& inheritanceInfo)
+{
+    // Command pools are externally synchronized, so a slice records from the pool of the thread running it.
+    uint32_t threadIndex = JobSystem::GetThreadIndex();
+    ThreadCommands& threadCommands = m_frames[currentFrame].threadCommands[threadIndex];
+
+    if (threadCommands.usedCount == threadCommands.commandBuffers.size()) {
+        threadCommands.commandBuffers.push_back(threadCommands.p_commandPool->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY).GetHandle());
+    }
+
+    VkCommandBuffer commandBuffer = threadCommands.commandBuffers[threadCommands.usedCount++];
+    BeginSecondary(commandBuffer, inheritanceInfo);
+
+    // Secondary command buffers inherit no state, every slice binds its own.
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_drawPipeline);
 
     VkViewport viewport {};
     {
@@ -259,18 +937,87 @@ void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
     }
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    /* auto matrix = p_scene->GetViewProjMatrix();
-     vkCmdPushConstants(commandBuffer, p_pipeline->GetPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(CameraUniform), &matrix);*/
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->GetPipelineLayout(), 1, 1, &m_commonDescriptorSet, 1, &m_commonUniformOffset);
+
+    // Dynamic offsets go in binding order, objects first, then instances.
+    std::array<uint32_t, 2> modelOffsets { m_objectFrameOffset, m_instanceOffset };
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->GetPipelineLayout(), 0, 1, &m_modelDescriptorSet, static_cast<uint32_t>(modelOffsets.size()), modelOffsets.data());
+
+    VkDescriptorSet textureSet = p_device->GetBindlessTable()->GetDescriptorSet();
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->GetPipelineLayout(), 2, 1, &textureSet, 0, nullptr);
+
+    // Push constants start out undefined, instanced draws need NO_SLOT in place.
+    DrawConstants constants { UINT32_MAX };
+    vkCmdPushConstants(commandBuffer, p_pipeline->GetPipelineLayout(), p_pipeline->GetPushConstantStages(), 0, sizeof(DrawConstants), &constants);
+
+    return commandBuffer;
+}
+
+void Renderer::RecordDraws(uint32_t slice, uint32_t begin, uint32_t end, const VkCommandBufferInheritanceInfo& inheritanceInfo)
+{
+    auto start = std::chrono::steady_clock::now();
 
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->GetPipelineLayout(), 1, 1, &m_commonDescriptorSet, 0, nullptr);
+    VkCommandBuffer commandBuffer = BeginDrawSecondary(inheritanceInfo);
+    m_sliceCommandBuffers[slice] = commandBuffer;
+
+    uint32_t boundPage = UINT32_MAX;
+
+    for (uint32_t i = begin; i < end; i++) {
+        const DrawBatch& batch = m_drawBatches[i];
+
+        // Meshes share the pool's buffers, so rebinding only happens when the draw moves to another page.
+        if (batch.mesh.page != boundPage) {
+            boundPage = batch.mesh.page;
+            p_geometryPool->Bind(commandBuffer, boundPage);
+        }
+
+        vkCmdDrawIndexed(commandBuffer, batch.mesh.indexCount, batch.instanceCount, batch.mesh.firstIndex, batch.mesh.vertexOffset, batch.firstInstance);
+    }
+
+    VkResult result = vkEndCommandBuffer(commandBuffer);
+    CHECK_VK(result);
+
+    uint32_t threadIndex = JobSystem::GetThreadIndex();
+    m_recordTimes[threadIndex] += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_recordDrawCounts[threadIndex] += end - begin;
+}
+
+void Renderer::RecordPushConstantDraws(uint32_t slice, uint32_t begin, uint32_t end, const VkCommandBufferInheritanceInfo& inheritanceInfo)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    VkCommandBuffer commandBuffer = BeginDrawSecondary(inheritanceInfo);
+    m_sliceCommandBuffers[slice] = commandBuffer;
+
+    // The slice starts somewhere inside a batch, find the one holding instance begin.
+    auto batch = std::upper_bound(m_drawBatches.begin(), m_drawBatches.end(), begin, [](uint32_t instance, const DrawBatch& b) { return instance < b.firstInstance; }) - 1;
+    uint32_t boundPage = UINT32_MAX;
+
+    for (uint32_t i = begin; i < end; i++) {
+        if (i == batch->firstInstance + batch->instanceCount) {
+            ++batch;
+        }
+
+        if (batch->mesh.page != boundPage) {
+            boundPage = batch->mesh.page;
+            p_geometryPool->Bind(commandBuffer, boundPage);
+        }
 
-    for (int i = 0; i < p_scene->GetModels().size(); i++) {
-        Model* model = p_scene->GetModels()[i];
-        model->Bind(commandBuffer);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_pipeline->GetPipelineLayout(), 0, 1, &model->m_descriptorSet, 0, nullptr);
-        model->Draw(commandBuffer);
+        DrawConstants constants { m_instanceSlots[i] };
+        vkCmdPushConstants(commandBuffer, p_pipeline->GetPipelineLayout(), p_pipeline->GetPushConstantStages(), 0, sizeof(DrawConstants), &constants);
+        vkCmdDrawIndexed(commandBuffer, batch->mesh.indexCount, 1, batch->mesh.firstIndex, batch->mesh.vertexOffset, 0);
     }
 
+    VkResult result = vkEndCommandBuffer(commandBuffer);
+    CHECK_VK(result);
+
+    uint32_t threadIndex = JobSystem::GetThreadIndex();
+    m_recordTimes[threadIndex] += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_recordDrawCounts[threadIndex] += end - begin;
+}
+
+void Renderer::RecordGui(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo& inheritanceInfo)
+{
     ImGui_ImplVulkan_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -284,25 +1031,167 @@ void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
         ImGui::Separator();
 
         ImGui::Text("Light");
-        ImGui::SliderFloat("lx", &p_scene->lightPos.x, -10.0f, 10.0f);
-        ImGui::SliderFloat("ly", &p_scene->lightPos.y, -10.0f, 10.0f);
-        ImGui::SliderFloat("lz", &p_scene->lightPos.z, -10.0f, 10.0f);
+        ImGui::SliderFloat("lx", &p_scene->lights[0].position.x, -10.0f, 10.0f);
+        ImGui::SliderFloat("ly", &p_scene->lights[0].position.y, -10.0f, 10.0f);
+        ImGui::SliderFloat("lz", &p_scene->lights[0].position.z, -10.0f, 10.0f);
         ImGui::Separator();
 
         ImGui::Text("Model Settings");
-        ImGui::SliderFloat("rx", &p_scene->GetModels()[0]->m_transform.m_rotation.x, -100.0f, 100.0f);
-        ImGui::SliderFloat("ry", &p_scene->GetModels()[0]->m_transform.m_rotation.y, -100.0f, 100.0f);
-        ImGui::SliderFloat("rz", &p_scene->GetModels()[0]->m_transform.m_rotation.z, -100.0f, 100.0f);
+        // Edits go through the setters, so only a touched model is re-uploaded.
+        if (p_scene->GetModelCount() > 0) {
+            Model* model = p_scene->GetModels()[0];
+
+            Vec3 rotation = model->m_transform.GetRotation();
+            bool rotated = ImGui::SliderFloat("rx", &rotation.x, -100.0f, 100.0f);
+            rotated |= ImGui::SliderFloat("ry", &rotation.y, -100.0f, 100.0f);
+            rotated |= ImGui::SliderFloat("rz", &rotation.z, -100.0f, 100.0f);
+            if (rotated) {
+                model->m_transform.SetRotation(rotation);
+            }
+
+            Vec3 ambient = model->GetAmbient();
+            bool ambientChanged = ImGui::SliderFloat("ar", &ambient.r, 0.0f, 1.0f);
+            ambientChanged |= ImGui::SliderFloat("ag", &ambient.g, 0.0f, 1.0f);
+            ambientChanged |= ImGui::SliderFloat("ab", &ambient.b, 0.0f, 1.0f);
+            if (ambientChanged) {
+                model->SetAmbient(ambient);
+            }
+
+            Vec3 diffuse = model->GetDiffuse();
+            bool diffuseChanged = ImGui::SliderFloat("dr", &diffuse.r, 0.0f, 1.0f);
+            diffuseChanged |= ImGui::SliderFloat("dg", &diffuse.g, 0.0f, 1.0f);
+            diffuseChanged |= ImGui::SliderFloat("db", &diffuse.b, 0.0f, 1.0f);
+            if (diffuseChanged) {
+                model->SetDiffuse(diffuse);
+            }
+
+            float shininess = model->GetShininess();
+            if (ImGui::SliderFloat("s", &shininess, 1.0f, 1000.0f)) {
+                model->SetShininess(shininess);
+            }
+        }
+
+        // The draws of this frame are already recorded from the scene, the models are added by the next Update.
+        if (!p_scene->GetMeshes().empty() && p_scene->GetTransforms()->GetCount() + SPAWN_COUNT <= MAX_OBJECTS && ImGui::Button("Add 10000 cubes")) {
+            m_addCubesRequested = true;
+        }
+        // Vertex bound, for comparing the GPU render pass time of vertex shader changes.
+        if (p_scene->GetTransforms()->GetCount() < MAX_OBJECTS && ImGui::Button("Add high-poly sphere")) {
+            m_addSphereRequested = true;
+        }
+        ImGui::Text("models : %u", p_scene->GetModelCount());
+
+        ImGui::Separator();
+
+        // Counters of the running renderer. Benchmarks run in benchmarks/ or a --profile-* run, not while a frame records.
+        MemoryStats memoryStats = p_device->GetAllocator()->GetStats();
+        ImGui::Text("Device Memory");
+        ImGui::Text("allocations : %u (%u dedicated)", memoryStats.allocationCount, memoryStats.dedicatedAllocationCount);
+        ImGui::Text("blocks : %u, vkDeviceMemory : %u", memoryStats.blockCount, memoryStats.deviceMemoryCount);
+        ImGui::Text("requested : %.2f MB, block memory : %.2f MB", memoryStats.requestedBytes / (1024.0f * 1024.0f), memoryStats.blockBytes / (1024.0f * 1024.0f));
+        ImGui::Text("fragmentation : %.1f%% internal, %.1f%% external", memoryStats.internalFragmentation * 100.0f, memoryStats.externalFragmentation * 100.0f);
+        UploadStats uploadStats = p_device->GetUploadContext()->GetStats();
+        ImGui::Text("uploads : %u submits, %.2f MB, %u staging chunks", uploadStats.submitCount, uploadStats.uploadedBytes / (1024.0f * 1024.0f), uploadStats.stagingChunkCount);
+        ImGui::Text("transfer queue : %s", uploadStats.dedicatedTransferQueue ? "dedicated" : "graphics");
+        GeometryStats geometryStats = p_geometryPool->GetStats();
+        ImGui::Text("geometry : %u meshes, %u pages", geometryStats.meshCount, geometryStats.pageCount);
+        ImGui::Text("vertices : %u / %u, indices : %u / %u", geometryStats.usedVertices, geometryStats.vertexCapacity, geometryStats.usedIndices, geometryStats.indexCapacity);
+        DeletionStats deletionStats = p_device->GetDeletionQueue()->GetStats();
+        ImGui::Text("deferred deletion : %u objects, %.2f MB", deletionStats.pendingCount, deletionStats.pendingBytes / (1024.0f * 1024.0f));
+        DescriptorAllocatorStats descriptorStats = p_descriptorAllocator->GetStats();
+        DescriptorAllocatorStats transientStats = m_frames[currentFrame].p_transientDescriptors->GetStats();
+        ImGui::Text("descriptor pools : %u (%u sets), transient : %u (%u sets)", descriptorStats.poolCount, descriptorStats.allocatedSets, transientStats.poolCount, transientStats.allocatedSets);
+        BindlessTable* pBindlessTable = p_device->GetBindlessTable();
+        ImGui::Text("bindless : %u / %u textures, %u samplers", pBindlessTable->GetTextureCount(), pBindlessTable->GetTextureCapacity(), pBindlessTable->GetSamplerCount());
+        if (ImGui::Button("Run descriptor update benchmark")) {
+            m_descriptorBenchmarkRequested = true;
+        }
+        if (m_descriptorBenchmark.setCount > 0) {
+            float perSet = 1e6f / m_descriptorBenchmark.setCount;
+            ImGui::Text("%u sets : write %.0f ns/set, batched %.0f ns/set, template %.0f ns/set", m_descriptorBenchmark.setCount, m_descriptorBenchmark.writeMs * perSet, m_descriptorBenchmark.batchedMs * perSet, m_descriptorBenchmark.templateMs * perSet);
+        }
+        PipelineCacheStats cacheStats = p_device->GetPipelineCache()->GetStats();
+        ImGui::Text("pipeline cache : %s, %s (%.1f KB)", cacheStats.warm ? "warm" : "cold", cacheStats.status, cacheStats.loadedBytes / 1024.0f);
+        ImGui::Text("pipelines : %u created in %.2f ms", cacheStats.pipelineCount, cacheStats.createMs);
+        // Cold passes no cache, drivers with their own shader cache still make it faster than a first run.
+        if (ImGui::Button("Measure pipeline creation")) {
+            m_pipelineColdMs = p_pipeline->MeasureCreation(VK_NULL_HANDLE);
+            m_pipelineWarmMs = p_pipeline->MeasureCreation(p_device->GetPipelineCache()->GetCache());
+        }
+        if (m_pipelineColdMs > 0.0f) {
+            ImGui::Text("graphics pipeline : cold %.3f ms, warm %.3f ms", m_pipelineColdMs, m_pipelineWarmMs);
+        }
+        PipelineVariantStats variantStats = p_pipeline->GetVariants()->GetStats();
+        ImGui::Text("variants : %u ready / %u, %u compiling, %.2f ms compiled", variantStats.readyCount, variantStats.variantCount, variantStats.pendingCount, variantStats.compileMs);
+        ImGui::Text("fallback draws : %llu frames", static_cast<unsigned long long>(variantStats.fallbackCount));
+        ImGui::Text("shader reloads : %u, %s", variantStats.reloadCount, variantStats.reloadStatus.empty() ? "watching" : variantStats.reloadStatus.c_str());
+        if (p_device->GetFeatures().fillModeNonSolid) {
+            ImGui::Checkbox("wireframe", &m_wireframe);
+            ImGui::SameLine();
+        }
+        ImGui::Checkbox("double sided", &m_doubleSided);
+        ImGui::SameLine();
+        ImGui::Checkbox("additive", &m_additiveBlend);
+        bool useTexture = m_fragmentVariant.useTexture == VK_TRUE;
+        if (ImGui::Checkbox("texture", &useTexture)) {
+            m_fragmentVariant.useTexture = useTexture ? VK_TRUE : VK_FALSE;
+        }
+        int lightCount = static_cast<int>(m_fragmentVariant.lightCount);
+        if (ImGui::SliderInt("lights", &lightCount, 0, MAX_LIGHTS)) {
+            m_fragmentVariant.lightCount = static_cast<uint32_t>(lightCount);
+        }
+        const char* lightingModels[] = { "Phong", "Blinn-Phong", "Lambert" };
+        int lightingModel = static_cast<int>(m_fragmentVariant.lightingModel);
+        if (ImGui::Combo("lighting", &lightingModel, lightingModels, 3)) {
+            m_fragmentVariant.lightingModel = static_cast<LightingModel>(lightingModel);
+        }
+        if (p_gpuTimer->IsSupported()) {
+            ImGui::Text("gpu scene draws : %.3f ms", m_gpuFrameMs);
+            if (m_profileIndex < m_variantProfiles.size()) {
+                ImGui::Text("profiling variant %u / %u", m_profileIndex + 1, static_cast<uint32_t>(m_variantProfiles.size()));
+            } else if (ImGui::Button("Profile fragment variants")) {
+                StartVariantProfile();
+            }
+            // The unlit, untextured variant comes first, everything else is relative to it.
+            for (uint32_t i = 0; i < m_profileIndex && i < m_variantProfiles.size(); i++) {
+                const VariantProfile& profile = m_variantProfiles[i];
+                ImGui::Text("%s, %u lights, %s%s%s : %.3f ms (%+.3f)", profile.variant.useTexture ? "texture" : "no texture", profile.variant.lightCount, lightingModels[static_cast<uint32_t>(profile.variant.lightingModel)], profile.vertex.deriveMatrices ? ", derived matrices" : "", profile.pushConstantDraws ? ", push constants" : "", profile.gpuMs, profile.gpuMs - m_variantProfiles[0].gpuMs);
+            }
+        }
+        ImGui::Text("uniform ring : %llu / %llu bytes", static_cast<unsigned long long>(p_uniformRing->GetUsedBytes()), static_cast<unsigned long long>(p_uniformRing->GetFrameSize()));
+        ImGui::Text("flush : %u ranges, %llu bytes", static_cast<uint32_t>(m_flushRanges.size()), static_cast<unsigned long long>(m_flushedBytes));
 
-        ImGui::SliderFloat("ar", &p_scene->GetModels()[0]->ambient.r, 0.0f, 1.0f);
-        ImGui::SliderFloat("ag", &p_scene->GetModels()[0]->ambient.g, 0.0f, 1.0f);
-        ImGui::SliderFloat("ab", &p_scene->GetModels()[0]->ambient.b, 0.0f, 1.0f);
+        ImGui::Separator();
 
-        ImGui::SliderFloat("dr", &p_scene->GetModels()[0]->diffuse.r, 0.0f, 1.0f);
-        ImGui::SliderFloat("dg", &p_scene->GetModels()[0]->diffuse.g, 0.0f, 1.0f);
-        ImGui::SliderFloat("db", &p_scene->GetModels()[0]->diffuse.b, 0.0f, 1.0f);
+        ImGui::Text("Command Recording");
+        for (uint32_t t = 0; t < m_recordTimes.size(); t++) {
+            ImGui::Text("thread %u : %.3f ms, %u draws", t, m_recordTimes[t], m_recordDrawCounts[t]);
+        }
+        ImGui::Text("slices : %u", static_cast<uint32_t>(m_sliceCommandBuffers.size()));
+        ImGui::Checkbox("frustum culling", &m_frustumCulling);
+        ImGui::SameLine();
+        ImGui::Checkbox("bvh", &m_hierarchyCulling);
+        ImGui::SameLine();
+        ImGui::Checkbox("gpu", &m_gpuCulling);
+        // Compare the thread record times above with instancing, both read the same object buffer.
+        // vulkan_tutorial --profile-draws measures both with the GPU timer.
+        ImGui::Checkbox("push constant draws (one per model)", &m_pushConstantDraws);
+        if (m_gpuCulling) {
+            // Visibility stays on the GPU, there is no readback to count it.
+            ImGui::Text("cull.comp : %u draw items, %u commands, %u indirect calls", static_cast<uint32_t>(p_scene->GetDrawItems().size()), static_cast<uint32_t>(m_commandTemplate.size()), static_cast<uint32_t>(m_indirectRuns.size()));
+            ImGui::Text("indirect count : %s, multi draw : %s", p_device->GetCmdDrawIndexedIndirectCount() != nullptr ? "yes" : "no", p_device->GetFeatures().multiDrawIndirect ? "yes" : "no");
+        } else {
+            ImGui::Text("visible : %u, culled : %u, %.3f ms", m_cullStats.visibleCount, m_cullStats.culledCount, m_cullStats.cullMs);
+            ImGui::Text("draws : %u for %u instances", static_cast<uint32_t>(m_drawBatches.size()), m_cullStats.visibleCount);
+        }
+        ImGui::Text("bvh : %u nodes", p_scene->GetBvh()->GetNodeCount());
+
+        ImGui::Text("Transforms");
+        ImGui::Text("objects : %u, %u changed, %u uploaded, %.3f ms", p_scene->GetTransforms()->GetCount(), static_cast<uint32_t>(m_dirtyObjects.size()), m_uploadedObjectCount, m_transformMs);
 
-        ImGui::SliderFloat("s", &p_scene->GetModels()[0]->shininess, 1.0f, 1000.0f);
+        JobStats jobStats = p_jobSystem->GetStats();
+        ImGui::Text("Job System");
+        ImGui::Text("threads : %u, jobs : %llu, steals : %llu", jobStats.threadCount, static_cast<unsigned long long>(jobStats.executedCount), static_cast<unsigned long long>(jobStats.stealCount));
 
         ImGui::Separator();
     }
@@ -310,10 +1199,25 @@ void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
     ImGui::End();
 
     ImGui::Render();
+
+    BeginSecondary(commandBuffer, inheritanceInfo);
+    // Executes after every draw secondary, the GUI costs the same for every variant and stays out of the timing.
+    p_gpuTimer->End(commandBuffer, currentFrame);
     ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
 
-    vkCmdEndRenderPass(commandBuffer);
-    result = vkEndCommandBuffer(commandBuffer);
+    VkResult result = vkEndCommandBuffer(commandBuffer);
+    CHECK_VK(result);
+}
+
+void Renderer::BeginSecondary(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo& inheritanceInfo)
+{
+    VkCommandBufferBeginInfo beginInfo { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    {
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+    }
+
+    VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
     CHECK_VK(result);
 }
 
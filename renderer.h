@@ -1,18 +1,81 @@
 #pragma once
 
+#include "job_system.h"
+#include "transform_array.h"
+#include "scene.h"
+#include "bvh.h"
+#include "vk_descriptor_update_template.h"
+#include "vk_pipeline.h"
+
 class Device;
 class SwapChain;
 class Pipeline;
-class Scene;
 class CommandPool;
 class CommandBuffer;
-class DescriptorPool;
+class DescriptorAllocator;
 class Image;
 class Buffer;
+class RingBuffer;
+class ComputePipeline;
+class GeometryPool;
+class JobSystem;
+class Model;
+class GpuTimer;
+
+struct ThreadCommands {
+    CommandPool* p_commandPool; // reset as a whole every frame
+    std::vector<VkCommandBuffer> commandBuffers; // secondary, grows to the most slices the thread recorded in a frame
+    uint32_t usedCount;
+};
+
+// One instanced draw, instances firstInstance .. firstInstance + instanceCount of the frame's instance buffer.
+struct DrawBatch {
+    MeshRange mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+// std430 layout of DrawCommand in cull.comp, one per mesh. The cull shader counts the instances.
+struct GpuDrawCommand {
+    VkDrawIndexedIndirectCommand command;
+    uint32_t countSlot; // draw count of the geometry page run the command belongs to
+    uint32_t drawInSlot; // position of the command in its run
+    uint32_t pad;
+    Vec4 localBounds;
+};
+
+struct CullConstants {
+    Vec4 planes[6];
+    uint32_t drawCount;
+};
+
+// Commands firstCommand .. firstCommand + commandCount share a geometry page and are drawn by one indirect call.
+struct IndirectRun {
+    uint32_t page;
+    uint32_t firstCommand;
+    uint32_t commandCount;
+};
+
+// GPU time of the scene draws with one shader variant or draw path, nothing else changes between variants.
+struct VariantProfile {
+    FragmentVariant variant;
+    VertexVariant vertex;
+    bool pushConstantDraws; // one draw per model instead of instanced batches
+    float gpuMs; // average over the measured frames
+    float recordMs; // CPU time recording the draw slices, summed over threads, same average
+    uint32_t frameCount;
+};
 
 struct PerFrame {
+    uint64_t frameNumber; // last frame submitted with inFlightFence
     CommandPool* p_commandPool;
     VkCommandBuffer commandBuffer;
+    VkCommandBuffer guiCommandBuffer; // secondary, ImGui records after the draw threads
+    std::vector<ThreadCommands> threadCommands; // indexed by JobSystem::GetThreadIndex
+    DescriptorAllocator* p_transientDescriptors; // reset once the frame's fence signaled
+    uint32_t profileIndex; // variant profile the frame was drawn for, UINT32_MAX if none
+    float recordMs; // draw slices of the frame, summed over threads
+    uint64_t cullDrawVersion; // scene structure version of this frame's copy of the cull draw list
     VkSemaphore imageAvailableSemaphore;
     VkSemaphore renderFinishedSemaphore;
     VkFence inFlightFence;
@@ -20,7 +83,7 @@ struct PerFrame {
 
 class Renderer {
 public:
-    Renderer(Device*, SwapChain*, const Pipeline*);
+    Renderer(Device*, SwapChain*, const Pipeline*, JobSystem*);
     ~Renderer();
     Renderer(const Renderer&) = delete;
     Renderer(Renderer&&) = delete;
@@ -32,11 +95,40 @@ public:
     void Update(float dt);
     void Render();
     void UpdateSwapChain(SwapChain*);
-    void CreateCommonUniform();
+    void CreateUniformRing();
+    void StartVariantProfile(); // needs the GPU timer, measures one variant after the other over the next frames
+    void StartVertexProfile(); // same for both simple.vert paths, the high-poly sphere is added by the next Update
+    void StartDrawProfile(); // instanced vs push constant draws with SPAWN_COUNT more cubes, also times recording
+
+public: // getter
+    GeometryPool* GetGeometryPool() const { return p_geometryPool; }
+    bool IsGpuTimerSupported() const;
+    bool IsVariantProfileDone() const { return m_profileIndex >= m_variantProfiles.size(); }
+    const std::vector<VariantProfile>& GetVariantProfiles() const { return m_variantProfiles; }
 
 private:
     void InitPerFrame();
+    void CreateDescriptorSets();
+    void CullScene(); // against m_frustum
+    void BuildBatches();
+    void CreateCullPipeline();
+    void PrepareGpuCulling();
+    void RebuildIndirectCommands();
+    void RecordGpuCulling(VkCommandBuffer);
+    void ApplySceneRequests(); // models asked for from the GUI or a profile
+    void AddHighPolySphere();
+    PipelineKey MakeDrawKey(const VertexVariant&, const FragmentVariant&) const;
+    void SelectDrawPipeline();
+    void RecordVariantProfile(uint32_t index, float gpuMs, float recordMs);
     void RecordCommandBuffer(VkCommandBuffer, uint32_t imageIndex);
+    void RecordDraws(uint32_t slice, uint32_t begin, uint32_t end, const VkCommandBufferInheritanceInfo&);
+    void RecordPushConstantDraws(uint32_t slice, uint32_t begin, uint32_t end, const VkCommandBufferInheritanceInfo&); // instance range
+    void RecordIndirectDraws(const VkCommandBufferInheritanceInfo&);
+    VkCommandBuffer BeginDrawSecondary(const VkCommandBufferInheritanceInfo&);
+    void RecordGui(VkCommandBuffer, const VkCommandBufferInheritanceInfo&);
+    void BeginSecondary(VkCommandBuffer, const VkCommandBufferInheritanceInfo&);
+    void UpdateObjectUniforms();
+    void FlushFrameMemory();
 
 private: // temp
     void CreateTextureImage();
@@ -46,18 +138,90 @@ private: // temp
     VkImageView imageView;
 
 private: // uniform
-    Buffer* m_uniform;
+    RingBuffer* p_uniformRing;
+    RingBuffer* p_objectBuffer; // storage buffer, PhongModel per transform slot, one persistent copy per frame in flight
+    RingBuffer* p_instanceBuffer; // storage buffer, object slot per instance, rewritten every frame
+    uint32_t m_commonUniformOffset { 0 };
+    uint32_t m_objectFrameOffset { 0 };
+    uint32_t m_instanceOffset { 0 };
+    uint32_t m_objectStride { 0 };
+    std::vector<uint32_t> m_dirtyObjects;
+    std::vector<uint32_t> m_pendingObjects; // slots whose change has not reached every frame copy yet
+    std::vector<uint8_t> m_objectPendingCopies; // per slot, bit i set while frame copy i misses the last change
+    VkDescriptorSet m_modelDescriptorSet;
     VkDescriptorSet m_commonDescriptorSet;
 
+private: // gpu culling
+    ComputePipeline* p_cullPipeline;
+    RingBuffer* p_cullDrawBuffer; // storage buffer, (object slot, command) per draw item, one persistent copy per frame in flight
+    RingBuffer* p_indirectBuffer; // draw counts and indirect commands, reset every frame and filled by cull.comp
+    VkDescriptorSet m_cullDescriptorSet;
+    uint32_t m_cullDrawOffset { 0 };
+    uint32_t m_commandOffset { 0 };
+    uint32_t m_countOffset { 0 };
+    uint64_t m_indirectVersion { UINT64_MAX }; // scene structure version the commands were built for
+    std::vector<GpuDrawCommand> m_commandTemplate; // instance counts zeroed, copied into the frame's commands
+    std::vector<IndirectRun> m_indirectRuns;
+    std::vector<uint32_t> m_meshCommands; // command index by mesh id
+    Frustum m_frustum {};
+    bool m_gpuCulling { false };
+
 private:
     Device* p_device;
     SwapChain* p_swapChain;
     const Pipeline* p_pipeline;
-    DescriptorPool* p_descriptorPool;
+    DescriptorAllocator* p_descriptorAllocator; // sets that live as long as the renderer
+    GeometryPool* p_geometryPool;
+    JobSystem* p_jobSystem;
     Scene* p_scene;
+    Mesh* p_sphereMesh { nullptr }; // owned by the scene, added on first use
+    bool m_addCubesRequested { false }; // SPAWN_COUNT cubes at the start of the next Update
+    bool m_addSphereRequested { false };
 
 private:
     enum { MAX_FRAMES_IN_FLIGHT = 3 };
+    enum { ALL_FRAME_COPIES = (1 << MAX_FRAMES_IN_FLIGHT) - 1 }; // fits the uint8_t masks of m_objectPendingCopies
+    enum { UNIFORM_RING_FRAME_SIZE = 256 * 1024 };
+    enum { MIN_DRAWS_PER_SLICE = 256 };
+    enum { TRANSFORM_BATCH_SIZE = 1024 }; // multiple of 4, keeps the SIMD kernel off its padded tail
+    enum { MAX_OBJECTS = 128 * 1024 };
+    enum { SPAWN_COUNT = 10000 };
+    enum { MAX_MESHES = 1024 }; // indirect commands per frame
+    enum { TRANSIENT_SETS_PER_POOL = 64 };
+    enum { CULL_GROUP_SIZE = 64 }; // local_size_x of cull.comp
+    enum { PROFILE_WARMUP_FRAMES = 8 };
+    enum { PROFILE_FRAMES = 64 };
+    enum { COMMAND_OFFSET = sizeof(uint32_t) * MAX_MESHES }; // commands in an indirect buffer frame, after the draw counts
     PerFrame m_frames[MAX_FRAMES_IN_FLIGHT];
+    std::vector<VkSemaphore> m_uploadSemaphores;
+    std::vector<VkMappedMemoryRange> m_flushRanges;
+    VkDeviceSize m_flushedBytes { 0 };
+    std::vector<VkCommandBuffer> m_sliceCommandBuffers; // in draw order, whichever thread recorded them
+    std::vector<float> m_recordTimes; // ms spent per thread recording the last frame
+    std::vector<uint32_t> m_recordDrawCounts;
+    std::vector<uint32_t> m_visibleDraws; // draw indices that passed culling, in draw order
+    std::vector<DrawBatch> m_drawBatches; // one per mesh with visible instances
+    std::vector<uint32_t> m_meshInstanceCounts; // scratch for BuildBatches, indexed by mesh id
+    std::vector<uint32_t> m_instanceSlots; // host copy of the frame's instance buffer
+    bool m_pushConstantDraws { false }; // one draw per visible model with its slot in push constants
+    CullStats m_cullStats {};
+    bool m_frustumCulling { true };
+    bool m_hierarchyCulling { false }; // query the scene BVH instead of testing every sphere
+    DescriptorBenchmark m_descriptorBenchmark {};
+    bool m_descriptorBenchmarkRequested { false }; // runs at the start of the next Update
+    VkPipeline m_drawPipeline { VK_NULL_HANDLE }; // variant bound by every draw slice this frame
+    bool m_wireframe { false };
+    bool m_doubleSided { false };
+    bool m_additiveBlend { false };
+    FragmentVariant m_fragmentVariant { VK_TRUE, 1, LightingModel::Phong };
+    GpuTimer* p_gpuTimer;
+    float m_gpuFrameMs { 0.0f }; // render pass of the last frame read back
+    std::vector<VariantProfile> m_variantProfiles;
+    uint32_t m_profileIndex { 0 }; // variant being measured, m_variantProfiles.size() when done
+    float m_pipelineColdMs { 0.0f };
+    float m_pipelineWarmMs { 0.0f };
+    float m_transformMs { 0.0f };
+    uint32_t m_uploadedObjectCount { 0 };
     uint32_t currentFrame = 0;
+    uint64_t m_frameNumber = 1;
 };
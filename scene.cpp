@@ -1,11 +1,16 @@
 #include "pch.h"
 #include "scene.h"
 #include "model.h"
+#include "mesh.h"
 #include "camera.h"
+#include "transform_array.h"
+#include "bvh.h"
 
 Scene::Scene(Camera* pCamera)
     : p_camera { pCamera }
 {
+    p_transforms = new TransformArray {};
+    p_bvh = new Bvh {};
 }
 
 Scene::~Scene()
@@ -15,9 +20,196 @@ Scene::~Scene()
     for (const Model* m : m_models) {
         delete m;
     }
+
+    for (const Mesh* mesh : m_meshes) {
+        delete mesh;
+    }
+
+    delete p_bvh;
+    delete p_transforms;
 }
 
-void Scene::AddModel(Model* model)
+uint32_t Scene::AddMesh(Mesh* mesh)
 {
+    uint32_t meshId = static_cast<uint32_t>(m_meshes.size());
+    m_meshes.push_back(mesh);
+    m_meshIds[mesh] = meshId;
+    m_structureVersion++;
+
+    return meshId;
+}
+
+ModelHandle Scene::AddModel(Model* model)
+{
+    auto meshId = m_meshIds.find(model->GetMesh());
+
+    if (meshId == m_meshIds.end()) {
+        throw std::runtime_error("model mesh was not added to the scene!");
+    }
+
+    ModelHandle handle {};
+
+    if (!m_freeHandles.empty()) {
+        handle.index = m_freeHandles.back();
+        m_freeHandles.pop_back();
+    } else {
+        handle.index = static_cast<uint32_t>(m_handleSlots.size());
+        m_handleSlots.push_back(HandleSlot { UINT32_MAX, 0 });
+    }
+
+    HandleSlot& slot = m_handleSlots[handle.index];
+    slot.drawIndex = static_cast<uint32_t>(m_drawItems.size());
+    handle.generation = slot.generation;
+
+    DrawItem item {};
+    item.mesh = model->GetMesh()->GetRange();
+    item.meshId = meshId->second;
+    item.objectSlot = model->m_transform.GetIndex();
+    item.localBounds = model->GetLocalBounds();
+
+    m_drawItems.push_back(item);
     m_models.push_back(model);
+    m_drawHandles.push_back(handle.index);
+    m_boundsX.push_back(0.0f);
+    m_boundsY.push_back(0.0f);
+    m_boundsZ.push_back(0.0f);
+    m_boundsRadius.push_back(0.0f);
+    m_worldAabbs.push_back(Aabb {});
+
+    if (model->m_animated) {
+        m_animatedModels.push_back(model);
+    }
+
+    if (item.objectSlot >= m_slotModels.size()) {
+        m_slotModels.resize(item.objectSlot + 1, nullptr);
+        m_slotDraws.resize(item.objectSlot + 1, UINT32_MAX);
+    }
+    m_slotModels[item.objectSlot] = model;
+    m_slotDraws[item.objectSlot] = slot.drawIndex;
+
+    ComputeWorldBounds(slot.drawIndex);
+    m_bvhStale = true;
+    m_structureVersion++;
+
+    return handle;
+}
+
+void Scene::RemoveModel(ModelHandle handle)
+{
+    Model* model = GetModel(handle);
+
+    if (model == nullptr) {
+        return;
+    }
+
+    HandleSlot& slot = m_handleSlots[handle.index];
+    uint32_t drawIndex = slot.drawIndex;
+    uint32_t lastIndex = static_cast<uint32_t>(m_drawItems.size()) - 1;
+
+    // Keep the arrays dense, the last draw moves into the hole and its handle follows it.
+    MoveDraw(lastIndex, drawIndex);
+    m_slotDraws[model->m_transform.GetIndex()] = UINT32_MAX;
+
+    m_drawItems.pop_back();
+    m_models.pop_back();
+    m_drawHandles.pop_back();
+    m_boundsX.pop_back();
+    m_boundsY.pop_back();
+    m_boundsZ.pop_back();
+    m_boundsRadius.pop_back();
+    m_worldAabbs.pop_back();
+    m_bvhStale = true;
+    m_structureVersion++;
+
+    slot.drawIndex = UINT32_MAX;
+    slot.generation++;
+    m_freeHandles.push_back(handle.index);
+
+    m_slotModels[model->m_transform.GetIndex()] = nullptr;
+    m_animatedModels.erase(std::remove(m_animatedModels.begin(), m_animatedModels.end(), model), m_animatedModels.end());
+
+    // The transform slot goes back to its array, the mesh stays with the scene for other instances.
+    delete model;
+}
+
+Model* Scene::GetModel(ModelHandle handle) const
+{
+    if (handle.index >= m_handleSlots.size()) {
+        return nullptr;
+    }
+
+    const HandleSlot& slot = m_handleSlots[handle.index];
+
+    if (slot.generation != handle.generation || slot.drawIndex == UINT32_MAX) {
+        return nullptr;
+    }
+
+    return m_models[slot.drawIndex];
+}
+
+void Scene::UpdateWorldBounds(const std::vector<uint32_t>& transformIndices)
+{
+    for (uint32_t index : transformIndices) {
+        if (index < m_slotDraws.size() && m_slotDraws[index] != UINT32_MAX) {
+            ComputeWorldBounds(m_slotDraws[index]);
+            m_movedDraws.push_back(m_slotDraws[index]);
+        }
+    }
+}
+
+void Scene::UpdateSpatialIndex(JobSystem* pJobSystem)
+{
+    if (m_bvhStale) {
+        p_bvh->Build(m_worldAabbs, pJobSystem);
+        m_bvhStale = false;
+    } else if (!m_movedDraws.empty()) {
+        p_bvh->Refit(m_worldAabbs, m_movedDraws);
+    }
+
+    m_movedDraws.clear();
+}
+
+void Scene::Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+    Culling::CullSpheres(frustum, m_boundsX.data(), m_boundsY.data(), m_boundsZ.data(), m_boundsRadius.data(), static_cast<uint32_t>(m_drawItems.size()), visible);
+}
+
+void Scene::CullHierarchy(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+    size_t first = visible.size();
+    p_bvh->QueryFrustum(frustum, visible);
+
+    // The tree returns draws grouped by space, recording wants them back in draw order.
+    std::sort(visible.begin() + first, visible.end());
+}
+
+void Scene::ComputeWorldBounds(uint32_t drawIndex)
+{
+    const Vec4& localBounds = m_drawItems[drawIndex].localBounds;
+    Mat4 world = m_models[drawIndex]->GetWorldMatrix();
+
+    // The largest axis scale keeps the sphere conservative under non-uniform scaling.
+    Vec3 center = Vec3 { world * Vec4 { Vec3 { localBounds }, 1.0f } };
+    float scale = std::max({ glm::length(Vec3 { world[0] }), glm::length(Vec3 { world[1] }), glm::length(Vec3 { world[2] }) });
+
+    m_boundsX[drawIndex] = center.x;
+    m_boundsY[drawIndex] = center.y;
+    m_boundsZ[drawIndex] = center.z;
+    m_boundsRadius[drawIndex] = localBounds.w * scale;
+    m_worldAabbs[drawIndex] = Culling::TransformAabb(m_models[drawIndex]->GetLocalAabb(), world);
+}
+
+void Scene::MoveDraw(uint32_t from, uint32_t to)
+{
+    m_drawItems[to] = m_drawItems[from];
+    m_models[to] = m_models[from];
+    m_drawHandles[to] = m_drawHandles[from];
+    m_boundsX[to] = m_boundsX[from];
+    m_boundsY[to] = m_boundsY[from];
+    m_boundsZ[to] = m_boundsZ[from];
+    m_boundsRadius[to] = m_boundsRadius[from];
+    m_worldAabbs[to] = m_worldAabbs[from];
+
+    m_handleSlots[m_drawHandles[to]].drawIndex = to;
+    m_slotDraws[m_drawItems[to].objectSlot] = to;
 }
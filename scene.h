@@ -1,7 +1,24 @@
 #pragma once
 
+#include "geometry_pool.h"
+#include "culling.h"
+
 class Model;
+class Mesh;
 class Camera;
+class TransformArray;
+class Bvh;
+class JobSystem;
+
+/*
+ * Stays valid while the model lives. A removed model's slot gets a new generation,
+ * so a stale handle resolves to nullptr instead of whatever took its place.
+ */
+struct ModelHandle {
+    uint32_t index { UINT32_MAX };
+    uint32_t generation { 0 };
+};
+
 
 class Scene {
 public:
@@ -13,15 +30,69 @@ public:
     Scene& operator=(Scene&&) = delete;
 
 public:
-    void AddModel(Model*);
-    std::vector<Model*> GetModels() const { return m_models; }
+    uint32_t AddMesh(Mesh*); // takes ownership, returns the mesh id
+    ModelHandle AddModel(Model*); // takes ownership, its mesh must have been added
+    void RemoveModel(ModelHandle);
+    Model* GetModel(ModelHandle) const;
+    void UpdateWorldBounds(const std::vector<uint32_t>& transformIndices); // slots whose transform changed
+    void UpdateSpatialIndex(JobSystem*); // rebuilds the BVH after adds and removes, refits it after moves
+    void Cull(const Frustum&, std::vector<uint32_t>& visible) const; // SIMD sphere test over every draw, appends draw indices
+    void CullHierarchy(const Frustum&, std::vector<uint32_t>& visible) const; // BVH query, appends draw indices in draw order
+
+public: // getter
+    // Draw items and models are parallel arrays, removal moves the last entry into the hole.
+    const std::vector<DrawItem>& GetDrawItems() const { return m_drawItems; }
+    const std::vector<Model*>& GetModels() const { return m_models; }
+    const std::vector<Mesh*>& GetMeshes() const { return m_meshes; }
+    uint32_t GetModelCount() const { return static_cast<uint32_t>(m_models.size()); }
+    const std::vector<Model*>& GetAnimatedModels() const { return m_animatedModels; }
+    Model* GetModelBySlot(uint32_t transformIndex) const { return transformIndex < m_slotModels.size() ? m_slotModels[transformIndex] : nullptr; }
+    TransformArray* GetTransforms() const { return p_transforms; }
+    const Bvh* GetBvh() const { return p_bvh; }
+    const std::vector<Aabb>& GetWorldAabbs() const { return m_worldAabbs; }
+    uint64_t GetStructureVersion() const { return m_structureVersion; } // changes whenever meshes or draw items are added or removed
 
 public:
     Camera* p_camera;
-    Vec3 lightPos { Vec3 { 0, 0, 3.0f } };
     Vec3 lightDir { Vec3 { 1.0f } };
-    Vec3 lightColor { Vec3 { 1.0f } };
+    // Point lights, how many are shaded is a pipeline variant. The first one is white so one light looks as before.
+    std::array<LightData, MAX_LIGHTS> lights { {
+        { Vec3 { 0.0f, 0.0f, 3.0f }, Vec3 { 1.0f } },
+        { Vec3 { 4.0f, 2.0f, 1.0f }, Vec3 { 0.8f, 0.3f, 0.2f } },
+        { Vec3 { -4.0f, 2.0f, 1.0f }, Vec3 { 0.2f, 0.3f, 0.8f } },
+        { Vec3 { 0.0f, -4.0f, 2.0f }, Vec3 { 0.3f, 0.8f, 0.3f } },
+    } };
+
+private:
+    struct HandleSlot {
+        uint32_t drawIndex;
+        uint32_t generation;
+    };
+
+private:
+    void ComputeWorldBounds(uint32_t drawIndex);
+    void MoveDraw(uint32_t from, uint32_t to);
 
 private:
+    std::vector<DrawItem> m_drawItems;
+    // World bounding spheres, one array per component and parallel to m_drawItems for the SIMD cull.
+    std::vector<float> m_boundsX;
+    std::vector<float> m_boundsY;
+    std::vector<float> m_boundsZ;
+    std::vector<float> m_boundsRadius;
+    std::vector<Aabb> m_worldAabbs; // parallel to m_drawItems, the BVH primitives
     std::vector<Model*> m_models;
+    std::vector<Mesh*> m_meshes; // indexed by mesh id
+    std::map<const Mesh*, uint32_t> m_meshIds;
+    std::vector<uint32_t> m_drawHandles; // handle index of each draw item
+    std::vector<HandleSlot> m_handleSlots;
+    std::vector<uint32_t> m_freeHandles;
+    std::vector<Model*> m_animatedModels;
+    std::vector<Model*> m_slotModels; // indexed by transform slot
+    std::vector<uint32_t> m_slotDraws; // draw index by transform slot
+    TransformArray* p_transforms;
+    Bvh* p_bvh;
+    bool m_bvhStale { true }; // draw indices changed, a refit is not enough
+    std::vector<uint32_t> m_movedDraws;
+    uint64_t m_structureVersion { 0 };
 };
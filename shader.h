@@ -6,8 +6,11 @@ class Shader {
 public:
     static void CreateModule(VkDevice device, const std::string& filename, VkShaderModule* out)
     {
-        std::vector<char> binary = ReadFile(filename);
+        CreateModule(device, ReadFile(filename), out);
+    }
 
+    static void CreateModule(VkDevice device, const std::vector<char>& binary, VkShaderModule* out)
+    {
         VkShaderModuleCreateInfo createInfo {};
         {
             createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -19,12 +22,28 @@ public:
         CHECK_VK(result);
     }
 
-private:
+    // Constants 0 .. count - 1, packed as consecutive 4 byte values in declaration order.
+    static std::vector<VkSpecializationMapEntry> CreateSpecializationEntries(uint32_t count)
+    {
+        std::vector<VkSpecializationMapEntry> entries(count);
+
+        for (uint32_t i = 0; i < count; i++) {
+            entries[i].constantID = i;
+            entries[i].offset = i * sizeof(uint32_t);
+            entries[i].size = sizeof(uint32_t);
+        }
+
+        return entries;
+    }
+
+    // Throws if the file cannot be opened, a shader being rewritten by the compiler may be locked for a moment.
     static std::vector<char> ReadFile(const std::string& filename)
     {
         std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
-        assert(file.is_open());
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open shader " + filename + "!");
+        }
 
         size_t fileSize = (size_t)file.tellg();
         std::vector<char> buffer(fileSize);
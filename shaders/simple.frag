@@ -1,54 +1,90 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(set = 0, binding = 0) uniform ModelUniformData {
+struct ObjectData {
     mat4 world;
+    mat3 normalMatrix;
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
     float shininess;
-} model;
+    uint textureIndex;
+    uint samplerIndex;
+};
 
-layout(set = 0, binding = 1) uniform sampler2D texSampler;
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+};
+
+// Pipeline variants, see FragmentVariant. The driver compiles each combination with the
+// constants folded in, so a disabled feature costs nothing rather than a branch.
+layout(constant_id = 0) const bool USE_TEXTURE = true;
+layout(constant_id = 1) const uint LIGHT_COUNT = 1;
+layout(constant_id = 2) const uint LIGHTING_MODEL = 0;
+
+const uint LIGHTING_PHONG = 0;
+const uint LIGHTING_BLINN_PHONG = 1;
+const uint LIGHTING_LAMBERT = 2;
+
+// Bindless table, materials pick their texture and sampler by index.
+layout(set = 2, binding = 0) uniform texture2D textures[];
+layout(set = 2, binding = 1) uniform sampler samplers[];
+
+const uint MAX_LIGHTS = 4;
+
+struct LightData {
+    vec3 position;
+    vec3 color;
+};
 
 layout(set = 1, binding = 0) uniform CommonUniform
 {
 	mat4 view;
 	mat4 proj;
+	mat4 viewProj;
     vec3 eyePos;
-    vec3 lightPos;
     vec3 lightDir;
-    vec3 lightColor;
+    LightData lights[MAX_LIGHTS];
 } commonData;
 
 layout(location = 0) in vec3 worldPos;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
+layout(location = 3) flat in uint objectSlot;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    vec3 base = texture(texSampler, texCoord).xyz;
-    //base = vec3(1.0, 0.5, 0.5);
+    ObjectData model = objects[objectSlot];
 
-    // Ambient
-    vec3 ambient = model.ambient;
+    vec3 base = vec3(1.0);
+    if (USE_TEXTURE) {
+        // Instances of one draw may use different textures, so the index is not uniform across the draw.
+        base = texture(sampler2D(textures[nonuniformEXT(model.textureIndex)], samplers[nonuniformEXT(model.samplerIndex)]), texCoord).xyz;
+    }
 
-    // Diffuse
     vec3 N = normalize(normal);
-    vec3 L = normalize(commonData.lightPos - worldPos);
-    float diff = max(dot(N, L), 0.0);
-
-    vec3 diffuse = diff * model.diffuse;
-   
-    // Specular
-    vec3 eyePos = inverse(commonData.view)[3].xyz;
-    vec3 viewDir = normalize(eyePos - worldPos);
-    vec3 reflectDir = reflect(-L, N);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), model.shininess);
-    
-    vec3 specular = spec * model.specular;
-
-    vec3 result = (ambient + diffuse + specular) * base;
-
-    outColor = vec4(result, 1.0);
+    vec3 viewDir = normalize(commonData.eyePos - worldPos);
+
+    // Ambient
+    vec3 lighting = model.ambient;
+
+    for (uint i = 0; i < LIGHT_COUNT; i++) {
+        // Diffuse
+        vec3 L = normalize(commonData.lights[i].position - worldPos);
+        vec3 light = max(dot(N, L), 0.0) * model.diffuse;
+
+        // Specular
+        if (LIGHTING_MODEL == LIGHTING_PHONG) {
+            vec3 reflectDir = reflect(-L, N);
+            light += pow(max(dot(viewDir, reflectDir), 0.0), model.shininess) * model.specular;
+        } else if (LIGHTING_MODEL == LIGHTING_BLINN_PHONG) {
+            vec3 halfDir = normalize(L + viewDir);
+            light += pow(max(dot(N, halfDir), 0.0), model.shininess) * model.specular;
+        }
+
+        lighting += light * commonData.lights[i].color;
+    }
+
+    outColor = vec4(lighting * base, 1.0);
 }
\ No newline at end of file
@@ -1,21 +1,50 @@
 #version 450
 
-layout(set = 0, binding = 0) uniform ModelUniformData {
+struct ObjectData {
     mat4 world;
+    mat3 normalMatrix;
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
     float shininess;
-} model;
+    uint textureIndex;
+    uint samplerIndex;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+};
+
+// gl_InstanceIndex includes firstInstance, so every batch reads its own range.
+layout(std430, set = 0, binding = 2) readonly buffer InstanceBuffer {
+    uint objectSlots[];
+};
+
+// Per-model draws push their object slot, instanced draws push NO_SLOT and look it up.
+const uint NO_SLOT = 0xFFFFFFFFu;
+
+// The per-vertex inverse and matrix product the precomputed matrices replaced, only set when profiling them.
+layout(constant_id = 0) const bool DERIVE_MATRICES = false;
+
+layout(push_constant) uniform DrawConstants {
+    uint objectSlot;
+} draw;
+
+const uint MAX_LIGHTS = 4;
+
+struct LightData {
+    vec3 position;
+    vec3 color;
+};
 
 layout(set = 1, binding = 0) uniform CommonUniform
 {
 	mat4 view;
 	mat4 proj;
+	mat4 viewProj;
     vec3 eyePos;
-    vec3 lightPos;
     vec3 lightDir;
-    vec3 lightColor;
+    LightData lights[MAX_LIGHTS];
 } commonData;
 
 layout(location = 0) in vec3 inPosition;
@@ -25,11 +54,25 @@ layout(location = 2) in vec2 inTexCoord;
 layout(location = 0) out vec3 worldPos;
 layout(location = 1) out vec3 normal;
 layout(location = 2) out vec2 texCoord;
+layout(location = 3) flat out uint objectSlot;
 
 void main() {
-    worldPos = (model.world * vec4(inPosition, 1.0)).xyz;
-    normal = (transpose(inverse(model.world)) * vec4(inNormal, 0.0)).xyz;
+    objectSlot = draw.objectSlot != NO_SLOT ? draw.objectSlot : objectSlots[gl_InstanceIndex];
+    mat4 world = objects[objectSlot].world;
+
     texCoord = inTexCoord;
 
-    gl_Position = commonData.proj * commonData.view * model.world * vec4(inPosition, 1.0);
-}
\ No newline at end of file
+    if (DERIVE_MATRICES) {
+        worldPos = (world * vec4(inPosition, 1.0)).xyz;
+        normal = (transpose(inverse(world)) * vec4(inNormal, 0.0)).xyz;
+        gl_Position = commonData.proj * commonData.view * world * vec4(inPosition, 1.0);
+        return;
+    }
+
+    // The normal matrix comes from the CPU with the world matrix, and the world position is reused for the
+    // clip position, so a vertex costs two matrix-vector products and no matrix inverse or matrix product.
+    worldPos = (world * vec4(inPosition, 1.0)).xyz;
+    normal = objects[objectSlot].normalMatrix * inNormal;
+
+    gl_Position = commonData.viewProj * vec4(worldPos, 1.0);
+}
@@ -1,38 +1,67 @@
 #pragma once
 
+#include "transform_array.h"
+
+/*
+ * One slot of a TransformArray. The components live in the array, this only knows where.
+ */
 class Transform {
 public:
-    Transform() = default;
-    ~Transform() = default;
+    Transform(TransformArray* pArray)
+        : p_array { pArray }
+        , m_index { pArray->Add() }
+    {
+    }
+    ~Transform() { p_array->Remove(m_index); }
+    Transform(const Transform&) = delete;
+    Transform(Transform&&) = delete;
+    Transform& operator=(const Transform&) = delete;
+    Transform& operator=(Transform&&) = delete;
 
 public:
+    // Reference path, TransformArray::ComputeWorldMatrices builds the same matrix for many transforms at once.
     Mat4 GetWorldMatrix() const
     {
+        Vec3 position = GetPosition();
+        Vec3 rotation = GetRotation();
+
         glm::mat4 modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, m_position);
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(m_rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(m_rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(m_rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-        modelMatrix = glm::scale(modelMatrix, m_scale);
+        modelMatrix = glm::translate(modelMatrix, position);
+        modelMatrix = glm::rotate(modelMatrix, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+        modelMatrix = glm::rotate(modelMatrix, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+        modelMatrix = glm::rotate(modelMatrix, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+        modelMatrix = glm::scale(modelMatrix, GetScale());
         return modelMatrix;
     }
 
     void RotateZ(float dt)
     {
-        m_rotation.z += rotation_speed * dt;
+        SetRotation(GetRotation() + Vec3 { 0.0f, 0.0f, rotation_speed * dt });
     }
     void RotateY(float dt)
     {
-        m_rotation.y += rotation_speed * dt;
+        SetRotation(GetRotation() + Vec3 { 0.0f, rotation_speed * dt, 0.0f });
     }
     void RotateX(float dt)
     {
-        m_rotation.x += rotation_speed * dt;
+        SetRotation(GetRotation() + Vec3 { rotation_speed * dt, 0.0f, 0.0f });
     }
 
+    Vec3 GetPosition() const { return p_array->GetPosition(m_index); }
+    Vec3 GetRotation() const { return p_array->GetRotation(m_index); }
+    Vec3 GetScale() const { return p_array->GetScale(m_index); }
+    void SetPosition(const Vec3& position) { p_array->SetPosition(m_index, position); }
+    void SetRotation(const Vec3& rotation) { p_array->SetRotation(m_index, rotation); }
+    void SetScale(const Vec3& scale) { p_array->SetScale(m_index, scale); }
+    void MarkDirty() { p_array->MarkDirty(m_index); }
+
+public: // getter
+    uint32_t GetIndex() const { return m_index; }
+
 public:
     const float rotation_speed = 50.0f;
-    Vec3 m_scale { Vec3 { 1.0f } };
-    Vec3 m_rotation { Vec3 { 0.0f } };
-    Vec3 m_position { Vec3 { 0.0f } };
+
+private:
+    TransformArray* p_array;
+    uint32_t m_index;
 };
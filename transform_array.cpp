@@ -0,0 +1,314 @@
+// No pch.h, the transform kernels build without a window or Vulkan (see benchmarks/).
+#include "transform_array.h"
+#include "transform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace {
+// sin and cos of four angles in radians, Cephes polynomials after reduction to [-pi/4, pi/4].
+void SinCos4(__m128 x, __m128* pSin, __m128* pCos)
+{
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000)));
+
+    __m128 signSin = _mm_and_ps(x, signMask);
+    x = _mm_andnot_ps(signMask, x);
+
+    // Octant of the angle, rounded up to even so the remainder lands in [-pi/4, pi/4].
+    __m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+    octant = _mm_add_epi32(octant, _mm_set1_epi32(1));
+    octant = _mm_and_si128(octant, _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(octant);
+
+    __m128 swapSignSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29));
+    __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+    __m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+    signSin = _mm_xor_ps(signSin, swapSignSin);
+
+    // Extended precision subtraction of octant * pi/4.
+    x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-0.78515625f)));
+    x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-2.4187564849853515625e-4f)));
+    x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-3.77489497744594108e-8f)));
+
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 cosPoly = _mm_set1_ps(2.443315711809948e-5f);
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(-1.388731625493765e-3f));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(4.166664568298827e-2f));
+    cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+    cosPoly = _mm_sub_ps(cosPoly, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+    cosPoly = _mm_add_ps(cosPoly, _mm_set1_ps(1.0f));
+
+    __m128 sinPoly = _mm_set1_ps(-1.9515295891e-4f);
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(8.3321608736e-3f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(-1.6666654611e-1f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+    // Odd octants swap the two polynomials.
+    __m128 sinValue = _mm_or_ps(_mm_and_ps(polyMask, sinPoly), _mm_andnot_ps(polyMask, cosPoly));
+    __m128 cosValue = _mm_or_ps(_mm_and_ps(polyMask, cosPoly), _mm_andnot_ps(polyMask, sinPoly));
+
+    *pSin = _mm_xor_ps(sinValue, signSin);
+    *pCos = _mm_xor_ps(cosValue, signCos);
+}
+
+// Components of four transforms, lane i belongs to transform i.
+struct TransformLanes {
+    __m128 position[3];
+    __m128 rotation[3]; // degrees
+    __m128 scale[3];
+};
+
+// Transposes one matrix column of four transforms into place, lane i goes to matrix i.
+void StoreColumn(uint8_t* const pDst[4], uint32_t column, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(reinterpret_cast<float*>(pDst[0]) + column * 4, x);
+    _mm_storeu_ps(reinterpret_cast<float*>(pDst[1]) + column * 4, y);
+    _mm_storeu_ps(reinterpret_cast<float*>(pDst[2]) + column * 4, z);
+    _mm_storeu_ps(reinterpret_cast<float*>(pDst[3]) + column * 4, w);
+}
+
+// M = T * Rx * Ry * Rz * S for four transforms, then the normal matrix. R is orthonormal and S diagonal,
+// so transpose(inverse(R * S)) is R * inverse(S) and needs no general inverse.
+void StoreWorldMatrices(const TransformLanes& lanes, uint8_t* const pDst[4])
+{
+    const __m128 degToRad = _mm_set1_ps(glm::radians(1.0f));
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 sx, cx, sy, cy, sz, cz;
+    SinCos4(_mm_mul_ps(lanes.rotation[0], degToRad), &sx, &cx);
+    SinCos4(_mm_mul_ps(lanes.rotation[1], degToRad), &sy, &cy);
+    SinCos4(_mm_mul_ps(lanes.rotation[2], degToRad), &sz, &cz);
+
+    // Rx * Ry * Rz by rows, each column scaled by the matching scale component.
+    __m128 sxsy = _mm_mul_ps(sx, sy);
+    __m128 cxsy = _mm_mul_ps(cx, sy);
+
+    __m128 r00 = _mm_mul_ps(cy, cz);
+    __m128 r01 = _mm_sub_ps(zero, _mm_mul_ps(cy, sz));
+    __m128 r02 = sy;
+    __m128 r10 = _mm_add_ps(_mm_mul_ps(cx, sz), _mm_mul_ps(sxsy, cz));
+    __m128 r11 = _mm_sub_ps(_mm_mul_ps(cx, cz), _mm_mul_ps(sxsy, sz));
+    __m128 r12 = _mm_sub_ps(zero, _mm_mul_ps(sx, cy));
+    __m128 r20 = _mm_sub_ps(_mm_mul_ps(sx, sz), _mm_mul_ps(cxsy, cz));
+    __m128 r21 = _mm_add_ps(_mm_mul_ps(sx, cz), _mm_mul_ps(cxsy, sz));
+    __m128 r22 = _mm_mul_ps(cx, cy);
+
+    StoreColumn(pDst, 0, _mm_mul_ps(r00, lanes.scale[0]), _mm_mul_ps(r10, lanes.scale[0]), _mm_mul_ps(r20, lanes.scale[0]), zero);
+    StoreColumn(pDst, 1, _mm_mul_ps(r01, lanes.scale[1]), _mm_mul_ps(r11, lanes.scale[1]), _mm_mul_ps(r21, lanes.scale[1]), zero);
+    StoreColumn(pDst, 2, _mm_mul_ps(r02, lanes.scale[2]), _mm_mul_ps(r12, lanes.scale[2]), _mm_mul_ps(r22, lanes.scale[2]), zero);
+    StoreColumn(pDst, 3, lanes.position[0], lanes.position[1], lanes.position[2], _mm_set1_ps(1.0f));
+
+    // ModelUniform::normalMatrix follows the world matrix, three padded columns.
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 inverseScale[3] = { _mm_div_ps(one, lanes.scale[0]), _mm_div_ps(one, lanes.scale[1]), _mm_div_ps(one, lanes.scale[2]) };
+
+    StoreColumn(pDst, 4, _mm_mul_ps(r00, inverseScale[0]), _mm_mul_ps(r10, inverseScale[0]), _mm_mul_ps(r20, inverseScale[0]), zero);
+    StoreColumn(pDst, 5, _mm_mul_ps(r01, inverseScale[1]), _mm_mul_ps(r11, inverseScale[1]), _mm_mul_ps(r21, inverseScale[1]), zero);
+    StoreColumn(pDst, 6, _mm_mul_ps(r02, inverseScale[2]), _mm_mul_ps(r12, inverseScale[2]), _mm_mul_ps(r22, inverseScale[2]), zero);
+}
+
+// Loads the transforms at index[0..3] into lanes, for batches that are not contiguous.
+TransformLanes GatherLanes(const TransformArray& array, const uint32_t index[4])
+{
+    Vec3 position[4];
+    Vec3 rotation[4];
+    Vec3 scale[4];
+
+    for (uint32_t k = 0; k < 4; k++) {
+        position[k] = array.GetPosition(index[k]);
+        rotation[k] = array.GetRotation(index[k]);
+        scale[k] = array.GetScale(index[k]);
+    }
+
+    TransformLanes lanes;
+    for (int c = 0; c < 3; c++) {
+        lanes.position[c] = _mm_setr_ps(position[0][c], position[1][c], position[2][c], position[3][c]);
+        lanes.rotation[c] = _mm_setr_ps(rotation[0][c], rotation[1][c], rotation[2][c], rotation[3][c]);
+        lanes.scale[c] = _mm_setr_ps(scale[0][c], scale[1][c], scale[2][c], scale[3][c]);
+    }
+
+    return lanes;
+}
+}
+
+uint32_t TransformArray::Add()
+{
+    if (!m_freeSlots.empty()) {
+        uint32_t index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        MarkDirty(index);
+        return index;
+    }
+
+    m_positionX.push_back(0.0f);
+    m_positionY.push_back(0.0f);
+    m_positionZ.push_back(0.0f);
+    m_rotationX.push_back(0.0f);
+    m_rotationY.push_back(0.0f);
+    m_rotationZ.push_back(0.0f);
+    m_scaleX.push_back(1.0f);
+    m_scaleY.push_back(1.0f);
+    m_scaleZ.push_back(1.0f);
+    m_dirtyFlags.push_back(0);
+
+    MarkDirty(GetCount() - 1);
+    return GetCount() - 1;
+}
+
+void TransformArray::Remove(uint32_t index)
+{
+    // A recycled slot starts out as identity, like a new one.
+    SetPosition(index, Vec3 { 0.0f });
+    SetRotation(index, Vec3 { 0.0f });
+    SetScale(index, Vec3 { 1.0f });
+    m_freeSlots.push_back(index);
+}
+
+void TransformArray::MarkDirty(uint32_t index)
+{
+    if (m_dirtyFlags[index] == 0) {
+        m_dirtyFlags[index] = 1;
+        m_dirtyIndices.push_back(index);
+    }
+}
+
+void TransformArray::ConsumeDirty(std::vector<uint32_t>& indices)
+{
+    for (uint32_t index : m_dirtyIndices) {
+        m_dirtyFlags[index] = 0;
+    }
+
+    indices.insert(indices.end(), m_dirtyIndices.begin(), m_dirtyIndices.end());
+    m_dirtyIndices.clear();
+}
+
+void TransformArray::SetPosition(uint32_t index, const Vec3& position)
+{
+    m_positionX[index] = position.x;
+    m_positionY[index] = position.y;
+    m_positionZ[index] = position.z;
+    MarkDirty(index);
+}
+
+void TransformArray::SetRotation(uint32_t index, const Vec3& rotation)
+{
+    m_rotationX[index] = rotation.x;
+    m_rotationY[index] = rotation.y;
+    m_rotationZ[index] = rotation.z;
+    MarkDirty(index);
+}
+
+void TransformArray::SetScale(uint32_t index, const Vec3& scale)
+{
+    m_scaleX[index] = scale.x;
+    m_scaleY[index] = scale.y;
+    m_scaleZ[index] = scale.z;
+    MarkDirty(index);
+}
+
+void TransformArray::ComputeWorldMatrices(uint32_t begin, uint32_t end, void* pDst, size_t stride) const
+{
+    uint8_t* pOut = static_cast<uint8_t*>(pDst);
+    uint32_t i = begin;
+
+    for (; i + 4 <= end; i += 4, pOut += 4 * stride) {
+        TransformLanes lanes;
+        lanes.position[0] = _mm_loadu_ps(&m_positionX[i]);
+        lanes.position[1] = _mm_loadu_ps(&m_positionY[i]);
+        lanes.position[2] = _mm_loadu_ps(&m_positionZ[i]);
+        lanes.rotation[0] = _mm_loadu_ps(&m_rotationX[i]);
+        lanes.rotation[1] = _mm_loadu_ps(&m_rotationY[i]);
+        lanes.rotation[2] = _mm_loadu_ps(&m_rotationZ[i]);
+        lanes.scale[0] = _mm_loadu_ps(&m_scaleX[i]);
+        lanes.scale[1] = _mm_loadu_ps(&m_scaleY[i]);
+        lanes.scale[2] = _mm_loadu_ps(&m_scaleZ[i]);
+
+        uint8_t* const pMatrices[4] = { pOut, pOut + stride, pOut + 2 * stride, pOut + 3 * stride };
+        StoreWorldMatrices(lanes, pMatrices);
+    }
+
+    if (i < end) {
+        // Fewer than four left, the missing lanes repeat the last transform and write its matrix twice.
+        uint32_t index[4];
+        uint8_t* pMatrices[4];
+        for (uint32_t k = 0; k < 4; k++) {
+            uint32_t lane = std::min(k, end - i - 1);
+            index[k] = i + lane;
+            pMatrices[k] = pOut + lane * stride;
+        }
+        StoreWorldMatrices(GatherLanes(*this, index), pMatrices);
+    }
+}
+
+void TransformArray::ComputeWorldMatricesAt(const uint32_t* pIndices, uint32_t count, void* pDst, size_t stride) const
+{
+    uint8_t* pOut = static_cast<uint8_t*>(pDst);
+
+    for (uint32_t i = 0; i < count; i += 4) {
+        uint32_t index[4];
+        uint8_t* pMatrices[4];
+        for (uint32_t k = 0; k < 4; k++) {
+            index[k] = pIndices[std::min(i + k, count - 1)];
+            pMatrices[k] = pOut + index[k] * stride;
+        }
+        StoreWorldMatrices(GatherLanes(*this, index), pMatrices);
+    }
+}
+
+TransformBenchmark TransformArray::Benchmark(uint32_t count)
+{
+    TransformBenchmark benchmark {};
+    benchmark.count = count;
+
+    TransformArray array;
+    std::vector<Transform*> transforms;
+
+    for (uint32_t i = 0; i < count; i++) {
+        Transform* transform = new Transform { &array };
+        transform->SetPosition(Vec3 { i % 97 * 0.5f, i % 31 * 0.25f, i % 13 * -1.0f });
+        transform->SetRotation(Vec3 { i * 7 % 720 - 360.0f, i * 13 % 1080 - 540.0f, i * 3 % 360 * 1.0f });
+        transform->SetScale(Vec3 { 1.0f + i % 5, 0.5f, 2.0f });
+        transforms.push_back(transform);
+    }
+
+    // Both paths build the world and the normal matrix, the SIMD one writes them as a ModelUniform.
+    std::vector<Mat4> reference(count);
+    std::vector<glm::mat3> referenceNormals(count);
+    std::vector<ModelUniform> batched(count);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++) {
+        reference[i] = transforms[i]->GetWorldMatrix();
+        referenceNormals[i] = glm::transpose(glm::inverse(glm::mat3(reference[i])));
+    }
+    benchmark.glmMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    array.ComputeWorldMatrices(0, count, batched.data(), sizeof(ModelUniform));
+    benchmark.simdMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    benchmark.speedup = benchmark.simdMs > 0.0f ? benchmark.glmMs / benchmark.simdMs : 0.0f;
+
+    for (uint32_t i = 0; i < count; i++) {
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                benchmark.maxError = std::max(benchmark.maxError, std::abs(reference[i][c][r] - batched[i].world[c][r]));
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            for (int r = 0; r < 3; r++) {
+                benchmark.maxError = std::max(benchmark.maxError, std::abs(referenceNormals[i][c][r] - batched[i].normalMatrix[c][r]));
+            }
+        }
+    }
+
+    for (Transform* transform : transforms) {
+        delete transform;
+    }
+
+    return benchmark;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "math_types.h"
+
+#include <cstdint>
+#include <vector>
+
+// Written by TransformArray::ComputeWorldMatrices whenever the transform changes.
+struct ModelUniform {
+    Mat4 world;
+    Vec4 normalMatrix[3]; // transpose(inverse(mat3(world))), a std430 mat3 pads its columns to vec4
+};
+
+struct TransformBenchmark {
+    uint32_t count;
+    float glmMs; // Transform::GetWorldMatrix and a glm normal matrix per object
+    float simdMs; // TransformArray::ComputeWorldMatrices on one thread
+    float speedup;
+    float maxError; // largest absolute difference between the two paths
+};
+
+/*
+ * Positions, rotations (Euler degrees) and scales of every transform, one array per component,
+ * so ComputeWorldMatrices can build the world matrices of four transforms per SSE iteration.
+ * Slots are recycled through a free list and never move, a slot index stays valid until Remove.
+ *
+ * Every setter marks its slot dirty. The renderer drains the dirty list once per frame, so only
+ * slots that changed get their matrix rebuilt and uploaded.
+ */
+class TransformArray {
+public:
+    TransformArray() = default;
+    ~TransformArray() = default;
+    TransformArray(const TransformArray&) = delete;
+    TransformArray(TransformArray&&) = delete;
+    TransformArray& operator=(const TransformArray&) = delete;
+    TransformArray& operator=(TransformArray&&) = delete;
+
+public:
+    uint32_t Add();
+    void Remove(uint32_t index);
+
+    // M = T * Rx * Ry * Rz * S, the same order Transform::GetWorldMatrix uses, followed by its normal matrix.
+    // The ModelUniform of transform i is written to pDst + (i - begin) * stride.
+    void ComputeWorldMatrices(uint32_t begin, uint32_t end, void* pDst, size_t stride) const;
+    // ModelUniform of slot pIndices[k] is written to pDst + pIndices[k] * stride.
+    void ComputeWorldMatricesAt(const uint32_t* pIndices, uint32_t count, void* pDst, size_t stride) const;
+
+    void MarkDirty(uint32_t index);
+    void ConsumeDirty(std::vector<uint32_t>& indices); // appends the dirty slots and clears them
+
+    static TransformBenchmark Benchmark(uint32_t count);
+
+public:
+    Vec3 GetPosition(uint32_t index) const { return Vec3 { m_positionX[index], m_positionY[index], m_positionZ[index] }; }
+    Vec3 GetRotation(uint32_t index) const { return Vec3 { m_rotationX[index], m_rotationY[index], m_rotationZ[index] }; }
+    Vec3 GetScale(uint32_t index) const { return Vec3 { m_scaleX[index], m_scaleY[index], m_scaleZ[index] }; }
+    void SetPosition(uint32_t index, const Vec3& position);
+    void SetRotation(uint32_t index, const Vec3& rotation);
+    void SetScale(uint32_t index, const Vec3& scale);
+
+public: // getter
+    uint32_t GetCount() const { return static_cast<uint32_t>(m_positionX.size()); } // slots, including free ones
+
+private:
+    std::vector<float> m_positionX;
+    std::vector<float> m_positionY;
+    std::vector<float> m_positionZ;
+    std::vector<float> m_rotationX;
+    std::vector<float> m_rotationY;
+    std::vector<float> m_rotationZ;
+    std::vector<float> m_scaleX;
+    std::vector<float> m_scaleY;
+    std::vector<float> m_scaleZ;
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<uint8_t> m_dirtyFlags;
+    std::vector<uint32_t> m_dirtyIndices;
+};
@@ -0,0 +1,158 @@
+#include "pch.h"
+#include "vk_bindless_table.h"
+#include "vk_device.h"
+
+BindlessTable::BindlessTable(const Device* pDevice)
+    : p_device { pDevice }
+{
+    CreateLayout();
+    CreateDescriptorSet();
+}
+
+BindlessTable::~BindlessTable()
+{
+    vkDestroyDescriptorPool(p_device->GetDevice(), m_pool, nullptr);
+    vkDestroyDescriptorSetLayout(p_device->GetDevice(), m_layout, nullptr);
+}
+
+uint32_t BindlessTable::AddTexture(VkImageView imageView)
+{
+    if (m_textureCount == m_textureCapacity) {
+        throw std::runtime_error("bindless texture table is full!");
+    }
+
+    VkDescriptorImageInfo imageInfo {};
+    {
+        imageInfo.imageView = imageView;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    QueueWrite(TEXTURE_BINDING, m_textureCount, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageInfo);
+
+    return m_textureCount++;
+}
+
+uint32_t BindlessTable::AddSampler(VkSampler sampler)
+{
+    if (m_samplerCount == m_samplerCapacity) {
+        throw std::runtime_error("bindless sampler table is full!");
+    }
+
+    VkDescriptorImageInfo imageInfo {};
+    {
+        imageInfo.sampler = sampler;
+    }
+
+    QueueWrite(SAMPLER_BINDING, m_samplerCount, VK_DESCRIPTOR_TYPE_SAMPLER, imageInfo);
+
+    return m_samplerCount++;
+}
+
+void BindlessTable::CreateLayout()
+{
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProperties { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES };
+    VkPhysicalDeviceProperties2 properties { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+    {
+        properties.pNext = &indexingProperties;
+    }
+    vkGetPhysicalDeviceProperties2(p_device->GetPhysicalDevice(), &properties);
+
+    m_textureCapacity = std::min<uint32_t>({ MAX_TEXTURES, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages });
+    m_samplerCapacity = std::min<uint32_t>({ MAX_SAMPLERS, indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers, indexingProperties.maxDescriptorSetUpdateAfterBindSamplers });
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings {};
+    {
+        bindings[0].binding = TEXTURE_BINDING;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        bindings[0].descriptorCount = m_textureCapacity;
+        bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        bindings[1].binding = SAMPLER_BINDING;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+        bindings[1].descriptorCount = m_samplerCapacity;
+        bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+
+    // Slots past the last added entry stay unwritten, the shaders never index them.
+    VkDescriptorBindingFlags bindingFlag = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    std::array<VkDescriptorBindingFlags, 2> bindingFlags { bindingFlag, bindingFlag };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+    {
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+    }
+
+    VkDescriptorSetLayoutCreateInfo createInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    {
+        createInfo.pNext = &bindingFlagsInfo;
+        createInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        createInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        createInfo.pBindings = bindings.data();
+    }
+
+    VkResult result = vkCreateDescriptorSetLayout(p_device->GetDevice(), &createInfo, nullptr, &m_layout);
+    CHECK_VK(result);
+}
+
+void BindlessTable::CreateDescriptorSet()
+{
+    std::array<VkDescriptorPoolSize, 2> poolSizes {};
+    {
+        poolSizes[0] = { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, m_textureCapacity };
+        poolSizes[1] = { VK_DESCRIPTOR_TYPE_SAMPLER, m_samplerCapacity };
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+    {
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = 1;
+    }
+
+    VkResult result = vkCreateDescriptorPool(p_device->GetDevice(), &poolInfo, nullptr, &m_pool);
+    CHECK_VK(result);
+
+    VkDescriptorSetAllocateInfo allocInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+    {
+        allocInfo.descriptorPool = m_pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_layout;
+    }
+
+    result = vkAllocateDescriptorSets(p_device->GetDevice(), &allocInfo, &m_descriptorSet);
+    CHECK_VK(result);
+}
+
+void BindlessTable::Flush()
+{
+    if (m_pendingWrites.empty()) {
+        return;
+    }
+
+    // The info array may have grown since a write was queued, pointers are only taken now.
+    for (size_t i = 0; i < m_pendingWrites.size(); i++) {
+        m_pendingWrites[i].pImageInfo = &m_pendingInfos[i];
+    }
+
+    vkUpdateDescriptorSets(p_device->GetDevice(), static_cast<uint32_t>(m_pendingWrites.size()), m_pendingWrites.data(), 0, nullptr);
+
+    m_pendingWrites.clear();
+    m_pendingInfos.clear();
+}
+
+void BindlessTable::QueueWrite(uint32_t binding, uint32_t index, VkDescriptorType type, const VkDescriptorImageInfo& imageInfo)
+{
+    VkWriteDescriptorSet write { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    {
+        write.dstSet = m_descriptorSet;
+        write.dstBinding = binding;
+        write.dstArrayElement = index;
+        write.descriptorType = type;
+        write.descriptorCount = 1;
+    }
+
+    m_pendingWrites.push_back(write);
+    m_pendingInfos.push_back(imageInfo);
+}
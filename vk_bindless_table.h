@@ -0,0 +1,55 @@
+#pragma once
+
+class Device;
+
+/*
+ * One descriptor set for every texture and sampler of the device (set 2 of the pipelines).
+ * Materials store indices into the two arrays, so draws with different textures share one bind.
+ * Bindings are partially bound and update-after-bind, a new entry can be written while frames
+ * that never read it are still in flight. Entries added during a load are written together by Flush.
+ */
+class BindlessTable {
+public:
+    BindlessTable(const Device*);
+    ~BindlessTable();
+    BindlessTable(const BindlessTable&) = delete;
+    BindlessTable(BindlessTable&&) = delete;
+    BindlessTable& operator=(const BindlessTable&) = delete;
+    BindlessTable& operator=(BindlessTable&&) = delete;
+
+public:
+    uint32_t AddTexture(VkImageView); // expects VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, returns the texture index
+    uint32_t AddSampler(VkSampler); // returns the sampler index
+    void Flush(); // one vkUpdateDescriptorSets for every entry added since the last call, before recording draws that use them
+
+public: // getter
+    VkDescriptorSetLayout GetDescriptorSetLayout() const { return m_layout; }
+    VkDescriptorSet GetDescriptorSet() const { return m_descriptorSet; }
+    uint32_t GetTextureCount() const { return m_textureCount; }
+    uint32_t GetSamplerCount() const { return m_samplerCount; }
+    uint32_t GetTextureCapacity() const { return m_textureCapacity; }
+
+private:
+    void CreateLayout();
+    void CreateDescriptorSet();
+    void QueueWrite(uint32_t binding, uint32_t index, VkDescriptorType, const VkDescriptorImageInfo&);
+
+private:
+    const Device* p_device;
+
+private:
+    enum { TEXTURE_BINDING = 0 };
+    enum { SAMPLER_BINDING = 1 };
+    enum { MAX_TEXTURES = 4096 }; // lowered to the device's update-after-bind limit
+    enum { MAX_SAMPLERS = 32 };
+
+    VkDescriptorSetLayout m_layout;
+    VkDescriptorPool m_pool;
+    VkDescriptorSet m_descriptorSet;
+    uint32_t m_textureCapacity { 0 };
+    uint32_t m_samplerCapacity { 0 };
+    uint32_t m_textureCount { 0 };
+    uint32_t m_samplerCount { 0 };
+    std::vector<VkWriteDescriptorSet> m_pendingWrites;
+    std::vector<VkDescriptorImageInfo> m_pendingInfos; // parallel to m_pendingWrites, linked up in Flush
+};
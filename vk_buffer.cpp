@@ -1,8 +1,7 @@
 #include "pch.h"
 #include "vk_buffer.h"
 #include "vk_device.h"
-#include "vk_command_pool.h"
-#include "vk_command_buffer.h"
+#include "vk_upload_context.h"
 #include "query.h"
 
 Buffer::Buffer(const Device* pDevice, VkBufferCreateInfo createInfo, VkMemoryPropertyFlags memoryPropertyFlags)
@@ -25,39 +24,38 @@ void Buffer::CreateBuffer(VkBufferCreateInfo createInfo, VkMemoryPropertyFlags m
     VkMemoryRequirements memRequirements {};
     vkGetBufferMemoryRequirements(p_device->GetDevice(), m_buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo {};
-    {
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = p_device->FindMemoryType(memRequirements.memoryTypeBits, memoryPropertyFlags);
-    }
+    m_allocation = p_device->GetAllocator()->Allocate(memRequirements, memoryPropertyFlags, ResourceKind::Linear);
 
-    result = vkAllocateMemory(p_device->GetDevice(), &allocInfo, nullptr, &m_deviceMemory);
+    result = vkBindBufferMemory(p_device->GetDevice(), m_buffer, m_allocation.memory, m_allocation.offset);
     CHECK_VK(result);
 
-    result = vkBindBufferMemory(p_device->GetDevice(), m_buffer, m_deviceMemory, 0);
-    CHECK_VK(result);
+    m_coherent = (m_allocation.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    m_atomSize = p_device->GetAllocator()->GetNonCoherentAtomSize();
 }
 
 void Buffer::MapMemory(void)
 {
-    vkMapMemory(p_device->GetDevice(), m_deviceMemory, 0, m_size, 0, &p_host);
+    p_host = p_device->GetAllocator()->Map(m_allocation);
 }
 
 void Buffer::UnmapMemory(void)
 {
-    vkUnmapMemory(p_device->GetDevice(), m_deviceMemory);
+    p_device->GetAllocator()->Unmap(m_allocation);
     p_host = nullptr;
 }
 
 void Buffer::InvalidateMappedMemory(void)
 {
-    VkMappedMemoryRange mappedMemoryRange {};
+    // Only needed before reading back device writes, coherent memory never needs it.
+    if (m_coherent) {
+        return;
+    }
+
+    VkMappedMemoryRange mappedMemoryRange { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
     {
-        mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedMemoryRange.memory = m_deviceMemory;
-        mappedMemoryRange.offset = 0;
-        mappedMemoryRange.size = m_size;
+        mappedMemoryRange.memory = m_allocation.memory;
+        mappedMemoryRange.offset = m_allocation.offset;
+        mappedMemoryRange.size = GetMappedRangeSize();
     }
 
     VkResult result = vkInvalidateMappedMemoryRanges(p_device->GetDevice(), 1, &mappedMemoryRange);
@@ -66,29 +64,69 @@ void Buffer::InvalidateMappedMemory(void)
 
 void Buffer::FlushMappedMemory(void)
 {
-    VkMappedMemoryRange mappedMemoryRange {};
-    {
-        mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedMemoryRange.memory = m_deviceMemory;
-        mappedMemoryRange.offset = 0;
-        mappedMemoryRange.size = m_size;
+    std::vector<VkMappedMemoryRange> ranges;
+    CollectDirtyRanges(ranges);
+
+    if (ranges.empty()) {
+        return;
     }
 
-    VkResult result = vkFlushMappedMemoryRanges(p_device->GetDevice(), 1, &mappedMemoryRange);
+    VkResult result = vkFlushMappedMemoryRanges(p_device->GetDevice(), static_cast<uint32_t>(ranges.size()), ranges.data());
     CHECK_VK(result);
 }
 
-void Buffer::Copy(VkBuffer srcBuffer)
+void Buffer::MarkDirty(VkDeviceSize offset, VkDeviceSize size)
 {
-    CommandBuffer commandBuffer = BeginSingleTimeCommand();
+    if (m_coherent || size == 0) {
+        return;
+    }
+
+    // Flushed ranges must start and end on nonCoherentAtomSize, the allocation offset already does.
+    VkDeviceSize begin = m_allocation.offset + (offset & ~(m_atomSize - 1));
+    VkDeviceSize end = m_allocation.offset + ((offset + size + m_atomSize - 1) & ~(m_atomSize - 1));
+
+    if (!m_dirtyRanges.empty()) {
+        VkMappedMemoryRange& last = m_dirtyRanges.back();
+
+        if (begin <= last.offset + last.size && end >= last.offset) {
+            VkDeviceSize lastEnd = last.offset + last.size;
+            last.offset = std::min(last.offset, begin);
+            last.size = std::max(lastEnd, end) - last.offset;
+            return;
+        }
+    }
 
-    VkBufferCopy copyRegion {};
+    VkMappedMemoryRange range { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
     {
-        copyRegion.srcOffset = 0;
-        copyRegion.dstOffset = 0;
-        copyRegion.size = m_size;
+        range.memory = m_allocation.memory;
+        range.offset = begin;
+        range.size = end - begin;
     }
 
-    vkCmdCopyBuffer(commandBuffer.GetHandle(), srcBuffer, m_buffer, 1, &copyRegion);
-    EndSingleTimeCommand(commandBuffer);
-}
\ No newline at end of file
+    m_dirtyRanges.push_back(range);
+}
+
+void Buffer::CollectDirtyRanges(std::vector<VkMappedMemoryRange>& ranges)
+{
+    for (VkMappedMemoryRange& range : m_dirtyRanges) {
+        // Rounding up may run past a dedicated allocation, which is only valid as VK_WHOLE_SIZE.
+        if (m_allocation.p_block == nullptr && range.offset + range.size > m_allocation.size) {
+            range.size = VK_WHOLE_SIZE;
+        }
+        ranges.push_back(range);
+    }
+
+    m_dirtyRanges.clear();
+}
+
+VkDeviceSize Buffer::GetMappedRangeSize(void) const
+{
+    // Sub-allocated nodes are nonCoherentAtomSize aligned; a dedicated allocation owns the whole memory.
+    return m_allocation.p_block != nullptr ? m_allocation.size : VK_WHOLE_SIZE;
+}
+
+void Buffer::Upload(const void* pData, VkDeviceSize size)
+{
+    // Recorded into the current upload batch, the copy lands before the next frame is submitted.
+    p_device->GetUploadContext()->UploadBuffer(m_buffer, 0, pData, size);
+}
@@ -18,17 +18,24 @@ public:
     void UnmapMemory(void);
     void InvalidateMappedMemory(void);
     void FlushMappedMemory(void);
-    void Copy(VkBuffer);
+    void MarkDirty(VkDeviceSize offset, VkDeviceSize size);
+    void CollectDirtyRanges(std::vector<VkMappedMemoryRange>&);
+    void Upload(const void* pData, VkDeviceSize size);
 
 public: // getter
     VkBuffer GetBuffer() { return m_buffer; }
     void* GetMappedPtr() { return p_host; }
+    bool IsCoherent() const { return m_coherent; }
 
 private:
     void CreateBuffer(VkBufferCreateInfo, VkMemoryPropertyFlags);
+    VkDeviceSize GetMappedRangeSize(void) const;
 
 private:
     VkDeviceSize m_size;
     VkBuffer m_buffer;
     void* p_host;
+    bool m_coherent;
+    VkDeviceSize m_atomSize;
+    std::vector<VkMappedMemoryRange> m_dirtyRanges;
 };
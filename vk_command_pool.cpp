@@ -6,7 +6,13 @@
 CommandPool::CommandPool(const Device* pDevice)
     : p_device { pDevice }
 {
-    CreatePool();
+    CreatePool(p_device->GetQueueFamilyIndices().graphicsFamily);
+}
+
+CommandPool::CommandPool(const Device* pDevice, uint32_t queueFamilyIndex)
+    : p_device { pDevice }
+{
+    CreatePool(queueFamilyIndex);
 }
 
 CommandPool::~CommandPool()
@@ -15,7 +21,7 @@ CommandPool::~CommandPool()
     vkDestroyCommandPool(p_device->GetDevice(), m_pool, nullptr);
 }
 
-CommandBuffer CommandPool::AllocateCommandBuffer()
+CommandBuffer CommandPool::AllocateCommandBuffer(VkCommandBufferLevel level)
 {
     VkCommandBuffer commandBuffer;
 
@@ -23,7 +29,7 @@ CommandBuffer CommandPool::AllocateCommandBuffer()
     {
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         allocInfo.commandPool = m_pool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.level = level;
         allocInfo.commandBufferCount = 1;
     }
 
@@ -38,13 +44,19 @@ void CommandPool::FreeCommandBuffer(CommandBuffer& commandBuffer)
     vkFreeCommandBuffers(p_device->GetDevice(), m_pool, 1, commandBuffer.GetPtr());
 }
 
-void CommandPool::CreatePool()
+void CommandPool::Reset()
+{
+    VkResult result = vkResetCommandPool(p_device->GetDevice(), m_pool, 0);
+    CHECK_VK(result);
+}
+
+void CommandPool::CreatePool(uint32_t queueFamilyIndex)
 {
     VkCommandPoolCreateInfo poolInfo {};
     {
         poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
         poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        poolInfo.queueFamilyIndex = p_device->GetQueueFamilyIndices().graphicsFamily;
+        poolInfo.queueFamilyIndex = queueFamilyIndex;
     }
 
     VkResult result = vkCreateCommandPool(p_device->GetDevice(), &poolInfo, nullptr, &m_pool);
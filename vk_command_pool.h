@@ -6,6 +6,7 @@ class CommandBuffer;
 class CommandPool {
 public:
     CommandPool(const Device*);
+    CommandPool(const Device*, uint32_t queueFamilyIndex);
     ~CommandPool();
     CommandPool(const CommandPool&) = delete;
     CommandPool(CommandPool&&) = delete;
@@ -13,14 +14,15 @@ public:
     CommandPool& operator=(CommandPool&&) = delete;
 
 public:
-    CommandBuffer AllocateCommandBuffer();
+    CommandBuffer AllocateCommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
     void FreeCommandBuffer(CommandBuffer&);
+    void Reset(); // recycles every command buffer of the pool at once
 
 public: // getter
     VkCommandPool GetPool() { return m_pool; }
 
 private:
-    void CreatePool();
+    void CreatePool(uint32_t queueFamilyIndex);
 
 private:
     const Device* p_device;
@@ -0,0 +1,68 @@
+#include "pch.h"
+#include "vk_compute_pipeline.h"
+#include "vk_device.h"
+#include "shader.h"
+#include "vk_descriptor_update_template.h"
+#include "vk_pipeline_cache.h"
+
+ComputePipeline::ComputePipeline(const Device* pDevice, const std::string& shaderPath, const std::vector<VkDescriptorSetLayoutBinding>& bindings, uint32_t pushConstantSize)
+    : p_device { pDevice }
+{
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    {
+        descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        descriptorSetLayoutInfo.pBindings = bindings.data();
+    }
+
+    VkResult result = vkCreateDescriptorSetLayout(p_device->GetDevice(), &descriptorSetLayoutInfo, nullptr, &m_descriptorSetLayout);
+    CHECK_VK(result);
+
+    p_updateTemplate = new DescriptorUpdateTemplate { p_device, m_descriptorSetLayout, bindings };
+
+    VkPushConstantRange pushConstant {};
+    {
+        pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstant.offset = 0;
+        pushConstant.size = pushConstantSize;
+    }
+
+    VkPipelineLayoutCreateInfo layoutInfo { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+    {
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        layoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+        layoutInfo.pPushConstantRanges = &pushConstant;
+    }
+
+    result = vkCreatePipelineLayout(p_device->GetDevice(), &layoutInfo, nullptr, &m_layout);
+    CHECK_VK(result);
+
+    VkShaderModule shader;
+    Shader::CreateModule(p_device->GetDevice(), shaderPath, &shader);
+
+    VkComputePipelineCreateInfo createInfo { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+    {
+        createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        createInfo.stage.module = shader;
+        createInfo.stage.pName = "main";
+        createInfo.layout = m_layout;
+    }
+
+    PipelineCache* pCache = p_device->GetPipelineCache();
+
+    auto start = std::chrono::steady_clock::now();
+    result = vkCreateComputePipelines(p_device->GetDevice(), pCache->GetCache(), 1, &createInfo, nullptr, &m_pipeline);
+    CHECK_VK(result);
+    pCache->RecordCreation(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    vkDestroyShaderModule(p_device->GetDevice(), shader, nullptr);
+}
+
+ComputePipeline::~ComputePipeline()
+{
+    vkDestroyPipeline(p_device->GetDevice(), m_pipeline, nullptr);
+    vkDestroyPipelineLayout(p_device->GetDevice(), m_layout, nullptr);
+    delete p_updateTemplate;
+    vkDestroyDescriptorSetLayout(p_device->GetDevice(), m_descriptorSetLayout, nullptr);
+}
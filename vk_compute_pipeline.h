@@ -0,0 +1,32 @@
+#pragma once
+
+class Device;
+class DescriptorUpdateTemplate;
+
+/*
+ * A compute shader with its own descriptor set layout (set 0) and an optional push constant block.
+ */
+class ComputePipeline {
+public:
+    ComputePipeline(const Device*, const std::string& shaderPath, const std::vector<VkDescriptorSetLayoutBinding>&, uint32_t pushConstantSize);
+    ~ComputePipeline();
+    ComputePipeline(const ComputePipeline&) = delete;
+    ComputePipeline(ComputePipeline&&) = delete;
+    ComputePipeline& operator=(const ComputePipeline&) = delete;
+    ComputePipeline& operator=(ComputePipeline&&) = delete;
+
+public: // getter
+    VkDescriptorSetLayout GetDescriptorSetLayout() const { return m_descriptorSetLayout; }
+    const DescriptorUpdateTemplate* GetUpdateTemplate() const { return p_updateTemplate; }
+    VkPipelineLayout GetPipelineLayout() const { return m_layout; }
+    VkPipeline GetPipeline() const { return m_pipeline; }
+
+private:
+    const Device* p_device;
+
+private:
+    VkDescriptorSetLayout m_descriptorSetLayout;
+    DescriptorUpdateTemplate* p_updateTemplate;
+    VkPipelineLayout m_layout;
+    VkPipeline m_pipeline;
+};
@@ -0,0 +1,158 @@
+#include "pch.h"
+#include "vk_deletion_queue.h"
+#include "vk_device.h"
+#include "vk_resource.h"
+
+DeletionQueue::DeletionQueue(const Device* pDevice)
+    : p_device { pDevice }
+{
+}
+
+DeletionQueue::~DeletionQueue()
+{
+    Flush();
+}
+
+void DeletionQueue::Push(const Allocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    Entry entry {};
+    entry.type = VK_OBJECT_TYPE_DEVICE_MEMORY;
+    entry.allocation = allocation;
+    entry.bytes = allocation.size;
+    Push(entry);
+}
+
+void DeletionQueue::Push(Resource* pResource)
+{
+    Entry entry {};
+    entry.type = VK_OBJECT_TYPE_UNKNOWN;
+    entry.p_resource = pResource;
+    entry.bytes = pResource->GetAllocation().size;
+    Push(entry);
+}
+
+void DeletionQueue::Push(std::function<void()> callback)
+{
+    Entry entry {};
+    entry.type = VK_OBJECT_TYPE_UNKNOWN;
+    entry.callback = std::move(callback);
+    Push(entry);
+}
+
+void DeletionQueue::SetFrame(uint64_t frameNumber)
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    m_frameNumber = frameNumber;
+}
+
+void DeletionQueue::Collect(uint64_t completedFrame)
+{
+    std::deque<Entry> retired;
+
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+
+        // Frame numbers only grow, so the queue is ordered by frame.
+        while (!m_entries.empty() && m_entries.front().frame <= completedFrame) {
+            m_pendingBytes -= m_entries.front().bytes;
+            retired.push_back(std::move(m_entries.front()));
+            m_entries.pop_front();
+        }
+    }
+
+    // Destroying a resource may push more entries, so run it outside the lock.
+    for (Entry& entry : retired) {
+        Destroy(entry);
+    }
+}
+
+void DeletionQueue::Flush(void)
+{
+    // Only valid once the device is idle.
+    Collect(UINT64_MAX);
+
+    std::lock_guard<std::mutex> lock { m_mutex };
+    assert(m_entries.empty());
+}
+
+DeletionStats DeletionQueue::GetStats() const
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    DeletionStats stats {};
+    stats.pendingCount = static_cast<uint32_t>(m_entries.size());
+    stats.pendingBytes = m_pendingBytes;
+
+    return stats;
+}
+
+void DeletionQueue::Push(Entry& entry)
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    entry.frame = m_frameNumber;
+    m_pendingBytes += entry.bytes;
+    m_entries.push_back(std::move(entry));
+}
+
+void DeletionQueue::Destroy(Entry& entry)
+{
+    VkDevice device = p_device->GetDevice();
+
+    if (entry.p_resource != nullptr) {
+        delete entry.p_resource;
+        return;
+    }
+
+    if (entry.callback) {
+        entry.callback();
+        return;
+    }
+
+    switch (entry.type) {
+    case VK_OBJECT_TYPE_DEVICE_MEMORY:
+        p_device->GetAllocator()->Free(entry.allocation);
+        break;
+    case VK_OBJECT_TYPE_BUFFER:
+        vkDestroyBuffer(device, reinterpret_cast<VkBuffer>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_IMAGE:
+        vkDestroyImage(device, reinterpret_cast<VkImage>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_IMAGE_VIEW:
+        vkDestroyImageView(device, reinterpret_cast<VkImageView>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_SAMPLER:
+        vkDestroySampler(device, reinterpret_cast<VkSampler>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_FRAMEBUFFER:
+        vkDestroyFramebuffer(device, reinterpret_cast<VkFramebuffer>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_RENDER_PASS:
+        vkDestroyRenderPass(device, reinterpret_cast<VkRenderPass>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_PIPELINE:
+        vkDestroyPipeline(device, reinterpret_cast<VkPipeline>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+        vkDestroyPipelineLayout(device, reinterpret_cast<VkPipelineLayout>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_DESCRIPTOR_POOL:
+        vkDestroyDescriptorPool(device, reinterpret_cast<VkDescriptorPool>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_SHADER_MODULE:
+        vkDestroyShaderModule(device, reinterpret_cast<VkShaderModule>(entry.handle), nullptr);
+        break;
+    case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+        vkDestroySwapchainKHR(device, reinterpret_cast<VkSwapchainKHR>(entry.handle), nullptr);
+        break;
+    default:
+        assert(false && "unsupported object type in deletion queue");
+        break;
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "vk_memory_allocator.h"
+
+class Device;
+class Resource;
+
+struct DeletionStats {
+    uint32_t pendingCount;
+    VkDeviceSize pendingBytes;
+};
+
+/*
+ * Holds objects until the frame that may still use them has retired.
+ * Entries are tagged with the frame being recorded when they are pushed, the renderer reports which
+ * frame's inFlightFence signaled last, and everything up to that frame is destroyed.
+ */
+class DeletionQueue {
+public:
+    DeletionQueue(const Device*);
+    ~DeletionQueue();
+    DeletionQueue(const DeletionQueue&) = delete;
+    DeletionQueue(DeletionQueue&&) = delete;
+    DeletionQueue& operator=(const DeletionQueue&) = delete;
+    DeletionQueue& operator=(DeletionQueue&&) = delete;
+
+public:
+    template <typename T>
+    void Push(VkObjectType type, T handle)
+    {
+        Entry entry {};
+        entry.type = type;
+        entry.handle = reinterpret_cast<uint64_t>(handle);
+        Push(entry);
+    }
+
+    void Push(const Allocation&);
+    void Push(Resource*);
+    void Push(std::function<void()>);
+
+    void SetFrame(uint64_t frameNumber);
+    void Collect(uint64_t completedFrame);
+    void Flush(void);
+
+public: // getter
+    DeletionStats GetStats() const;
+
+private:
+    struct Entry {
+        uint64_t frame;
+        VkObjectType type;
+        uint64_t handle;
+        Allocation allocation;
+        Resource* p_resource;
+        std::function<void()> callback;
+        VkDeviceSize bytes;
+    };
+
+private:
+    void Push(Entry&);
+    void Destroy(Entry&);
+
+private:
+    const Device* p_device;
+
+private:
+    uint64_t m_frameNumber { 0 };
+    std::deque<Entry> m_entries;
+    VkDeviceSize m_pendingBytes { 0 };
+    mutable std::mutex m_mutex;
+};
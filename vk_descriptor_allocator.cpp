@@ -0,0 +1,122 @@
+#include "pch.h"
+#include "vk_descriptor_allocator.h"
+#include "vk_device.h"
+
+DescriptorAllocator::DescriptorAllocator(const Device* pDevice, const std::vector<PoolSizeRatio>& ratios, uint32_t initialSetsPerPool)
+    : p_device { pDevice }
+    , m_ratios { ratios }
+    , m_setsPerPool { initialSetsPerPool }
+{
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+    for (VkDescriptorPool pool : m_fullPools) {
+        vkDestroyDescriptorPool(p_device->GetDevice(), pool, nullptr);
+    }
+    for (VkDescriptorPool pool : m_readyPools) {
+        vkDestroyDescriptorPool(p_device->GetDevice(), pool, nullptr);
+    }
+    if (m_currentPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(p_device->GetDevice(), m_currentPool, nullptr);
+    }
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout)
+{
+    if (m_currentPool == VK_NULL_HANDLE) {
+        m_currentPool = AcquirePool();
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+    {
+        allocInfo.descriptorPool = m_currentPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+    }
+
+    VkDescriptorSet descriptorSet;
+    VkResult result = vkAllocateDescriptorSets(p_device->GetDevice(), &allocInfo, &descriptorSet);
+
+    // An exhausted pool is retired until the next Reset, the set is retried once on a fresh pool.
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        m_fullPools.push_back(m_currentPool);
+        m_currentPool = AcquirePool();
+        allocInfo.descriptorPool = m_currentPool;
+
+        result = vkAllocateDescriptorSets(p_device->GetDevice(), &allocInfo, &descriptorSet);
+    }
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+
+    m_allocatedSets++;
+
+    return descriptorSet;
+}
+
+void DescriptorAllocator::Reset()
+{
+    if (m_allocatedSets == 0) {
+        return;
+    }
+
+    if (m_currentPool != VK_NULL_HANDLE) {
+        m_fullPools.push_back(m_currentPool);
+        m_currentPool = VK_NULL_HANDLE;
+    }
+
+    for (VkDescriptorPool pool : m_fullPools) {
+        vkResetDescriptorPool(p_device->GetDevice(), pool, 0);
+        m_readyPools.push_back(pool);
+    }
+    m_fullPools.clear();
+    m_allocatedSets = 0;
+}
+
+DescriptorAllocatorStats DescriptorAllocator::GetStats() const
+{
+    DescriptorAllocatorStats stats {};
+    stats.poolCount = static_cast<uint32_t>(m_fullPools.size() + m_readyPools.size()) + (m_currentPool != VK_NULL_HANDLE ? 1 : 0);
+    stats.allocatedSets = m_allocatedSets;
+
+    return stats;
+}
+
+VkDescriptorPool DescriptorAllocator::AcquirePool()
+{
+    if (!m_readyPools.empty()) {
+        VkDescriptorPool pool = m_readyPools.back();
+        m_readyPools.pop_back();
+        return pool;
+    }
+
+    // Every new pool is half again as large, a growing scene needs few of them.
+    VkDescriptorPool pool = CreatePool(m_setsPerPool);
+    m_setsPerPool = std::min(m_setsPerPool + std::max(1u, m_setsPerPool / 2), static_cast<uint32_t>(MAX_SETS_PER_POOL));
+
+    return pool;
+}
+
+VkDescriptorPool DescriptorAllocator::CreatePool(uint32_t setCount)
+{
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (const PoolSizeRatio& ratio : m_ratios) {
+        uint32_t count = std::max(1u, static_cast<uint32_t>(ratio.ratio * setCount));
+        poolSizes.push_back(VkDescriptorPoolSize { ratio.type, count });
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+    {
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = setCount;
+    }
+
+    VkDescriptorPool pool;
+    VkResult result = vkCreateDescriptorPool(p_device->GetDevice(), &poolInfo, nullptr, &pool);
+    CHECK_VK(result);
+
+    return pool;
+}
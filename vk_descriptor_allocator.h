@@ -0,0 +1,53 @@
+#pragma once
+
+class Device;
+
+// Descriptors of one type per set, pool sizes are ratio * the pool's set count.
+struct PoolSizeRatio {
+    VkDescriptorType type;
+    float ratio;
+};
+
+struct DescriptorAllocatorStats {
+    uint32_t poolCount; // including pools waiting for reuse
+    uint32_t allocatedSets; // since the last Reset
+};
+
+/*
+ * Chain of descriptor pools that grows instead of failing. Sets come from the current pool until it runs
+ * out, then a recycled pool or a new, larger one takes over. Sets are never freed one by one,
+ * Reset returns every pool with vkResetDescriptorPool, which suits descriptors rebuilt every frame.
+ */
+class DescriptorAllocator {
+public:
+    DescriptorAllocator(const Device*, const std::vector<PoolSizeRatio>&, uint32_t initialSetsPerPool);
+    ~DescriptorAllocator();
+    DescriptorAllocator(const DescriptorAllocator&) = delete;
+    DescriptorAllocator(DescriptorAllocator&&) = delete;
+    DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+    DescriptorAllocator& operator=(DescriptorAllocator&&) = delete;
+
+public:
+    VkDescriptorSet Allocate(VkDescriptorSetLayout);
+    void Reset(); // every set allocated so far becomes invalid
+
+public: // getter
+    DescriptorAllocatorStats GetStats() const;
+
+private:
+    VkDescriptorPool AcquirePool();
+    VkDescriptorPool CreatePool(uint32_t setCount);
+
+private:
+    const Device* p_device;
+
+private:
+    enum { MAX_SETS_PER_POOL = 4096 };
+
+    std::vector<PoolSizeRatio> m_ratios;
+    std::vector<VkDescriptorPool> m_fullPools;
+    std::vector<VkDescriptorPool> m_readyPools; // reset, or never used
+    VkDescriptorPool m_currentPool { VK_NULL_HANDLE };
+    uint32_t m_setsPerPool;
+    uint32_t m_allocatedSets { 0 };
+};
@@ -24,7 +24,11 @@ VkDescriptorSet DescriptorPool::AllocateDescriptorSet(const VkDescriptorSetLayou
     }
 
     VkDescriptorSet descriptorSet;
-    vkAllocateDescriptorSets(p_device->GetDevice(), &allocInfo, &descriptorSet);
+    VkResult result = vkAllocateDescriptorSets(p_device->GetDevice(), &allocInfo, &descriptorSet);
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
 
     return descriptorSet;
 }
@@ -0,0 +1,147 @@
+#include "pch.h"
+#include "vk_descriptor_update_template.h"
+#include "vk_device.h"
+#include "vk_descriptor_allocator.h"
+
+DescriptorUpdateTemplate::DescriptorUpdateTemplate(const Device* pDevice, VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+    : p_device { pDevice }
+{
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+
+    for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+        VkDescriptorUpdateTemplateEntry entry {};
+        {
+            entry.dstBinding = binding.binding;
+            entry.dstArrayElement = 0;
+            entry.descriptorCount = binding.descriptorCount;
+            entry.descriptorType = binding.descriptorType;
+            entry.offset = sizeof(DescriptorInfo) * m_descriptorCount;
+            entry.stride = sizeof(DescriptorInfo);
+        }
+
+        entries.push_back(entry);
+        m_descriptorCount += binding.descriptorCount;
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo createInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO };
+    {
+        createInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+        createInfo.pDescriptorUpdateEntries = entries.data();
+        createInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        createInfo.descriptorSetLayout = layout;
+    }
+
+    VkResult result = vkCreateDescriptorUpdateTemplate(p_device->GetDevice(), &createInfo, nullptr, &m_template);
+    CHECK_VK(result);
+}
+
+DescriptorUpdateTemplate::~DescriptorUpdateTemplate()
+{
+    vkDestroyDescriptorUpdateTemplate(p_device->GetDevice(), m_template, nullptr);
+}
+
+void DescriptorUpdateTemplate::Update(VkDescriptorSet descriptorSet, const DescriptorInfo* pInfos) const
+{
+    vkUpdateDescriptorSetWithTemplate(p_device->GetDevice(), descriptorSet, m_template, pInfos);
+}
+
+DescriptorBenchmark DescriptorUpdateTemplate::Benchmark(const Device* pDevice, VkBuffer buffer, uint32_t setCount)
+{
+    enum { BINDING_COUNT = 4 };
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings(BINDING_COUNT);
+    for (uint32_t i = 0; i < BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    {
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+    }
+
+    VkDescriptorSetLayout layout;
+    VkResult result = vkCreateDescriptorSetLayout(pDevice->GetDevice(), &layoutInfo, nullptr, &layout);
+    CHECK_VK(result);
+
+    DescriptorBenchmark benchmark {};
+    benchmark.setCount = setCount;
+
+    {
+        DescriptorAllocator allocator { pDevice, { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<float>(BINDING_COUNT) } }, 1024 };
+        DescriptorUpdateTemplate updateTemplate { pDevice, layout, bindings };
+
+        std::vector<VkDescriptorSet> sets(setCount);
+        for (VkDescriptorSet& set : sets) {
+            set = allocator.Allocate(layout);
+        }
+
+        // Every set points at a different 256 byte slice, so no path can skip work for identical data.
+        auto bufferInfo = [buffer](uint32_t set, uint32_t binding) { return VkDescriptorBufferInfo { buffer, (set * BINDING_COUNT + binding) % 64 * 256, 256 }; };
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t s = 0; s < setCount; s++) {
+            // On the stack like the template path's infos, a heap allocation per set would be timed too.
+            std::array<VkDescriptorBufferInfo, BINDING_COUNT> infos {};
+            std::array<VkWriteDescriptorSet, BINDING_COUNT> writes {};
+
+            for (uint32_t b = 0; b < BINDING_COUNT; b++) {
+                infos[b] = bufferInfo(s, b);
+
+                writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[b].dstSet = sets[s];
+                writes[b].dstBinding = b;
+                writes[b].dstArrayElement = 0;
+                writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[b].descriptorCount = 1;
+                writes[b].pBufferInfo = &infos[b];
+            }
+
+            vkUpdateDescriptorSets(pDevice->GetDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+        benchmark.writeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        {
+            std::vector<VkDescriptorBufferInfo> infos(static_cast<size_t>(setCount) * BINDING_COUNT);
+            std::vector<VkWriteDescriptorSet> writes(infos.size());
+
+            for (uint32_t s = 0; s < setCount; s++) {
+                for (uint32_t b = 0; b < BINDING_COUNT; b++) {
+                    size_t i = static_cast<size_t>(s) * BINDING_COUNT + b;
+                    infos[i] = bufferInfo(s, b);
+
+                    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                    writes[i].dstSet = sets[s];
+                    writes[i].dstBinding = b;
+                    writes[i].dstArrayElement = 0;
+                    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                    writes[i].descriptorCount = 1;
+                    writes[i].pBufferInfo = &infos[i];
+                }
+            }
+
+            vkUpdateDescriptorSets(pDevice->GetDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+        benchmark.batchedMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t s = 0; s < setCount; s++) {
+            std::array<DescriptorInfo, BINDING_COUNT> infos {};
+
+            for (uint32_t b = 0; b < BINDING_COUNT; b++) {
+                infos[b].buffer = bufferInfo(s, b);
+            }
+
+            updateTemplate.Update(sets[s], infos.data());
+        }
+        benchmark.templateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    vkDestroyDescriptorSetLayout(pDevice->GetDevice(), layout, nullptr);
+
+    return benchmark;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+class Device;
+
+// One descriptor's data as a template reads it, any of the three kinds at the same stride.
+union DescriptorInfo {
+    VkDescriptorBufferInfo buffer;
+    VkDescriptorImageInfo image;
+    VkBufferView texelBuffer;
+};
+
+struct DescriptorBenchmark {
+    uint32_t setCount;
+    float writeMs; // vkUpdateDescriptorSets per set, the way every model used to write its own set
+    float batchedMs; // every write of every set in one vkUpdateDescriptorSets
+    float templateMs; // vkUpdateDescriptorSetWithTemplate per set
+};
+
+/*
+ * VkDescriptorUpdateTemplate covering every binding of a set layout. Update reads one DescriptorInfo per
+ * descriptor, in binding order and array elements in order, so a set is rewritten from a flat array
+ * without building VkWriteDescriptorSet structures.
+ */
+class DescriptorUpdateTemplate {
+public:
+    DescriptorUpdateTemplate(const Device*, VkDescriptorSetLayout, const std::vector<VkDescriptorSetLayoutBinding>&);
+    ~DescriptorUpdateTemplate();
+    DescriptorUpdateTemplate(const DescriptorUpdateTemplate&) = delete;
+    DescriptorUpdateTemplate(DescriptorUpdateTemplate&&) = delete;
+    DescriptorUpdateTemplate& operator=(const DescriptorUpdateTemplate&) = delete;
+    DescriptorUpdateTemplate& operator=(DescriptorUpdateTemplate&&) = delete;
+
+public:
+    void Update(VkDescriptorSet, const DescriptorInfo* pInfos) const; // GetDescriptorCount entries
+
+    // Writes setCount sets of four storage buffers pointing at buffer, once per path.
+    static DescriptorBenchmark Benchmark(const Device*, VkBuffer, uint32_t setCount);
+
+public: // getter
+    uint32_t GetDescriptorCount() const { return m_descriptorCount; }
+
+private:
+    const Device* p_device;
+
+private:
+    VkDescriptorUpdateTemplate m_template;
+    uint32_t m_descriptorCount { 0 };
+};
@@ -4,6 +4,11 @@
 #include "vk_surface.h"
 #include "vk_swap_chain.h"
 #include "query.h"
+#include "vk_memory_allocator.h"
+#include "vk_upload_context.h"
+#include "vk_deletion_queue.h"
+#include "vk_bindless_table.h"
+#include "vk_pipeline_cache.h"
 
 Device::Device(const Instance* pInstance, const Surface* pSurface, const std::vector<const char*>& extensions)
     : p_instance { pInstance }
@@ -12,10 +17,23 @@ Device::Device(const Instance* pInstance, const Surface* pSurface, const std::ve
 {
     SelectPhysicalDevice();
     CreateLogicalDevice();
+    p_allocator = new MemoryAllocator { this };
+    p_uploadContext = new UploadContext { this };
+    p_deletionQueue = new DeletionQueue { this };
+    p_bindlessTable = new BindlessTable { this };
+    p_pipelineCache = new PipelineCache { this, "pipeline_cache.bin" };
 }
 
 Device::~Device()
 {
+    // Whatever is still queued can go now, nothing is in flight anymore.
+    vkDeviceWaitIdle(m_device);
+    delete p_deletionQueue;
+    delete p_bindlessTable;
+    delete p_pipelineCache;
+    delete p_uploadContext;
+    delete p_allocator;
+
     // VkPhysicalDevice will be implicitly destroyed when the VkInstance is destroyed.
     vkDestroyDevice(m_device, nullptr);
 }
@@ -34,7 +52,7 @@ uint32_t Device::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags memor
     throw std::runtime_error("failed to find suitable memory type!");
 }
 
-void Device::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) const
+void Device::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageAllocation) const
 {
     VkImageCreateInfo imageInfo {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -58,16 +76,10 @@ void Device::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkIma
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(m_device, image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
-    }
+    ResourceKind kind = tiling == VK_IMAGE_TILING_LINEAR ? ResourceKind::Linear : ResourceKind::Optimal;
+    imageAllocation = p_allocator->Allocate(memRequirements, properties, kind);
 
-    vkBindImageMemory(m_device, image, imageMemory, 0);
+    vkBindImageMemory(m_device, image, imageAllocation.memory, imageAllocation.offset);
 }
 
 VkImageView Device::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) const
@@ -95,21 +107,35 @@ void Device::SelectPhysicalDevice()
 {
     const auto& physicalDevices = Query::GetPhysicalDevices(p_instance->GetInstance());
 
+    // Hardware first, a software rasterizer such as lavapipe is only taken when nothing else is suitable.
+    uint32_t bestRank = 0;
+    m_physicalDevice = VK_NULL_HANDLE;
+
     for (const auto& physicalDevice : physicalDevices) {
-        if (IsDeviceSuitable(physicalDevice)) {
+        if (!IsDeviceSuitable(physicalDevice)) {
+            continue;
+        }
+
+        VkPhysicalDeviceProperties properties {};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        uint32_t rank = GetDeviceTypeRank(properties.deviceType);
+        if (rank > bestRank) {
+            bestRank = rank;
             m_physicalDevice = physicalDevice;
-            break;
         }
     }
 
-    assert(m_physicalDevice);
+    if (m_physicalDevice == VK_NULL_HANDLE) {
+        throw std::runtime_error("failed to find a suitable GPU!");
+    }
 }
 
 void Device::CreateLogicalDevice()
 {
     m_queueFamilyIndices = FindQueueFamily(m_physicalDevice, p_surface->GetSurface());
 
-    std::set<uint32_t> uniqueQueueFamilies = { m_queueFamilyIndices.graphicsFamily, m_queueFamilyIndices.presentFamily };
+    std::set<uint32_t> uniqueQueueFamilies = { m_queueFamilyIndices.graphicsFamily, m_queueFamilyIndices.presentFamily, m_queueFamilyIndices.transferFamily };
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 
     float queuePriority = 1.0f;
@@ -121,24 +147,59 @@ void Device::CreateLogicalDevice()
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures {};
+    vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+
+    m_features.multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+    m_features.fillModeNonSolid = supportedFeatures.fillModeNonSolid == VK_TRUE;
+
     VkPhysicalDeviceFeatures deviceFeatures {};
     {
         deviceFeatures.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+    }
+
+    // Optional extensions are only requested when present, the GPU-driven path falls back without them.
+    std::vector<const char*> extensions = m_requiredExtensions;
+
+    for (const VkExtensionProperties& extension : Query::GetDeviceExtensions(m_physicalDevice)) {
+        if (strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0) {
+            m_features.drawIndirectCount = true;
+            extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+    }
+
+    // Descriptor indexing for the bindless texture table, IsDeviceSuitable already checked every flag.
+    VkPhysicalDeviceVulkan12Features vulkan12Features { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+    {
+        vulkan12Features.descriptorIndexing = VK_TRUE;
+        vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+        vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
     }
 
     VkDeviceCreateInfo deviceCreateInfo { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
     {
+        deviceCreateInfo.pNext = &vulkan12Features;
         deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
-        deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(m_requiredExtensions.size());
-        deviceCreateInfo.ppEnabledExtensionNames = m_requiredExtensions.data();
+        deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
         deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
     }
 
     CHECK_VK(vkCreateDevice(m_physicalDevice, &deviceCreateInfo, nullptr, &m_device));
 
+    if (m_features.drawIndirectCount) {
+        m_cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+
     vkGetDeviceQueue(m_device, m_queueFamilyIndices.graphicsFamily, 0, &m_graphicsQueue);
     vkGetDeviceQueue(m_device, m_queueFamilyIndices.presentFamily, 0, &m_presentQueue);
+    vkGetDeviceQueue(m_device, m_queueFamilyIndices.transferFamily, 0, &m_transferQueue);
 }
 
 bool Device::IsDeviceSuitable(VkPhysicalDevice physicalDevice)
@@ -174,7 +235,39 @@ bool Device::IsDeviceSuitable(VkPhysicalDevice physicalDevice)
         return false;
     }
 
-    return properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU || properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+    if (properties.apiVersion < VK_API_VERSION_1_2 || !HasDescriptorIndexing(physicalDevice)) {
+        return false;
+    }
+
+    return GetDeviceTypeRank(properties.deviceType) > 0;
+}
+
+bool Device::HasDescriptorIndexing(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceVulkan12Features vulkan12Features { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+    VkPhysicalDeviceFeatures2 features { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+    {
+        features.pNext = &vulkan12Features;
+    }
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    return vulkan12Features.descriptorIndexing && vulkan12Features.runtimeDescriptorArray && vulkan12Features.shaderSampledImageArrayNonUniformIndexing && vulkan12Features.descriptorBindingPartiallyBound && vulkan12Features.descriptorBindingSampledImageUpdateAfterBind && vulkan12Features.descriptorBindingUpdateUnusedWhilePending;
+}
+
+uint32_t Device::GetDeviceTypeRank(VkPhysicalDeviceType deviceType)
+{
+    switch (deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        return 4;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        return 3;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        return 2;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+        return 1;
+    default:
+        return 0;
+    }
 }
 
 bool Device::CheckDeviceExtensionSupport(VkPhysicalDevice physicalDevice)
@@ -217,5 +310,27 @@ QueueFamilyIndices Device::FindQueueFamily(VkPhysicalDevice physicalDevice, VkSu
         }
     }
 
+    // Prefer a transfer-only family (usually backed by a DMA engine), then any family without graphics.
+    for (uint32_t i = 0; i < queueFamilies.size(); i++) {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+
+        if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+            continue;
+        }
+
+        if (!(flags & VK_QUEUE_COMPUTE_BIT)) {
+            indices.transferFamily = i;
+            break;
+        }
+
+        if (indices.transferFamily == UINT32_MAX) {
+            indices.transferFamily = i;
+        }
+    }
+
+    if (indices.transferFamily == UINT32_MAX) {
+        indices.transferFamily = indices.graphicsFamily;
+    }
+
     return indices;
 }
\ No newline at end of file
@@ -2,14 +2,28 @@
 
 class Instance;
 class Surface;
+class MemoryAllocator;
+class UploadContext;
+class DeletionQueue;
+class BindlessTable;
+class PipelineCache;
+struct Allocation;
 
 struct QueueFamilyIndices {
     uint32_t graphicsFamily = UINT32_MAX;
     uint32_t presentFamily = UINT32_MAX;
+    uint32_t transferFamily = UINT32_MAX; // graphicsFamily when there is no dedicated transfer family
 
     bool isComplete() { return graphicsFamily != UINT32_MAX && presentFamily != UINT32_MAX; }
 };
 
+// Optional features, enabled when the physical device has them.
+struct DeviceFeatures {
+    bool multiDrawIndirect; // drawCount > 1 in vkCmdDrawIndexedIndirect
+    bool drawIndirectCount; // VK_KHR_draw_indirect_count
+    bool fillModeNonSolid; // line and point polygon modes
+};
+
 class Device {
 public:
     Device(const Instance*, const Surface*, const std::vector<const char*>& extensions);
@@ -21,7 +35,7 @@ public:
 
 public:
     uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags) const;
-    void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) const;
+    void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageAllocation) const;
     VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) const;
 
 public: // getter
@@ -29,12 +43,22 @@ public: // getter
     VkDevice GetDevice() const { return m_device; }
     VkQueue GetQueue() const { return m_graphicsQueue; }
     VkQueue GetPresentQueue() const { return m_presentQueue; }
+    VkQueue GetTransferQueue() const { return m_transferQueue; }
     QueueFamilyIndices GetQueueFamilyIndices() const { return m_queueFamilyIndices; }
+    MemoryAllocator* GetAllocator() const { return p_allocator; }
+    UploadContext* GetUploadContext() const { return p_uploadContext; }
+    DeletionQueue* GetDeletionQueue() const { return p_deletionQueue; }
+    BindlessTable* GetBindlessTable() const { return p_bindlessTable; }
+    PipelineCache* GetPipelineCache() const { return p_pipelineCache; }
+    const DeviceFeatures& GetFeatures() const { return m_features; }
+    PFN_vkCmdDrawIndexedIndirectCountKHR GetCmdDrawIndexedIndirectCount() const { return m_cmdDrawIndexedIndirectCount; } // nullptr without drawIndirectCount
 
 private:
     void SelectPhysicalDevice();
     void CreateLogicalDevice();
     bool IsDeviceSuitable(VkPhysicalDevice);
+    static bool HasDescriptorIndexing(VkPhysicalDevice);
+    static uint32_t GetDeviceTypeRank(VkPhysicalDeviceType);
     bool CheckDeviceExtensionSupport(VkPhysicalDevice);
     QueueFamilyIndices FindQueueFamily(VkPhysicalDevice, VkSurfaceKHR);
 
@@ -48,5 +72,13 @@ private:
     QueueFamilyIndices m_queueFamilyIndices;
     VkQueue m_graphicsQueue;
     VkQueue m_presentQueue;
+    VkQueue m_transferQueue;
     std::vector<const char*> m_requiredExtensions;
+    DeviceFeatures m_features {};
+    PFN_vkCmdDrawIndexedIndirectCountKHR m_cmdDrawIndexedIndirectCount { nullptr };
+    MemoryAllocator* p_allocator;
+    UploadContext* p_uploadContext;
+    DeletionQueue* p_deletionQueue;
+    BindlessTable* p_bindlessTable;
+    PipelineCache* p_pipelineCache;
 };
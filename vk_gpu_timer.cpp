@@ -0,0 +1,83 @@
+#include "pch.h"
+#include "vk_gpu_timer.h"
+#include "vk_device.h"
+
+GpuTimer::GpuTimer(const Device* pDevice, uint32_t frameCount)
+    : p_device { pDevice }
+    , m_written(frameCount, 0)
+{
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(p_device->GetPhysicalDevice(), &properties);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(p_device->GetPhysicalDevice(), &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(p_device->GetPhysicalDevice(), &familyCount, families.data());
+
+    uint32_t validBits = families[p_device->GetQueueFamilyIndices().graphicsFamily].timestampValidBits;
+
+    m_supported = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+    m_period = properties.limits.timestampPeriod;
+    m_mask = validBits >= 64 ? UINT64_MAX : (uint64_t { 1 } << validBits) - 1;
+
+    if (!m_supported) {
+        return;
+    }
+
+    VkQueryPoolCreateInfo createInfo { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+    {
+        createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        createInfo.queryCount = frameCount * 2;
+    }
+
+    VkResult result = vkCreateQueryPool(p_device->GetDevice(), &createInfo, nullptr, &m_queryPool);
+    CHECK_VK(result);
+}
+
+GpuTimer::~GpuTimer()
+{
+    if (m_queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(p_device->GetDevice(), m_queryPool, nullptr);
+    }
+}
+
+void GpuTimer::Begin(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    if (!m_supported) {
+        return;
+    }
+
+    vkCmdResetQueryPool(commandBuffer, m_queryPool, frame * 2, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, frame * 2);
+}
+
+void GpuTimer::End(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    if (!m_supported) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, frame * 2 + 1);
+    m_written[frame] = 1;
+}
+
+bool GpuTimer::Read(uint32_t frame, float* pMs)
+{
+    if (!m_written[frame]) {
+        return false;
+    }
+    m_written[frame] = 0;
+
+    // The fence of the frame signaled, so the results are there without VK_QUERY_RESULT_WAIT_BIT.
+    std::array<uint64_t, 2> timestamps {};
+    VkResult result = vkGetQueryPoolResults(p_device->GetDevice(), m_queryPool, frame * 2, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (result != VK_SUCCESS) {
+        return false;
+    }
+
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & m_mask;
+    *pMs = static_cast<float>(static_cast<double>(ticks) * m_period * 1e-6);
+
+    return true;
+}
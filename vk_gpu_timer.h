@@ -0,0 +1,36 @@
+#pragma once
+
+class Device;
+
+/*
+ * Two timestamps per frame in flight. Begin and End bracket the work to time, Read returns the elapsed
+ * GPU time once the frame's fence has signaled. Begin goes into the frame's primary command buffer,
+ * End may also go into a secondary that executes after the timed work in the same render pass.
+ */
+class GpuTimer {
+public:
+    GpuTimer(const Device*, uint32_t frameCount);
+    ~GpuTimer();
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer(GpuTimer&&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+    GpuTimer& operator=(GpuTimer&&) = delete;
+
+public:
+    void Begin(VkCommandBuffer, uint32_t frame); // outside a render pass, resets the frame's queries first
+    void End(VkCommandBuffer, uint32_t frame);
+    bool Read(uint32_t frame, float* pMs); // false if the frame recorded no End since the last Read
+
+public: // getter
+    bool IsSupported() const { return m_supported; }
+
+private:
+    const Device* p_device;
+
+private:
+    VkQueryPool m_queryPool { VK_NULL_HANDLE };
+    std::vector<uint8_t> m_written; // per frame
+    float m_period { 0.0f }; // ns per tick
+    uint64_t m_mask { 0 }; // valid timestamp bits of the graphics queue
+    bool m_supported { false };
+};
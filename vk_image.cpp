@@ -3,8 +3,7 @@
 #include "vk_device.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-#include "vk_buffer.h"
-#include "vk_command_buffer.h"
+#include "vk_upload_context.h"
 
 Image::Image(const Device* pDevice, VkImageCreateInfo createInfo)
     : Resource { pDevice }
@@ -27,71 +26,6 @@ Image::~Image()
     vkDestroyImage(p_device->GetDevice(), m_image, nullptr);
 }
 
-void Image::transitionImageLayout(VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
-{
-    CommandBuffer commandBuffer = BeginSingleTimeCommand();
-
-    VkImageMemoryBarrier barrier {};
-    {
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.oldLayout = oldLayout;
-        barrier.newLayout = newLayout;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = m_image;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-    }
-
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else {
-        throw std::invalid_argument("unsupported layout transition!");
-    }
-
-    vkCmdPipelineBarrier(commandBuffer.GetHandle(), sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    EndSingleTimeCommand(commandBuffer);
-}
-
-void Image::copyBufferToImage(VkBuffer buffer, uint32_t width, uint32_t height)
-{
-    CommandBuffer commandBuffer = BeginSingleTimeCommand();
-
-    VkBufferImageCopy region {};
-    {
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
-        region.imageOffset = { 0, 0, 0 };
-        region.imageExtent = { width, height, 1 };
-    }
-
-    vkCmdCopyBufferToImage(commandBuffer.GetHandle(), buffer, m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    EndSingleTimeCommand(commandBuffer);
-}
-
 VkImageView Image::CreateImageView(VkFormat format)
 {
     VkImageViewCreateInfo viewInfo {};
@@ -122,17 +56,10 @@ void Image::CreateImage(VkImageCreateInfo createInfo)
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(p_device->GetDevice(), m_image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo {};
-    {
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = p_device->FindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    }
-
-    result = vkAllocateMemory(p_device->GetDevice(), &allocInfo, nullptr, &m_deviceMemory);
-    CHECK_VK(result);
+    ResourceKind kind = createInfo.tiling == VK_IMAGE_TILING_LINEAR ? ResourceKind::Linear : ResourceKind::Optimal;
+    m_allocation = p_device->GetAllocator()->Allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, kind);
 
-    result = vkBindImageMemory(p_device->GetDevice(), m_image, m_deviceMemory, 0);
+    result = vkBindImageMemory(p_device->GetDevice(), m_image, m_allocation.memory, m_allocation.offset);
     CHECK_VK(result);
 }
 
@@ -146,23 +73,6 @@ void Image::CreateTextureImage(std::string filename)
         throw std::runtime_error("failed to load texture image!");
     }
 
-    VkBufferCreateInfo stagingBufferCreateInfo {};
-    {
-        stagingBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        stagingBufferCreateInfo.size = imageSize;
-        stagingBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        stagingBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    }
-
-    VkMemoryPropertyFlags stagingBufferMemoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
-    Buffer stagingBuffer { p_device, stagingBufferCreateInfo, stagingBufferMemoryPropertyFlags };
-    stagingBuffer.MapMemory();
-    memcpy(stagingBuffer.GetMappedPtr(), pixels, imageSize);
-    stagingBuffer.UnmapMemory();
-
-    stbi_image_free(pixels);
-
     VkImageCreateInfo imageCreateInfo {};
     {
         imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -183,7 +93,8 @@ void Image::CreateTextureImage(std::string filename)
 
     CreateImage(imageCreateInfo);
 
-    transitionImageLayout(VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyBufferToImage(stagingBuffer.GetBuffer(), static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-    transitionImageLayout(VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // The pixels are copied into staging memory right away, the transitions and the copy go into the upload batch.
+    p_device->GetUploadContext()->UploadImage(m_image, imageCreateInfo.extent, pixels, imageSize);
+
+    stbi_image_free(pixels);
 }
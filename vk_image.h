@@ -11,8 +11,6 @@ public:
     ~Image();
 
 public:
-    void transitionImageLayout(VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-    void copyBufferToImage(VkBuffer buffer, uint32_t width, uint32_t height);
     VkImageView CreateImageView(VkFormat);
 
 public: // getter
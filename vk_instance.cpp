@@ -18,7 +18,7 @@ void Instance::CreateInstance(const std::vector<const char*>& layers, const std:
     {
         appInfo.pApplicationName = "vulkan_tutorial";
         appInfo.pEngineName = "tutorial";
-        appInfo.apiVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_2; // descriptor indexing is core from 1.2
     }
 
     VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo {};
@@ -0,0 +1,360 @@
+#include "pch.h"
+#include "vk_memory_allocator.h"
+#include "vk_device.h"
+
+namespace {
+VkDeviceSize NextPowerOfTwo(VkDeviceSize value)
+{
+    VkDeviceSize result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+VkDeviceSize PreviousPowerOfTwo(VkDeviceSize value)
+{
+    VkDeviceSize result = 1;
+    while ((result << 1) <= value) {
+        result <<= 1;
+    }
+    return result;
+}
+}
+
+MemoryBlock::MemoryBlock(VkDeviceMemory memory, VkDeviceSize blockSize, VkDeviceSize minNodeSize, uint32_t memoryTypeIndex)
+    : m_memory { memory }
+    , m_size { blockSize }
+    , m_minNodeSize { minNodeSize }
+    , m_memoryTypeIndex { memoryTypeIndex }
+{
+    m_maxOrder = GetOrder(blockSize);
+    m_freeLists.resize(m_maxOrder + 1);
+    m_freeLists[m_maxOrder].insert(0);
+}
+
+bool MemoryBlock::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* pOffset, VkDeviceSize* pNodeSize)
+{
+    // Nodes are aligned to their own size, so a node at least as large as the alignment satisfies it.
+    VkDeviceSize nodeSize = NextPowerOfTwo(std::max({ size, alignment, m_minNodeSize }));
+    if (nodeSize > m_size) {
+        return false;
+    }
+
+    uint32_t order = GetOrder(nodeSize);
+    uint32_t current = order;
+    while (current <= m_maxOrder && m_freeLists[current].empty()) {
+        current++;
+    }
+
+    if (current > m_maxOrder) {
+        return false;
+    }
+
+    VkDeviceSize offset = *m_freeLists[current].begin();
+    m_freeLists[current].erase(m_freeLists[current].begin());
+
+    // Split down to the requested order, keeping the upper halves free.
+    while (current > order) {
+        current--;
+        m_freeLists[current].insert(offset + (m_minNodeSize << current));
+    }
+
+    m_usedBytes += nodeSize;
+    m_allocationCount++;
+
+    *pOffset = offset;
+    *pNodeSize = nodeSize;
+    return true;
+}
+
+void MemoryBlock::Free(VkDeviceSize offset, VkDeviceSize nodeSize)
+{
+    m_usedBytes -= nodeSize;
+    m_allocationCount--;
+
+    uint32_t order = GetOrder(nodeSize);
+
+    // Merge with the buddy as long as it is free.
+    while (order < m_maxOrder) {
+        VkDeviceSize buddy = offset ^ (m_minNodeSize << order);
+        auto it = m_freeLists[order].find(buddy);
+        if (it == m_freeLists[order].end()) {
+            break;
+        }
+
+        m_freeLists[order].erase(it);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+
+    m_freeLists[order].insert(offset);
+}
+
+VkDeviceSize MemoryBlock::GetLargestFreeRange() const
+{
+    for (uint32_t order = m_maxOrder + 1; order > 0; order--) {
+        if (!m_freeLists[order - 1].empty()) {
+            return m_minNodeSize << (order - 1);
+        }
+    }
+
+    return 0;
+}
+
+uint32_t MemoryBlock::GetOrder(VkDeviceSize nodeSize) const
+{
+    uint32_t order = 0;
+    while ((m_minNodeSize << order) < nodeSize) {
+        order++;
+    }
+    return order;
+}
+
+MemoryAllocator::MemoryAllocator(const Device* pDevice)
+    : p_device { pDevice }
+{
+    vkGetPhysicalDeviceMemoryProperties(p_device->GetPhysicalDevice(), &m_memoryProperties);
+
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(p_device->GetPhysicalDevice(), &properties);
+
+    VkDeviceSize granularity = properties.limits.bufferImageGranularity;
+    VkDeviceSize atomSize = properties.limits.nonCoherentAtomSize;
+    m_nonCoherentAtomSize = atomSize;
+
+    // Every node boundary is a multiple of the minimum node size, so when the granularity fits in a
+    // node, linear and optimal resources can never land on the same page and may share blocks.
+    m_separateOptimalPools = granularity > MAX_SHARED_GRANULARITY;
+    m_minNodeSize = NextPowerOfTwo(std::max({ static_cast<VkDeviceSize>(MIN_NODE_SIZE), atomSize, m_separateOptimalPools ? 1 : granularity }));
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    for (auto& pool : m_pools) {
+        for (MemoryBlock* block : pool) {
+            DestroyBlock(block);
+        }
+        pool.clear();
+    }
+
+    assert(m_dedicatedCount == 0);
+}
+
+Allocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags memoryPropertyFlags, ResourceKind kind)
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    uint32_t memoryTypeIndex = p_device->FindMemoryType(requirements.memoryTypeBits, memoryPropertyFlags);
+    VkDeviceSize blockSize = GetBlockSize(memoryTypeIndex);
+
+    // Large resources would waste most of a block, give them their own memory.
+    if (requirements.size > blockSize / 2) {
+        return AllocateDedicated(requirements.size, memoryTypeIndex);
+    }
+
+    Allocation allocation {};
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.propertyFlags = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    allocation.requestedSize = requirements.size;
+
+    auto& pool = m_pools[GetPoolIndex(memoryTypeIndex, kind)];
+
+    for (MemoryBlock* block : pool) {
+        if (block->Allocate(requirements.size, requirements.alignment, &allocation.offset, &allocation.size)) {
+            allocation.memory = block->GetMemory();
+            allocation.p_block = block;
+            m_requestedBytes += requirements.size;
+            return allocation;
+        }
+    }
+
+    MemoryBlock* block = CreateBlock(memoryTypeIndex);
+    pool.push_back(block);
+
+    bool result = block->Allocate(requirements.size, requirements.alignment, &allocation.offset, &allocation.size);
+    assert(result);
+
+    allocation.memory = block->GetMemory();
+    allocation.p_block = block;
+    m_requestedBytes += requirements.size;
+    return allocation;
+}
+
+void MemoryAllocator::Free(Allocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    m_requestedBytes -= allocation.requestedSize;
+
+    if (allocation.p_block == nullptr) {
+        vkFreeMemory(p_device->GetDevice(), allocation.memory, nullptr);
+        m_dedicatedCount--;
+        m_dedicatedBytes -= allocation.size;
+        allocation = {};
+        return;
+    }
+
+    MemoryBlock* block = allocation.p_block;
+    block->Free(allocation.offset, allocation.size);
+    allocation = {};
+
+    if (!block->IsEmpty()) {
+        return;
+    }
+
+    // Keep one empty block per pool around so alternating create/destroy does not thrash vkAllocateMemory.
+    for (auto& pool : m_pools) {
+        auto it = std::find(pool.begin(), pool.end(), block);
+        if (it == pool.end()) {
+            continue;
+        }
+
+        uint32_t emptyCount = static_cast<uint32_t>(std::count_if(pool.begin(), pool.end(), [](const MemoryBlock* b) { return b->IsEmpty(); }));
+        if (emptyCount > 1) {
+            pool.erase(it);
+            DestroyBlock(block);
+        }
+        break;
+    }
+}
+
+void* MemoryAllocator::Map(const Allocation& allocation)
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    void* ptr = nullptr;
+
+    if (allocation.p_block == nullptr) {
+        VkResult result = vkMapMemory(p_device->GetDevice(), allocation.memory, 0, VK_WHOLE_SIZE, 0, &ptr);
+        CHECK_VK(result);
+        return ptr;
+    }
+
+    // A VkDeviceMemory can only be mapped once, so blocks stay persistently mapped after the first request.
+    MemoryBlock* block = allocation.p_block;
+    if (block->GetMappedPtr() == nullptr) {
+        VkResult result = vkMapMemory(p_device->GetDevice(), block->GetMemory(), 0, VK_WHOLE_SIZE, 0, &ptr);
+        CHECK_VK(result);
+        block->SetMappedPtr(ptr);
+    }
+
+    return static_cast<uint8_t*>(block->GetMappedPtr()) + allocation.offset;
+}
+
+void MemoryAllocator::Unmap(const Allocation& allocation)
+{
+    if (allocation.p_block == nullptr) {
+        vkUnmapMemory(p_device->GetDevice(), allocation.memory);
+    }
+}
+
+MemoryStats MemoryAllocator::GetStats() const
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    MemoryStats stats {};
+    VkDeviceSize freeBytes = 0;
+
+    for (const auto& pool : m_pools) {
+        for (const MemoryBlock* block : pool) {
+            stats.blockCount++;
+            stats.allocationCount += block->GetAllocationCount();
+            stats.blockBytes += block->GetSize();
+            stats.allocatedBytes += block->GetUsedBytes();
+            stats.largestFreeRange = std::max(stats.largestFreeRange, block->GetLargestFreeRange());
+            freeBytes += block->GetSize() - block->GetUsedBytes();
+        }
+    }
+
+    stats.dedicatedAllocationCount = m_dedicatedCount;
+    stats.allocationCount += m_dedicatedCount;
+    stats.deviceMemoryCount = stats.blockCount + m_dedicatedCount;
+    stats.allocatedBytes += m_dedicatedBytes;
+    stats.requestedBytes = m_requestedBytes;
+
+    if (stats.allocatedBytes > 0) {
+        stats.internalFragmentation = static_cast<float>(stats.allocatedBytes - stats.requestedBytes) / static_cast<float>(stats.allocatedBytes);
+    }
+
+    if (freeBytes > 0) {
+        stats.externalFragmentation = 1.0f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(freeBytes);
+    }
+
+    return stats;
+}
+
+MemoryBlock* MemoryAllocator::CreateBlock(uint32_t memoryTypeIndex)
+{
+    VkDeviceSize blockSize = GetBlockSize(memoryTypeIndex);
+
+    VkMemoryAllocateInfo allocInfo { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+    {
+        allocInfo.allocationSize = blockSize;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+    }
+
+    VkDeviceMemory memory;
+    VkResult result = vkAllocateMemory(p_device->GetDevice(), &allocInfo, nullptr, &memory);
+    CHECK_VK(result);
+
+    return new MemoryBlock { memory, blockSize, m_minNodeSize, memoryTypeIndex };
+}
+
+void MemoryAllocator::DestroyBlock(MemoryBlock* block)
+{
+    assert(block->IsEmpty());
+
+    // Freeing the memory implicitly unmaps it.
+    vkFreeMemory(p_device->GetDevice(), block->GetMemory(), nullptr);
+    delete block;
+}
+
+Allocation MemoryAllocator::AllocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex)
+{
+    VkMemoryAllocateInfo allocInfo { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+    {
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+    }
+
+    Allocation allocation {};
+    {
+        allocation.offset = 0;
+        allocation.size = size;
+        allocation.requestedSize = size;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.propertyFlags = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    }
+
+    VkResult result = vkAllocateMemory(p_device->GetDevice(), &allocInfo, nullptr, &allocation.memory);
+    CHECK_VK(result);
+
+    m_dedicatedCount++;
+    m_dedicatedBytes += size;
+    m_requestedBytes += size;
+
+    return allocation;
+}
+
+VkDeviceSize MemoryAllocator::GetBlockSize(uint32_t memoryTypeIndex) const
+{
+    VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+
+    // Small heaps (e.g. the 256 MiB host-visible device-local window) get proportionally smaller blocks.
+    VkDeviceSize blockSize = std::min(static_cast<VkDeviceSize>(DEFAULT_BLOCK_SIZE), PreviousPowerOfTwo(heapSize / 8));
+    return std::max(blockSize, m_minNodeSize);
+}
+
+uint32_t MemoryAllocator::GetPoolIndex(uint32_t memoryTypeIndex, ResourceKind kind) const
+{
+    if (m_separateOptimalPools && kind == ResourceKind::Optimal) {
+        return memoryTypeIndex * 2 + 1;
+    }
+
+    return memoryTypeIndex * 2;
+}
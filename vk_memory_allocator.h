@@ -0,0 +1,124 @@
+#pragma once
+
+class Device;
+class MemoryBlock;
+
+/*
+ * Linear resources (buffers, linear images) and optimal images must not share a
+ * bufferImageGranularity page, so the allocator keeps them apart when needed.
+ */
+enum class ResourceKind {
+    Linear,
+    Optimal,
+};
+
+struct Allocation {
+    VkDeviceMemory memory { VK_NULL_HANDLE };
+    VkDeviceSize offset { 0 };
+    VkDeviceSize size { 0 }; // reserved bytes (buddy node or dedicated memory)
+    VkDeviceSize requestedSize { 0 };
+    uint32_t memoryTypeIndex { UINT32_MAX };
+    VkMemoryPropertyFlags propertyFlags { 0 };
+    MemoryBlock* p_block { nullptr }; // nullptr for a dedicated allocation
+};
+
+struct MemoryStats {
+    uint32_t allocationCount;
+    uint32_t dedicatedAllocationCount;
+    uint32_t blockCount;
+    uint32_t deviceMemoryCount; // vkAllocateMemory objects alive
+    VkDeviceSize blockBytes;
+    VkDeviceSize allocatedBytes; // buddy nodes handed out
+    VkDeviceSize requestedBytes;
+    VkDeviceSize largestFreeRange;
+    float internalFragmentation; // padding inside nodes / allocated bytes
+    float externalFragmentation; // 1 - largest free range / total free bytes
+};
+
+/*
+ * Buddy allocator over one VkDeviceMemory.
+ * A node of order k is (minNodeSize << k) bytes and is aligned to its own size.
+ */
+class MemoryBlock {
+public:
+    MemoryBlock(VkDeviceMemory, VkDeviceSize blockSize, VkDeviceSize minNodeSize, uint32_t memoryTypeIndex);
+    ~MemoryBlock() = default;
+    MemoryBlock(const MemoryBlock&) = delete;
+    MemoryBlock(MemoryBlock&&) = delete;
+    MemoryBlock& operator=(const MemoryBlock&) = delete;
+    MemoryBlock& operator=(MemoryBlock&&) = delete;
+
+public:
+    bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* pOffset, VkDeviceSize* pNodeSize);
+    void Free(VkDeviceSize offset, VkDeviceSize nodeSize);
+
+public: // getter
+    VkDeviceMemory GetMemory() const { return m_memory; }
+    VkDeviceSize GetSize() const { return m_size; }
+    VkDeviceSize GetUsedBytes() const { return m_usedBytes; }
+    VkDeviceSize GetLargestFreeRange() const;
+    uint32_t GetMemoryTypeIndex() const { return m_memoryTypeIndex; }
+    uint32_t GetAllocationCount() const { return m_allocationCount; }
+    bool IsEmpty() const { return m_allocationCount == 0; }
+    void* GetMappedPtr() const { return p_mapped; }
+    void SetMappedPtr(void* ptr) { p_mapped = ptr; }
+
+private:
+    uint32_t GetOrder(VkDeviceSize nodeSize) const;
+
+private:
+    VkDeviceMemory m_memory;
+    VkDeviceSize m_size;
+    VkDeviceSize m_minNodeSize;
+    uint32_t m_memoryTypeIndex;
+    uint32_t m_maxOrder;
+    std::vector<std::set<VkDeviceSize>> m_freeLists;
+    VkDeviceSize m_usedBytes { 0 };
+    uint32_t m_allocationCount { 0 };
+    void* p_mapped { nullptr };
+};
+
+class MemoryAllocator {
+public:
+    MemoryAllocator(const Device*);
+    ~MemoryAllocator();
+    MemoryAllocator(const MemoryAllocator&) = delete;
+    MemoryAllocator(MemoryAllocator&&) = delete;
+    MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+    MemoryAllocator& operator=(MemoryAllocator&&) = delete;
+
+public:
+    Allocation Allocate(const VkMemoryRequirements&, VkMemoryPropertyFlags, ResourceKind);
+    void Free(Allocation&);
+    void* Map(const Allocation&);
+    void Unmap(const Allocation&);
+    MemoryStats GetStats() const;
+
+public: // getter
+    VkDeviceSize GetNonCoherentAtomSize() const { return m_nonCoherentAtomSize; }
+
+private:
+    MemoryBlock* CreateBlock(uint32_t memoryTypeIndex);
+    void DestroyBlock(MemoryBlock*);
+    Allocation AllocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex);
+    VkDeviceSize GetBlockSize(uint32_t memoryTypeIndex) const;
+    uint32_t GetPoolIndex(uint32_t memoryTypeIndex, ResourceKind) const;
+
+private:
+    const Device* p_device;
+
+private:
+    enum { DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024 };
+    enum { MIN_NODE_SIZE = 256 };
+    enum { MAX_SHARED_GRANULARITY = 4096 };
+
+    VkPhysicalDeviceMemoryProperties m_memoryProperties;
+    VkDeviceSize m_minNodeSize;
+    VkDeviceSize m_nonCoherentAtomSize;
+    bool m_separateOptimalPools;
+    std::vector<MemoryBlock*> m_pools[VK_MAX_MEMORY_TYPES * 2];
+    uint32_t m_dedicatedCount { 0 };
+    VkDeviceSize m_dedicatedBytes { 0 };
+    VkDeviceSize m_requestedBytes { 0 };
+    mutable std::mutex m_mutex;
+};
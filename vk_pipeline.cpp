@@ -3,23 +3,70 @@
 #include "vk_device.h"
 #include "vk_swap_chain.h"
 #include "shader.h"
+#include "vk_deletion_queue.h"
+#include "vk_bindless_table.h"
+#include "vk_descriptor_update_template.h"
+#include "vk_pipeline_cache.h"
+#include "vk_pipeline_variant_cache.h"
+#include "vk_shader_reflection.h"
+
+namespace {
+// Stages that read the same binding see one layout binding, so they have to agree on what it is.
+void MergeBindings(std::vector<ReflectedBinding>& merged, const ShaderReflection& reflection)
+{
+    for (const ReflectedBinding& binding : reflection.GetBindings()) {
+        auto it = std::find_if(merged.begin(), merged.end(), [&binding](const ReflectedBinding& other) { return other.set == binding.set && other.binding == binding.binding; });
+
+        if (it == merged.end()) {
+            merged.push_back(binding);
+        } else if (it->type != binding.type || it->count != binding.count) {
+            throw std::runtime_error("shader stages disagree on a descriptor binding!");
+        } else {
+            it->stages |= binding.stages;
+        }
+    }
+
+    std::sort(merged.begin(), merged.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) { return a.set != b.set ? a.set < b.set : a.binding < b.binding; });
+}
+
+// Buffers of sets 0 and 1 are frame ring segments, the renderer picks the frame with dynamic offsets.
+VkDescriptorType GetDynamicType(VkDescriptorType type)
+{
+    switch (type) {
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    default:
+        throw std::runtime_error("only buffers may be bound outside the bindless set!");
+    }
+}
+}
 
 Pipeline::Pipeline(const Device* pDevice, const SwapChain* pSwapChain)
     : p_device { pDevice }
     , p_swapChain { pSwapChain }
 {
+    CreateDefaultKey();
+    ReflectShaders();
     CreateDescriptorSetLayout();
     CreatePipelineLayout();
     CreateRenderPass();
+    p_variants = new PipelineVariantCache { p_device, this, COMPILE_THREADS };
     CreatePipeline();
 }
 
 Pipeline::~Pipeline()
 {
-    vkDestroyPipeline(p_device->GetDevice(), m_pipeline, nullptr);
+    // Joins the compile threads before anything they build against goes away.
+    delete p_variants;
     vkDestroyRenderPass(p_device->GetDevice(), m_renderPass, nullptr);
     vkDestroyPipelineLayout(p_device->GetDevice(), m_layout, nullptr);
 
+    for (DescriptorUpdateTemplate* updateTemplate : m_updateTemplates) {
+        delete updateTemplate;
+    }
+
     for (const auto& layout : m_descriptorSetLayouts) {
         vkDestroyDescriptorSetLayout(p_device->GetDevice(), layout, nullptr);
     }
@@ -27,71 +74,118 @@ Pipeline::~Pipeline()
 
 void Pipeline::UpdateSwapChain(const SwapChain* pSwapChain)
 {
+    p_variants->WaitIdle();
+
     p_swapChain = pSwapChain;
-    vkDestroyRenderPass(p_device->GetDevice(), m_renderPass, nullptr);
+    p_device->GetDeletionQueue()->Push(VK_OBJECT_TYPE_RENDER_PASS, m_renderPass);
     CreateRenderPass();
-}
 
-void Pipeline::CreateDescriptorSetLayout()
-{
-    std::array<VkDescriptorSetLayoutBinding, 2> modelDescriptorSetLayoutBinding {};
-    {
-        modelDescriptorSetLayoutBinding[0].binding = 0;
-        modelDescriptorSetLayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        modelDescriptorSetLayoutBinding[0].descriptorCount = 1;
-        modelDescriptorSetLayoutBinding[0].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+    // Variants of the old formats stay in the cache, only the default has to be ready right away.
+    CreateDefaultKey();
 
-        modelDescriptorSetLayoutBinding[1].binding = 1;
-        modelDescriptorSetLayoutBinding[1].descriptorCount = 1;
-        modelDescriptorSetLayoutBinding[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        modelDescriptorSetLayoutBinding[1].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+    if (p_variants->Find(m_defaultKey) == VK_NULL_HANDLE) {
+        CreatePipeline();
     }
+}
 
-    VkDescriptorSetLayoutCreateInfo modelDescriptorSetLayoutCreateInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
-    {
-        modelDescriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(modelDescriptorSetLayoutBinding.size());
-        modelDescriptorSetLayoutCreateInfo.pBindings = modelDescriptorSetLayoutBinding.data();
-    }
+VkPipeline Pipeline::GetPipeline() const
+{
+    // Looked up every time, a hot reload replaces the handle.
+    return p_variants->Find(m_defaultKey);
+}
 
-    VkDescriptorSetLayout modelDescriptorSetLayout;
-    CHECK_VK(vkCreateDescriptorSetLayout(p_device->GetDevice(), &modelDescriptorSetLayoutCreateInfo, nullptr, &modelDescriptorSetLayout));
-    m_descriptorSetLayouts.push_back(modelDescriptorSetLayout);
+void Pipeline::ReflectShaders()
+{
+    ShaderReflection vertex { Shader::ReadFile(m_defaultKey.vertexShader) };
+    ShaderReflection fragment { Shader::ReadFile(m_defaultKey.fragmentShader) };
 
-    std::array<VkDescriptorSetLayoutBinding, 1> commonDescriptorSetLayoutBinding {};
-    {
-        commonDescriptorSetLayoutBinding[0].binding = 0;
-        commonDescriptorSetLayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        commonDescriptorSetLayoutBinding[0].descriptorCount = 1;
-        commonDescriptorSetLayoutBinding[0].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+    for (const ShaderReflection* pReflection : { &vertex, &fragment }) {
+        MergeBindings(m_bindings, *pReflection);
+
+        if (pReflection->GetPushConstantSize() > 0) {
+            m_pushConstantSize = std::max(m_pushConstantSize, pReflection->GetPushConstantSize());
+            m_pushConstantStages |= pReflection->GetStage();
+        }
     }
+}
 
-    VkDescriptorSetLayoutCreateInfo commonDescriptorSetLayoutCreateInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
-    {
-        commonDescriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(commonDescriptorSetLayoutBinding.size());
-        commonDescriptorSetLayoutCreateInfo.pBindings = commonDescriptorSetLayoutBinding.data();
+void Pipeline::CreateDescriptorSetLayout()
+{
+    // Sets 0 (objects and instances) and 1 (common uniforms) are whatever the shaders declare.
+    for (uint32_t set = 0; set < BINDLESS_SET; set++) {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+
+        for (const ReflectedBinding& reflected : m_bindings) {
+            if (reflected.set != set) {
+                continue;
+            }
+            if (reflected.count == 0) {
+                throw std::runtime_error("runtime descriptor arrays belong in the bindless set!");
+            }
+
+            VkDescriptorSetLayoutBinding binding {};
+            {
+                binding.binding = reflected.binding;
+                binding.descriptorType = GetDynamicType(reflected.type);
+                binding.descriptorCount = reflected.count;
+                binding.stageFlags = reflected.stages;
+            }
+            setLayoutBindings.push_back(binding);
+        }
+
+        VkDescriptorSetLayoutCreateInfo createInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+        {
+            createInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+            createInfo.pBindings = setLayoutBindings.data();
+        }
+
+        VkDescriptorSetLayout setLayout;
+        CHECK_VK(vkCreateDescriptorSetLayout(p_device->GetDevice(), &createInfo, nullptr, &setLayout));
+        m_descriptorSetLayouts.push_back(setLayout);
+        m_updateTemplates.push_back(new DescriptorUpdateTemplate { p_device, setLayout, setLayoutBindings });
     }
 
-    VkDescriptorSetLayout commonDescriptorSetLayout;
-    CHECK_VK(vkCreateDescriptorSetLayout(p_device->GetDevice(), &commonDescriptorSetLayoutCreateInfo, nullptr, &commonDescriptorSetLayout));
-    m_descriptorSetLayouts.push_back(commonDescriptorSetLayout);
+    // Set 2 is created by the device, the shaders only have to agree with it.
+    std::string reason;
+    for (const ReflectedBinding& reflected : m_bindings) {
+        if (reflected.set >= BINDLESS_SET && !IsCompatible(reflected, &reason)) {
+            throw std::runtime_error(reason + "!");
+        }
+    }
 }
 
 void Pipeline::CreatePipelineLayout()
 {
-    // VkPushConstantRange pushConstant {};
-    //{
-    //     pushConstant.size = sizeof(Mat4);
-    //     pushConstant.offset = 0;
-    //     pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    // }
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(p_device->GetPhysicalDevice(), &properties);
+
+    // The renderer pushes a whole DrawConstants, the block the shaders declare has to cover it.
+    if (m_pushConstantSize < sizeof(DrawConstants)) {
+        throw std::runtime_error("shader push constant block is smaller than DrawConstants!");
+    }
+
+    // 128 bytes is the smallest limit a device may report, this only fails if the block outgrows it.
+    if (m_pushConstantSize > properties.limits.maxPushConstantsSize) {
+        throw std::runtime_error("push constant block exceeds maxPushConstantsSize!");
+    }
+
+    VkPushConstantRange pushConstant {};
+    {
+        pushConstant.size = m_pushConstantSize;
+        pushConstant.offset = 0;
+        pushConstant.stageFlags = m_pushConstantStages;
+    }
+
+    // Set 2 is owned by the device, every pipeline shares the same texture table.
+    std::vector<VkDescriptorSetLayout> setLayouts = m_descriptorSetLayouts;
+    setLayouts.push_back(p_device->GetBindlessTable()->GetDescriptorSetLayout());
 
     VkPipelineLayoutCreateInfo createInfo { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
     {
-        createInfo.pushConstantRangeCount = 0;
-        // createInfo.pushConstantRangeCount = 1;
-        // createInfo.pPushConstantRanges = &pushConstant;
-        createInfo.setLayoutCount = static_cast<uint32_t>(m_descriptorSetLayouts.size());
-        createInfo.pSetLayouts = m_descriptorSetLayouts.data();
+        createInfo.pushConstantRangeCount = 1;
+        createInfo.pPushConstantRanges = &pushConstant;
+        createInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        createInfo.pSetLayouts = setLayouts.data();
     }
 
     CHECK_VK(vkCreatePipelineLayout(p_device->GetDevice(), &createInfo, nullptr, &m_layout));
@@ -167,15 +261,85 @@ void Pipeline::CreateRenderPass()
     CHECK_VK(vkCreateRenderPass(p_device->GetDevice(), &createInfo, nullptr, &m_renderPass));
 }
 
+void Pipeline::CreateDefaultKey()
+{
+    m_defaultKey.vertexShader = "shaders/simple.vert.spv";
+    m_defaultKey.fragmentShader = "shaders/simple.frag.spv";
+    m_defaultKey.vertex = VertexVariant { VK_FALSE };
+    m_defaultKey.fragment = FragmentVariant { VK_TRUE, 1, LightingModel::Phong };
+    m_defaultKey.vertexLayout = VertexLayout::Mesh;
+    m_defaultKey.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    m_defaultKey.polygonMode = VK_POLYGON_MODE_FILL;
+    m_defaultKey.cullMode = VK_CULL_MODE_BACK_BIT;
+    m_defaultKey.depthTest = VK_TRUE;
+    m_defaultKey.depthWrite = VK_TRUE;
+    m_defaultKey.depthCompare = VK_COMPARE_OP_LESS;
+    m_defaultKey.blendEnable = VK_FALSE;
+    m_defaultKey.srcBlend = VK_BLEND_FACTOR_ONE;
+    m_defaultKey.dstBlend = VK_BLEND_FACTOR_ZERO;
+    m_defaultKey.blendOp = VK_BLEND_OP_ADD;
+    m_defaultKey.colorFormat = p_swapChain->GetFormat();
+    m_defaultKey.depthFormat = p_swapChain->findDepthFormat();
+    m_defaultKey.samples = VK_SAMPLE_COUNT_1_BIT;
+}
+
 void Pipeline::CreatePipeline()
 {
+    PipelineCache* pCache = p_device->GetPipelineCache();
+
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = BuildPipeline(m_defaultKey, pCache->GetCache());
+    pCache->RecordCreation(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    p_variants->Add(m_defaultKey, pipeline);
+}
+
+float Pipeline::MeasureCreation(VkPipelineCache cache) const
+{
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = BuildPipeline(m_defaultKey, cache);
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    vkDestroyPipeline(p_device->GetDevice(), pipeline, nullptr);
+    return ms;
+}
+
+VkPipeline Pipeline::BuildPipeline(const PipelineKey& key, VkPipelineCache cache) const
+{
+    std::vector<char> vertexBinary = Shader::ReadFile(key.vertexShader);
+    std::vector<char> fragmentBinary = Shader::ReadFile(key.fragmentShader);
+
+    // Reflection also rejects a file that is not SPIR-V before the driver sees it.
+    ShaderReflection vertexReflection { vertexBinary };
+    ShaderReflection fragmentReflection { fragmentBinary };
+
+    assert(key.vertexLayout == VertexLayout::Mesh);
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+    std::string reason;
+
+    if (!IsCompatible(vertexReflection, &reason) || !IsCompatible(fragmentReflection, &reason) || !GetVertexAttributes(vertexReflection, attributeDescriptions, &reason)) {
+        throw std::runtime_error(reason + "!");
+    }
+
     std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
 
     VkShaderModule vertexShader;
-    Shader::CreateModule(p_device->GetDevice(), "shaders/simple.vert.spv", &vertexShader);
+    Shader::CreateModule(p_device->GetDevice(), vertexBinary, &vertexShader);
+
+    static_assert(sizeof(VertexVariant) == sizeof(uint32_t), "every specialization constant is 4 bytes");
+    std::vector<VkSpecializationMapEntry> vertexConstants = Shader::CreateSpecializationEntries(sizeof(VertexVariant) / sizeof(uint32_t));
+
+    VkSpecializationInfo vertexSpecialization {};
+    {
+        vertexSpecialization.mapEntryCount = static_cast<uint32_t>(vertexConstants.size());
+        vertexSpecialization.pMapEntries = vertexConstants.data();
+        vertexSpecialization.dataSize = sizeof(VertexVariant);
+        vertexSpecialization.pData = &key.vertex;
+    }
 
     VkPipelineShaderStageCreateInfo vertexShaderStage { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
     {
+        vertexShaderStage.pSpecializationInfo = &vertexSpecialization;
         vertexShaderStage.module = vertexShader;
         vertexShaderStage.pName = "main";
         vertexShaderStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -183,17 +347,28 @@ void Pipeline::CreatePipeline()
     shaderStages.push_back(vertexShaderStage);
 
     VkShaderModule fragmentShader;
-    Shader::CreateModule(p_device->GetDevice(), "shaders/simple.frag.spv", &fragmentShader);
+    Shader::CreateModule(p_device->GetDevice(), fragmentBinary, &fragmentShader);
+
+    static_assert(sizeof(FragmentVariant) == 3 * sizeof(uint32_t), "every specialization constant is 4 bytes");
+    std::vector<VkSpecializationMapEntry> fragmentConstants = Shader::CreateSpecializationEntries(sizeof(FragmentVariant) / sizeof(uint32_t));
+
+    VkSpecializationInfo fragmentSpecialization {};
+    {
+        fragmentSpecialization.mapEntryCount = static_cast<uint32_t>(fragmentConstants.size());
+        fragmentSpecialization.pMapEntries = fragmentConstants.data();
+        fragmentSpecialization.dataSize = sizeof(FragmentVariant);
+        fragmentSpecialization.pData = &key.fragment;
+    }
 
     VkPipelineShaderStageCreateInfo fragmentShaderStage { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
     {
+        fragmentShaderStage.pSpecializationInfo = &fragmentSpecialization;
         fragmentShaderStage.module = fragmentShader;
         fragmentShaderStage.pName = "main";
         fragmentShaderStage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     }
     shaderStages.push_back(fragmentShaderStage);
 
-    auto attributeDescriptions = Vertex::GetAttributeDescriptions();
     auto bindingDescriptions = Vertex::GetBindingDescriptions();
     VkPipelineVertexInputStateCreateInfo vertexInputState { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
     {
@@ -205,29 +380,16 @@ void Pipeline::CreatePipeline()
 
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyState { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
     {
-        inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssemblyState.topology = key.topology;
     }
 
     VkPipelineTessellationStateCreateInfo tessellationState { VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO };
 
-    VkViewport viewport {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    viewport.width = static_cast<float>(p_swapChain->GetExtent2D().width);
-    viewport.height = static_cast<float>(p_swapChain->GetExtent2D().height);
-
-    VkRect2D scissor {};
-    scissor.extent = p_swapChain->GetExtent2D();
-    scissor.offset = { 0, 0 };
-
+    // Viewport and scissor are dynamic, so nothing here depends on the swap chain the variant outlives.
     VkPipelineViewportStateCreateInfo viewportState { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
     {
         viewportState.viewportCount = 1;
-        viewportState.pViewports = &viewport;
         viewportState.scissorCount = 1;
-        viewportState.pScissors = &scissor;
     }
 
     VkPipelineRasterizationStateCreateInfo rasterizationState { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
@@ -235,23 +397,23 @@ void Pipeline::CreatePipeline()
         rasterizationState.depthBiasEnable = VK_FALSE;
         rasterizationState.depthClampEnable = VK_FALSE;
         rasterizationState.rasterizerDiscardEnable = VK_FALSE;
-        rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizationState.cullMode = key.cullMode;
         rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
         rasterizationState.lineWidth = 1.0f;
-        rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizationState.polygonMode = key.polygonMode;
     }
 
     VkPipelineMultisampleStateCreateInfo multisampleState { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
     {
         multisampleState.sampleShadingEnable = VK_FALSE;
-        multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampleState.rasterizationSamples = key.samples;
     }
 
     VkPipelineDepthStencilStateCreateInfo depthStencilState { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
     {
-        depthStencilState.depthTestEnable = VK_TRUE;
-        depthStencilState.depthWriteEnable = VK_TRUE;
-        depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencilState.depthTestEnable = key.depthTest;
+        depthStencilState.depthWriteEnable = key.depthWrite;
+        depthStencilState.depthCompareOp = key.depthCompare;
         depthStencilState.depthBoundsTestEnable = VK_FALSE;
         depthStencilState.minDepthBounds = 0.0f; // Optional
         depthStencilState.maxDepthBounds = 1.0f; // Optional
@@ -263,7 +425,13 @@ void Pipeline::CreatePipeline()
     VkPipelineColorBlendAttachmentState colorBlendAttachment {};
     {
         colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
+        colorBlendAttachment.blendEnable = key.blendEnable;
+        colorBlendAttachment.srcColorBlendFactor = key.srcBlend;
+        colorBlendAttachment.dstColorBlendFactor = key.dstBlend;
+        colorBlendAttachment.colorBlendOp = key.blendOp;
+        colorBlendAttachment.srcAlphaBlendFactor = key.srcBlend;
+        colorBlendAttachment.dstAlphaBlendFactor = key.dstBlend;
+        colorBlendAttachment.alphaBlendOp = key.blendOp;
     }
 
     VkPipelineColorBlendStateCreateInfo colorBlendState { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
@@ -305,8 +473,142 @@ void Pipeline::CreatePipeline()
         createInfo.subpass = 0;
     }
 
-    CHECK_VK(vkCreateGraphicsPipelines(p_device->GetDevice(), nullptr, 1, &createInfo, nullptr, &m_pipeline));
+    VkPipeline pipeline;
+    VkResult result = vkCreateGraphicsPipelines(p_device->GetDevice(), cache, 1, &createInfo, nullptr, &pipeline);
+    CHECK_VK(result);
 
     vkDestroyShaderModule(p_device->GetDevice(), vertexShader, nullptr);
     vkDestroyShaderModule(p_device->GetDevice(), fragmentShader, nullptr);
+
+    return pipeline;
+}
+
+bool Pipeline::IsCompatible(const ShaderReflection& reflection, std::string* pReason) const
+{
+    for (const ReflectedBinding& binding : reflection.GetBindings()) {
+        if (!IsCompatible(binding, pReason)) {
+            return false;
+        }
+    }
+
+    // The range is fixed in the pipeline layout, a block may shrink but not grow or move to a new stage.
+    if (reflection.GetPushConstantSize() > m_pushConstantSize) {
+        *pReason = "push constant block grew";
+        return false;
+    }
+    if (reflection.GetPushConstantSize() > 0 && (m_pushConstantStages & reflection.GetStage()) == 0) {
+        *pReason = "push constants are not visible to this stage";
+        return false;
+    }
+
+    std::vector<VkVertexInputAttributeDescription> attributes;
+    return reflection.GetStage() != VK_SHADER_STAGE_VERTEX_BIT || GetVertexAttributes(reflection, attributes, pReason);
+}
+
+bool Pipeline::IsCompatible(const ReflectedBinding& binding, std::string* pReason) const
+{
+    std::string name = "set " + std::to_string(binding.set) + " binding " + std::to_string(binding.binding);
+
+    // The bindless table has its own layout, fixed by BindlessTable.
+    if (binding.set == BINDLESS_SET) {
+        bool texture = binding.binding == 0 && binding.type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        bool sampler = binding.binding == 1 && binding.type == VK_DESCRIPTOR_TYPE_SAMPLER;
+
+        if (!texture && !sampler) {
+            *pReason = name + " is not in the bindless table";
+            return false;
+        }
+        if ((binding.stages & ~VK_SHADER_STAGE_FRAGMENT_BIT) != 0) {
+            *pReason = "the bindless table is only visible to fragment shaders";
+            return false;
+        }
+        return true;
+    }
+
+    auto it = std::find_if(m_bindings.begin(), m_bindings.end(), [&binding](const ReflectedBinding& other) { return other.set == binding.set && other.binding == binding.binding; });
+
+    if (it == m_bindings.end()) {
+        *pReason = name + " is not in the layout";
+        return false;
+    }
+    if (it->type != binding.type || it->count != binding.count) {
+        *pReason = name + " changed type";
+        return false;
+    }
+    if ((it->stages & binding.stages) != binding.stages) {
+        *pReason = name + " is not visible to this stage";
+        return false;
+    }
+
+    return true;
+}
+
+bool Pipeline::GetVertexAttributes(const ShaderReflection& reflection, std::vector<VkVertexInputAttributeDescription>& attributes, std::string* pReason) const
+{
+    // Only the locations the shader reads, an attribute the shader dropped would draw a validation warning.
+    std::vector<VkVertexInputAttributeDescription> available = Vertex::GetAttributeDescriptions();
+
+    for (const ReflectedInput& input : reflection.GetInputs()) {
+        auto it = std::find_if(available.begin(), available.end(), [&input](const VkVertexInputAttributeDescription& attribute) { return attribute.location == input.location; });
+
+        if (it == available.end() || it->format != input.format) {
+            *pReason = "vertex input " + std::to_string(input.location) + " does not match Vertex";
+            return false;
+        }
+        attributes.push_back(*it);
+    }
+
+    return true;
+}
+
+bool PipelineKey::operator==(const PipelineKey& other) const
+{
+    return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader
+        && vertex.deriveMatrices == other.vertex.deriveMatrices
+        && fragment.useTexture == other.fragment.useTexture && fragment.lightCount == other.fragment.lightCount && fragment.lightingModel == other.fragment.lightingModel
+        && vertexLayout == other.vertexLayout
+        && topology == other.topology && polygonMode == other.polygonMode && cullMode == other.cullMode
+        && depthTest == other.depthTest && depthWrite == other.depthWrite && depthCompare == other.depthCompare
+        && blendEnable == other.blendEnable && srcBlend == other.srcBlend && dstBlend == other.dstBlend && blendOp == other.blendOp
+        && colorFormat == other.colorFormat && depthFormat == other.depthFormat && samples == other.samples;
+}
+
+size_t PipelineKey::Hash() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* pData, size_t size) {
+        const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ pBytes[i]) * 1099511628211ull;
+        }
+    };
+
+    // Strings go in with their terminator, so "ab" + "c" and "a" + "bc" differ.
+    mix(vertexShader.c_str(), vertexShader.size() + 1);
+    mix(fragmentShader.c_str(), fragmentShader.size() + 1);
+
+    // Field by field, the struct has padding that is never written.
+    uint32_t state[] = {
+        vertex.deriveMatrices,
+        fragment.useTexture,
+        fragment.lightCount,
+        static_cast<uint32_t>(fragment.lightingModel),
+        static_cast<uint32_t>(vertexLayout),
+        static_cast<uint32_t>(topology),
+        static_cast<uint32_t>(polygonMode),
+        static_cast<uint32_t>(cullMode),
+        depthTest,
+        depthWrite,
+        static_cast<uint32_t>(depthCompare),
+        blendEnable,
+        static_cast<uint32_t>(srcBlend),
+        static_cast<uint32_t>(dstBlend),
+        static_cast<uint32_t>(blendOp),
+        static_cast<uint32_t>(colorFormat),
+        static_cast<uint32_t>(depthFormat),
+        static_cast<uint32_t>(samples),
+    };
+    mix(state, sizeof(state));
+
+    return static_cast<size_t>(hash);
 }
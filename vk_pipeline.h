@@ -2,6 +2,66 @@
 
 class Device;
 class SwapChain;
+class DescriptorUpdateTemplate;
+class PipelineVariantCache;
+class ShaderReflection;
+struct ReflectedBinding;
+
+enum class VertexLayout : uint32_t {
+    Mesh, // Vertex, one interleaved binding
+};
+
+enum class LightingModel : uint32_t {
+    Phong,
+    BlinnPhong,
+    Lambert, // diffuse only
+};
+
+// Specialization constants of simple.vert. deriveMatrices selects the old path that inverts the world
+// matrix and multiplies view and projection per vertex, kept to measure against the precomputed ones.
+struct VertexVariant {
+    VkBool32 deriveMatrices;
+};
+
+// Specialization constants of simple.frag, constant_id follows the member order.
+struct FragmentVariant {
+    VkBool32 useTexture;
+    uint32_t lightCount; // 0 .. MAX_LIGHTS
+    LightingModel lightingModel;
+};
+
+/*
+ * Everything a graphics pipeline is built from. Two keys that compare equal build the same pipeline.
+ * The render pass is described by its attachment formats and samples, which is all that render pass
+ * compatibility looks at, so a pipeline survives a swap chain rebuild that keeps the formats.
+ */
+struct PipelineKey {
+    std::string vertexShader;
+    std::string fragmentShader;
+    VertexVariant vertex;
+    FragmentVariant fragment;
+    VertexLayout vertexLayout;
+    VkPrimitiveTopology topology;
+    VkPolygonMode polygonMode;
+    VkCullModeFlags cullMode;
+    VkBool32 depthTest;
+    VkBool32 depthWrite;
+    VkCompareOp depthCompare;
+    VkBool32 blendEnable;
+    VkBlendFactor srcBlend; // color and alpha
+    VkBlendFactor dstBlend;
+    VkBlendOp blendOp;
+    VkFormat colorFormat;
+    VkFormat depthFormat;
+    VkSampleCountFlagBits samples;
+
+    bool operator==(const PipelineKey&) const;
+    size_t Hash() const; // FNV-1a over every field
+};
+
+struct PipelineKeyHash {
+    size_t operator()(const PipelineKey& key) const { return key.Hash(); }
+};
 
 class Pipeline {
 public:
@@ -13,28 +73,53 @@ public:
     Pipeline& operator=(Pipeline&&) = delete;
 
 public:
-    void UpdateSwapChain(const SwapChain*);
+    void UpdateSwapChain(const SwapChain*); // waits for variants still compiling against the old render pass
+    // Creates and destroys a throwaway copy of the pipeline, VK_NULL_HANDLE measures a cold creation.
+    float MeasureCreation(VkPipelineCache) const;
+    // Thread safe, the variant cache builds on its compile threads through this. Throws if a shader
+    // does not fit the layout, which can only happen after a hot reload that skipped IsCompatible.
+    VkPipeline BuildPipeline(const PipelineKey&, VkPipelineCache) const;
+    // Whether a module can be used with the existing layouts and vertex layout, pReason says why not.
+    bool IsCompatible(const ShaderReflection&, std::string* pReason) const;
 
 public: // getter
     VkDescriptorSetLayout GetModelDescriptorSetLayouts() const { return m_descriptorSetLayouts[0]; }
     VkDescriptorSetLayout GetCommonDescriptorSetLayouts() const { return m_descriptorSetLayouts[1]; }
+    const DescriptorUpdateTemplate* GetModelUpdateTemplate() const { return m_updateTemplates[0]; }
+    const DescriptorUpdateTemplate* GetCommonUpdateTemplate() const { return m_updateTemplates[1]; }
     VkPipelineLayout GetPipelineLayout() const { return m_layout; }
+    VkShaderStageFlags GetPushConstantStages() const { return m_pushConstantStages; }
     VkRenderPass GetRenderPass() const { return m_renderPass; }
-    VkPipeline GetPipeline() const { return m_pipeline; }
+    VkPipeline GetPipeline() const; // the default key's variant, always ready
+    const PipelineKey& GetDefaultKey() const { return m_defaultKey; }
+    PipelineVariantCache* GetVariants() const { return p_variants; }
 
 private:
+    void ReflectShaders(); // default key's shaders
     void CreateDescriptorSetLayout();
     void CreatePipelineLayout();
     void CreateRenderPass();
-    void CreatePipeline();
+    void CreateDefaultKey();
+    void CreatePipeline(); // default key, on the calling thread
+    bool IsCompatible(const ReflectedBinding&, std::string* pReason) const;
+    bool GetVertexAttributes(const ShaderReflection&, std::vector<VkVertexInputAttributeDescription>& attributes, std::string* pReason) const;
 
 private:
     const Device* p_device;
     const SwapChain* p_swapChain;
 
 private:
+    std::vector<ReflectedBinding> m_bindings; // of every stage, sorted by set and binding
+    uint32_t m_pushConstantSize { 0 };
+    VkShaderStageFlags m_pushConstantStages { 0 };
     std::vector<VkDescriptorSetLayout> m_descriptorSetLayouts;
+    std::vector<DescriptorUpdateTemplate*> m_updateTemplates; // parallel to m_descriptorSetLayouts
     VkPipelineLayout m_layout;
     VkRenderPass m_renderPass;
-    VkPipeline m_pipeline;
+    PipelineKey m_defaultKey;
+    PipelineVariantCache* p_variants;
+
+private:
+    enum { COMPILE_THREADS = 2 };
+    enum { BINDLESS_SET = 2 }; // sets below are created from reflection, this one is the device's table
 };
@@ -0,0 +1,137 @@
+#include "pch.h"
+#include "vk_pipeline_cache.h"
+#include "vk_device.h"
+#include <fstream>
+#include <filesystem>
+
+PipelineCache::PipelineCache(const Device* pDevice, const std::string& path)
+    : p_device { pDevice }
+    , m_path { path }
+{
+    vkGetPhysicalDeviceProperties(p_device->GetPhysicalDevice(), &m_properties);
+
+    std::vector<char> data = ReadFile(m_path);
+
+    if (data.empty()) {
+        m_stats.status = "no cache file";
+    } else if (!IsCompatible(data)) {
+        m_stats.status = "rejected, written by another device or driver";
+        data.clear();
+    } else {
+        m_stats.status = "loaded";
+        m_stats.warm = true;
+        m_stats.loadedBytes = data.size();
+    }
+
+    m_cache = CreateCache(data);
+}
+
+PipelineCache::~PipelineCache()
+{
+    Save();
+    vkDestroyPipelineCache(p_device->GetDevice(), m_cache, nullptr);
+}
+
+bool PipelineCache::Save()
+{
+    // Another process may have saved since this one started, its pipelines are kept.
+    std::vector<char> diskData = ReadFile(m_path);
+
+    if (!diskData.empty() && IsCompatible(diskData)) {
+        VkPipelineCache diskCache = CreateCache(diskData);
+        VkResult result = vkMergePipelineCaches(p_device->GetDevice(), m_cache, 1, &diskCache);
+        CHECK_VK(result);
+        vkDestroyPipelineCache(p_device->GetDevice(), diskCache, nullptr);
+    }
+
+    size_t size = 0;
+    VkResult result = vkGetPipelineCacheData(p_device->GetDevice(), m_cache, &size, nullptr);
+    CHECK_VK(result);
+
+    std::vector<char> data(size);
+    result = vkGetPipelineCacheData(p_device->GetDevice(), m_cache, &size, data.data());
+    CHECK_VK(result);
+
+    // Each writer gets its own temporary file, the rename over the target is the only shared step.
+    std::string tempPath = m_path + "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(size));
+
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, m_path, error);
+
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+
+    return true;
+}
+
+void PipelineCache::RecordCreation(float ms)
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats.pipelineCount++;
+    m_stats.createMs += ms;
+}
+
+PipelineCacheStats PipelineCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_stats;
+}
+
+bool PipelineCache::IsCompatible(const std::vector<char>& data) const
+{
+    VkPipelineCacheHeaderVersionOne header {};
+
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(header) && header.headerSize <= data.size()
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == m_properties.vendorID
+        && header.deviceID == m_properties.deviceID
+        && memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache PipelineCache::CreateCache(const std::vector<char>& initialData) const
+{
+    VkPipelineCacheCreateInfo createInfo { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    {
+        createInfo.initialDataSize = initialData.size();
+        createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+    }
+
+    VkPipelineCache cache;
+    VkResult result = vkCreatePipelineCache(p_device->GetDevice(), &createInfo, nullptr, &cache);
+    CHECK_VK(result);
+
+    return cache;
+}
+
+std::vector<char> PipelineCache::ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+    if (!file.is_open()) {
+        return {};
+    }
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    std::vector<char> buffer(fileSize);
+
+    file.seekg(0);
+    file.read(buffer.data(), fileSize);
+
+    return buffer;
+}
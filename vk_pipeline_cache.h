@@ -0,0 +1,50 @@
+#pragma once
+
+class Device;
+
+struct PipelineCacheStats {
+    bool warm; // started from a file that passed validation
+    const char* status; // what happened to the file at startup
+    size_t loadedBytes;
+    uint32_t pipelineCount; // pipelines created through the cache since startup
+    float createMs; // their total creation time
+};
+
+/*
+ * VkPipelineCache kept on disk between runs. The file is only used when its header names this device
+ * and driver (vendor ID, device ID and pipelineCacheUUID), anything else starts cold. Save merges
+ * whatever another process wrote in the meantime and replaces the file through a rename, so a reader
+ * never sees a half-written cache.
+ */
+class PipelineCache {
+public:
+    PipelineCache(const Device*, const std::string& path);
+    ~PipelineCache(); // saves
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache(PipelineCache&&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+    PipelineCache& operator=(PipelineCache&&) = delete;
+
+public:
+    bool Save();
+    void RecordCreation(float ms); // called by pipelines after vkCreate*Pipelines, from any thread
+
+public: // getter
+    VkPipelineCache GetCache() const { return m_cache; }
+    PipelineCacheStats GetStats() const;
+
+private:
+    bool IsCompatible(const std::vector<char>& data) const;
+    VkPipelineCache CreateCache(const std::vector<char>& initialData) const;
+    static std::vector<char> ReadFile(const std::string& path); // empty if the file is missing
+
+private:
+    const Device* p_device;
+
+private:
+    std::string m_path;
+    VkPipelineCache m_cache;
+    VkPhysicalDeviceProperties m_properties;
+    PipelineCacheStats m_stats {};
+    mutable std::mutex m_statsMutex; // pipeline variants compile on their own threads
+};
@@ -0,0 +1,271 @@
+#include "pch.h"
+#include "vk_pipeline_variant_cache.h"
+#include "vk_device.h"
+#include "vk_pipeline_cache.h"
+#include "vk_deletion_queue.h"
+#include "vk_shader_reflection.h"
+#include "shader.h"
+
+#include <filesystem>
+
+namespace {
+// 0 when the file is missing, the next poll that finds it counts as a change.
+int64_t GetWriteTime(const std::string& path)
+{
+    std::error_code error;
+    auto writeTime = std::filesystem::last_write_time(path, error);
+    return error ? 0 : static_cast<int64_t>(writeTime.time_since_epoch().count());
+}
+}
+
+PipelineVariantCache::PipelineVariantCache(const Device* pDevice, const Pipeline* pPipeline, uint32_t threadCount)
+    : p_device { pDevice }
+    , p_pipeline { pPipeline }
+{
+    for (uint32_t i = 0; i < threadCount; i++) {
+        m_workers.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+PipelineVariantCache::~PipelineVariantCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+        m_queue.clear();
+    }
+    m_wakeCondition.notify_all();
+
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+
+    VkDevice device = p_device->GetDevice();
+
+    for (auto& entry : m_variants) {
+        for (VkPipeline pipeline : { entry.second->pipeline.load(std::memory_order_acquire), entry.second->rebuilt.load(std::memory_order_acquire) }) {
+            if (pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, pipeline, nullptr);
+            }
+        }
+        delete entry.second;
+    }
+}
+
+VkPipeline PipelineVariantCache::Get(const PipelineKey& key, VkPipeline fallback)
+{
+    auto it = m_variants.find(key);
+
+    if (it == m_variants.end()) {
+        Variant* pVariant = new Variant;
+        pVariant->key = key;
+        m_variants.emplace(key, pVariant);
+        Watch(key.vertexShader);
+        Watch(key.fragmentShader);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(pVariant);
+            m_pendingCount++;
+        }
+        m_wakeCondition.notify_one();
+
+        m_fallbackCount++;
+        return fallback;
+    }
+
+    VkPipeline pipeline = it->second->pipeline.load(std::memory_order_acquire);
+
+    if (pipeline == VK_NULL_HANDLE) {
+        m_fallbackCount++;
+        return fallback;
+    }
+
+    return pipeline;
+}
+
+VkPipeline PipelineVariantCache::Find(const PipelineKey& key) const
+{
+    auto it = m_variants.find(key);
+    return it == m_variants.end() ? VK_NULL_HANDLE : it->second->pipeline.load(std::memory_order_acquire);
+}
+
+void PipelineVariantCache::Add(const PipelineKey& key, VkPipeline pipeline)
+{
+    auto it = m_variants.find(key);
+
+    // A variant whose compile failed is still in the map, without a pipeline.
+    if (it != m_variants.end()) {
+        assert(it->second->pipeline.load(std::memory_order_acquire) == VK_NULL_HANDLE);
+        it->second->pipeline.store(pipeline, std::memory_order_release);
+        return;
+    }
+
+    Variant* pVariant = new Variant;
+    pVariant->key = key;
+    pVariant->pipeline.store(pipeline, std::memory_order_release);
+    m_variants.emplace(key, pVariant);
+    Watch(key.vertexShader);
+    Watch(key.fragmentShader);
+}
+
+void PipelineVariantCache::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idleCondition.wait(lock, [this] { return m_pendingCount == 0; });
+}
+
+void PipelineVariantCache::PollShaderChanges()
+{
+    // Frames in flight may still draw with the replaced pipeline, the deletion queue waits for them.
+    for (auto& entry : m_variants) {
+        VkPipeline rebuilt = entry.second->rebuilt.exchange(VK_NULL_HANDLE, std::memory_order_acq_rel);
+
+        if (rebuilt != VK_NULL_HANDLE) {
+            p_device->GetDeletionQueue()->Push(VK_OBJECT_TYPE_PIPELINE, entry.second->pipeline.exchange(rebuilt, std::memory_order_acq_rel));
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (now - m_lastPoll < std::chrono::milliseconds(RELOAD_INTERVAL_MS)) {
+        return;
+    }
+    m_lastPoll = now;
+
+    for (auto& watched : m_watchedFiles) {
+        int64_t writeTime = GetWriteTime(watched.first);
+
+        if (writeTime == watched.second || writeTime == 0) {
+            continue;
+        }
+
+        std::string status;
+        try {
+            ShaderReflection reflection { Shader::ReadFile(watched.first) };
+            std::string reason;
+
+            if (p_pipeline->IsCompatible(reflection, &reason)) {
+                Reload(watched.first);
+                status = "reloaded " + watched.first;
+            } else {
+                status = watched.first + ": " + reason + ", restart to apply";
+            }
+        } catch (const std::exception& e) {
+            // Most likely still being written, the write time stays old so the next poll tries again.
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_reloadStatus = e.what();
+            continue;
+        }
+
+        watched.second = writeTime;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reloadStatus = status;
+    }
+}
+
+void PipelineVariantCache::Watch(const std::string& path)
+{
+    if (m_watchedFiles.find(path) == m_watchedFiles.end()) {
+        m_watchedFiles.emplace(path, GetWriteTime(path));
+    }
+}
+
+void PipelineVariantCache::Reload(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (auto& entry : m_variants) {
+            if (entry.first.vertexShader == path || entry.first.fragmentShader == path) {
+                m_queue.push_back(entry.second);
+                m_pendingCount++;
+            }
+        }
+    }
+    m_wakeCondition.notify_all();
+
+    m_reloadCount++;
+}
+
+PipelineVariantStats PipelineVariantCache::GetStats() const
+{
+    PipelineVariantStats stats {};
+    stats.variantCount = static_cast<uint32_t>(m_variants.size());
+    stats.fallbackCount = m_fallbackCount;
+    stats.reloadCount = m_reloadCount;
+
+    for (const auto& entry : m_variants) {
+        if (entry.second->pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE) {
+            stats.readyCount++;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.pendingCount = m_pendingCount;
+    stats.compileMs = m_compileMs;
+    stats.reloadStatus = m_reloadStatus;
+
+    return stats;
+}
+
+void PipelineVariantCache::WorkerLoop()
+{
+    PipelineCache* pCache = p_device->GetPipelineCache();
+
+    while (true) {
+        Variant* pVariant = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeCondition.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+
+            if (m_quit) {
+                return;
+            }
+
+            pVariant = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        // The key is not touched by the render thread after queueing, and the driver synchronizes the VkPipelineCache.
+        // A shader rewritten between the poll and this build can still fail, the variant then keeps what it had.
+        auto start = std::chrono::steady_clock::now();
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        std::string error;
+
+        try {
+            pipeline = p_pipeline->BuildPipeline(pVariant->key, pCache->GetCache());
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (pipeline != VK_NULL_HANDLE) {
+            pCache->RecordCreation(ms);
+
+            // First build goes straight in, a rebuild waits for the render thread to swap it.
+            VkPipeline expected = VK_NULL_HANDLE;
+            if (!pVariant->pipeline.compare_exchange_strong(expected, pipeline, std::memory_order_acq_rel)) {
+                VkPipeline stale = pVariant->rebuilt.exchange(pipeline, std::memory_order_acq_rel);
+
+                // Never handed out, a newer rebuild overtook it.
+                if (stale != VK_NULL_HANDLE) {
+                    vkDestroyPipeline(p_device->GetDevice(), stale, nullptr);
+                }
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_compileMs += ms;
+            m_pendingCount--;
+
+            if (!error.empty()) {
+                m_reloadStatus = error;
+            }
+        }
+        m_idleCondition.notify_all();
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "vk_pipeline.h"
+
+class Device;
+
+struct PipelineVariantStats {
+    uint32_t variantCount;
+    uint32_t readyCount;
+    uint32_t pendingCount; // queued or compiling
+    uint64_t fallbackCount; // Get calls answered with the fallback
+    float compileMs; // compile thread time, summed over variants
+    uint32_t reloadCount; // shader files reloaded
+    std::string reloadStatus; // outcome of the last reload, empty before the first
+};
+
+/*
+ * Graphics pipelines of a Pipeline, keyed by their full state. Get queues a missing variant for the
+ * compile threads and answers with the caller's fallback until it is ready, so the first frame that
+ * uses a new state does not wait for the driver.
+ *
+ * The compile threads are separate from the JobSystem: a thread waiting there runs whatever job it
+ * finds, and a compile picked up that way would stall the very frame it was meant to keep smooth.
+ * Get, Find, Add and WaitIdle are called from the render thread only.
+ *
+ * PollShaderChanges watches the .spv files of every variant. A file that changed is reflected first,
+ * if it still fits the pipeline layout only the variants built from it are queued again and keep
+ * drawing with their old pipeline until the rebuilt one is swapped in. A changed layout needs a restart,
+ * the descriptor sets the renderer allocated were made for the old one.
+ */
+class PipelineVariantCache {
+public:
+    PipelineVariantCache(const Device*, const Pipeline*, uint32_t threadCount);
+    ~PipelineVariantCache(); // joins the compile threads and destroys every variant
+    PipelineVariantCache(const PipelineVariantCache&) = delete;
+    PipelineVariantCache(PipelineVariantCache&&) = delete;
+    PipelineVariantCache& operator=(const PipelineVariantCache&) = delete;
+    PipelineVariantCache& operator=(PipelineVariantCache&&) = delete;
+
+public:
+    VkPipeline Get(const PipelineKey&, VkPipeline fallback);
+    VkPipeline Find(const PipelineKey&) const; // VK_NULL_HANDLE while missing or compiling, queues nothing
+    void Add(const PipelineKey&, VkPipeline); // takes ownership of a variant built on the calling thread
+    void WaitIdle(); // until the queue is empty and no variant is compiling
+    // Once per frame: swaps in rebuilt variants and, every RELOAD_INTERVAL_MS, checks the shader files.
+    void PollShaderChanges();
+
+public: // getter
+    PipelineVariantStats GetStats() const;
+
+private:
+    struct Variant {
+        PipelineKey key;
+        std::atomic<VkPipeline> pipeline { VK_NULL_HANDLE };
+        std::atomic<VkPipeline> rebuilt { VK_NULL_HANDLE }; // after a shader reload, waits for PollShaderChanges
+    };
+
+private:
+    void WorkerLoop();
+    void Watch(const std::string& path);
+    void Reload(const std::string& path); // queues the variants built from path
+
+private:
+    const Device* p_device;
+    const Pipeline* p_pipeline;
+
+private:
+    std::unordered_map<PipelineKey, Variant*, PipelineKeyHash> m_variants;
+    std::deque<Variant*> m_queue;
+    std::vector<std::thread> m_workers;
+    mutable std::mutex m_mutex; // guards the queue and everything below it
+    std::condition_variable m_wakeCondition;
+    std::condition_variable m_idleCondition;
+    uint32_t m_pendingCount { 0 };
+    float m_compileMs { 0.0f };
+    bool m_quit { false };
+    std::string m_reloadStatus;
+    uint64_t m_fallbackCount { 0 }; // render thread only
+    std::unordered_map<std::string, int64_t> m_watchedFiles; // last write time, render thread only
+    std::chrono::steady_clock::time_point m_lastPoll;
+    uint32_t m_reloadCount { 0 };
+
+private:
+    enum { RELOAD_INTERVAL_MS = 250 };
+};
@@ -1,28 +1,23 @@
 #pragma once
 
+#include "vk_memory_allocator.h"
+
 class Device;
-class CommandPool;
-class CommandBuffer;
 
 class Resource {
+    friend class DeletionQueue;
+
 protected:
     Resource(const Device*);
     virtual ~Resource();
 
 public: // getter
-    VkDeviceMemory GetDeviceMemory() { return m_deviceMemory; }
-
-protected:
-    CommandBuffer BeginSingleTimeCommand(void);
-    void EndSingleTimeCommand(CommandBuffer);
+    VkDeviceMemory GetDeviceMemory() { return m_allocation.memory; }
+    const Allocation& GetAllocation() const { return m_allocation; }
 
 protected:
     const Device* p_device;
 
 protected:
-    VkDeviceMemory m_deviceMemory { VK_NULL_HANDLE };
-
-protected:
-    static uint32_t s_count;
-    static CommandPool* s_pool;
+    Allocation m_allocation {};
 };
@@ -0,0 +1,83 @@
+#include "pch.h"
+#include "vk_ring_buffer.h"
+#include "vk_device.h"
+#include "vk_buffer.h"
+
+RingBuffer::RingBuffer(const Device* pDevice, VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage)
+    : p_device { pDevice }
+{
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(p_device->GetPhysicalDevice(), &properties);
+
+    m_alignment = 1;
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+        m_alignment = std::max(m_alignment, properties.limits.minUniformBufferOffsetAlignment);
+    }
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+        m_alignment = std::max(m_alignment, properties.limits.minStorageBufferOffsetAlignment);
+    }
+
+    // Each segment starts on an aligned offset so the first slice of every frame is bindable.
+    m_frameSize = (frameSize + m_alignment - 1) & ~(m_alignment - 1);
+
+    VkBufferCreateInfo createInfo { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    {
+        createInfo.size = m_frameSize * frameCount;
+        createInfo.usage = usage;
+        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    VkMemoryPropertyFlags memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+
+    p_buffer = new Buffer { p_device, createInfo, memoryPropertyFlags };
+    p_buffer->MapMemory();
+    p_mapped = static_cast<uint8_t*>(p_buffer->GetMappedPtr());
+}
+
+RingBuffer::~RingBuffer()
+{
+    p_buffer->UnmapMemory();
+    delete p_buffer;
+}
+
+void RingBuffer::BeginFrame(uint32_t frameIndex)
+{
+    m_frameBegin = m_frameSize * frameIndex;
+    m_head = m_frameBegin;
+}
+
+uint32_t RingBuffer::Allocate(VkDeviceSize size, void** ppData)
+{
+    VkDeviceSize offset = (m_head + m_alignment - 1) & ~(m_alignment - 1);
+
+    if (offset + size > m_frameBegin + m_frameSize) {
+        throw std::runtime_error("ring buffer frame segment overflow!");
+    }
+
+    m_head = offset + size;
+    *ppData = p_mapped + offset;
+
+    return static_cast<uint32_t>(offset);
+}
+
+void RingBuffer::Flush(void)
+{
+    p_buffer->MarkDirty(m_frameBegin, m_head - m_frameBegin);
+    p_buffer->FlushMappedMemory();
+}
+
+void RingBuffer::CollectDirtyRanges(std::vector<VkMappedMemoryRange>& ranges)
+{
+    // Only this frame's slices were written, the rest of the ring is untouched.
+    p_buffer->MarkDirty(m_frameBegin, m_head - m_frameBegin);
+    p_buffer->CollectDirtyRanges(ranges);
+}
+
+void RingBuffer::MarkDirty(VkDeviceSize offset, VkDeviceSize size)
+{
+    p_buffer->MarkDirty(offset, size);
+}
+
+VkBuffer RingBuffer::GetBuffer() const
+{
+    return p_buffer->GetBuffer();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+class Device;
+class Buffer;
+
+/*
+ * Persistently mapped linear allocator split into one segment per frame in flight.
+ * Slices are bump-allocated from the current frame's segment and bound with dynamic offsets,
+ * so the CPU never writes a segment the GPU may still be reading.
+ */
+class RingBuffer {
+public:
+    RingBuffer(const Device*, VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags);
+    ~RingBuffer();
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer(RingBuffer&&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+    RingBuffer& operator=(RingBuffer&&) = delete;
+
+public:
+    void BeginFrame(uint32_t frameIndex);
+    uint32_t Allocate(VkDeviceSize size, void** ppData);
+    void Flush(void);
+    void CollectDirtyRanges(std::vector<VkMappedMemoryRange>&);
+    void MarkDirty(VkDeviceSize offset, VkDeviceSize size); // for writes through GetFrameData rather than Allocate
+
+    template <typename T>
+    uint32_t Push(const T& data)
+    {
+        void* ptr = nullptr;
+        uint32_t offset = Allocate(sizeof(T), &ptr);
+        memcpy(ptr, &data, sizeof(T));
+        return offset;
+    }
+
+public: // getter
+    VkBuffer GetBuffer() const;
+    VkDeviceSize GetAlignment() const { return m_alignment; }
+    VkDeviceSize GetFrameSize() const { return m_frameSize; }
+    VkDeviceSize GetUsedBytes() const { return m_head - m_frameBegin; }
+    VkDeviceSize GetFrameOffset() const { return m_frameBegin; }
+    uint8_t* GetFrameData() const { return p_mapped + m_frameBegin; }
+
+private:
+    const Device* p_device;
+
+private:
+    Buffer* p_buffer;
+    uint8_t* p_mapped;
+    VkDeviceSize m_alignment;
+    VkDeviceSize m_frameSize;
+    VkDeviceSize m_frameBegin { 0 };
+    VkDeviceSize m_head { 0 };
+};
@@ -0,0 +1,361 @@
+#include "pch.h"
+#include "vk_shader_reflection.h"
+
+namespace {
+// The handful of SPIR-V enumerants the reflection looks at, values from the SPIR-V specification.
+enum {
+    SPIRV_MAGIC = 0x07230203,
+    SPIRV_HEADER_WORDS = 5,
+};
+
+enum {
+    OP_ENTRY_POINT = 15,
+    OP_TYPE_INT = 21,
+    OP_TYPE_FLOAT = 22,
+    OP_TYPE_VECTOR = 23,
+    OP_TYPE_MATRIX = 24,
+    OP_TYPE_IMAGE = 25,
+    OP_TYPE_SAMPLER = 26,
+    OP_TYPE_SAMPLED_IMAGE = 27,
+    OP_TYPE_ARRAY = 28,
+    OP_TYPE_RUNTIME_ARRAY = 29,
+    OP_TYPE_STRUCT = 30,
+    OP_TYPE_POINTER = 32,
+    OP_CONSTANT = 43,
+    OP_SPEC_CONSTANT = 50,
+    OP_VARIABLE = 59,
+    OP_DECORATE = 71,
+    OP_MEMBER_DECORATE = 72,
+};
+
+enum {
+    DECORATION_BUFFER_BLOCK = 3,
+    DECORATION_ARRAY_STRIDE = 6,
+    DECORATION_MATRIX_STRIDE = 7,
+    DECORATION_BUILT_IN = 11,
+    DECORATION_LOCATION = 30,
+    DECORATION_BINDING = 33,
+    DECORATION_DESCRIPTOR_SET = 34,
+    DECORATION_OFFSET = 35,
+};
+
+enum {
+    STORAGE_UNIFORM_CONSTANT = 0,
+    STORAGE_INPUT = 1,
+    STORAGE_UNIFORM = 2,
+    STORAGE_PUSH_CONSTANT = 9,
+    STORAGE_STORAGE_BUFFER = 12,
+};
+
+enum {
+    DIM_BUFFER = 5,
+    DIM_SUBPASS_DATA = 6,
+};
+
+VkShaderStageFlagBits GetStage(uint32_t executionModel)
+{
+    switch (executionModel) {
+    case 0:
+        return VK_SHADER_STAGE_VERTEX_BIT;
+    case 1:
+        return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    case 2:
+        return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case 3:
+        return VK_SHADER_STAGE_GEOMETRY_BIT;
+    case 4:
+        return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case 5:
+        return VK_SHADER_STAGE_COMPUTE_BIT;
+    default:
+        throw std::runtime_error("unsupported shader execution model!");
+    }
+}
+}
+
+ShaderReflection::ShaderReflection(const std::vector<char>& binary)
+{
+    if (binary.size() % sizeof(uint32_t) != 0 || binary.size() < SPIRV_HEADER_WORDS * sizeof(uint32_t)) {
+        throw std::runtime_error("invalid SPIR-V size!");
+    }
+
+    m_words.resize(binary.size() / sizeof(uint32_t));
+    memcpy(m_words.data(), binary.data(), binary.size());
+
+    if (m_words[0] != SPIRV_MAGIC) {
+        throw std::runtime_error("invalid SPIR-V magic number!");
+    }
+
+    // Word 3 of the header bounds every result id.
+    m_ids.resize(m_words[3]);
+    uint32_t entryPointCount = 0;
+    std::vector<uint32_t> variables;
+
+    for (uint32_t offset = SPIRV_HEADER_WORDS; offset < m_words.size();) {
+        uint32_t opcode = m_words[offset] & 0xFFFF;
+        uint32_t wordCount = m_words[offset] >> 16;
+
+        if (wordCount == 0 || offset + wordCount > m_words.size()) {
+            throw std::runtime_error("truncated SPIR-V instruction!");
+        }
+
+        const uint32_t* pOperands = &m_words[offset + 1];
+        auto id = [this](uint32_t index) -> Id& {
+            if (index >= m_ids.size()) {
+                throw std::runtime_error("SPIR-V id out of bounds!");
+            }
+            return m_ids[index];
+        };
+
+        switch (opcode) {
+        case OP_ENTRY_POINT:
+            m_stage = ::GetStage(pOperands[0]);
+            entryPointCount++;
+            break;
+        case OP_TYPE_INT:
+        case OP_TYPE_FLOAT:
+        case OP_TYPE_VECTOR:
+        case OP_TYPE_MATRIX:
+        case OP_TYPE_IMAGE:
+        case OP_TYPE_SAMPLER:
+        case OP_TYPE_SAMPLED_IMAGE:
+        case OP_TYPE_ARRAY:
+        case OP_TYPE_RUNTIME_ARRAY:
+        case OP_TYPE_STRUCT:
+        case OP_TYPE_POINTER:
+            id(pOperands[0]).opcode = opcode;
+            id(pOperands[0]).offset = offset;
+            break;
+        case OP_CONSTANT:
+        case OP_SPEC_CONSTANT:
+        case OP_VARIABLE:
+            // Result type comes first, the id second.
+            id(pOperands[1]).opcode = opcode;
+            id(pOperands[1]).offset = offset;
+            if (opcode == OP_VARIABLE) {
+                variables.push_back(pOperands[1]);
+            }
+            break;
+        case OP_DECORATE: {
+            Id& target = id(pOperands[0]);
+            uint32_t value = wordCount > 3 ? pOperands[2] : 0;
+
+            switch (pOperands[1]) {
+            case DECORATION_BUFFER_BLOCK:
+                target.bufferBlock = true;
+                break;
+            case DECORATION_ARRAY_STRIDE:
+                target.arrayStride = value;
+                break;
+            case DECORATION_BUILT_IN:
+                target.builtIn = true;
+                break;
+            case DECORATION_LOCATION:
+                target.location = value;
+                target.hasLocation = true;
+                break;
+            case DECORATION_BINDING:
+                target.binding = value;
+                target.hasBinding = true;
+                break;
+            case DECORATION_DESCRIPTOR_SET:
+                target.set = value;
+                break;
+            }
+            break;
+        }
+        case OP_MEMBER_DECORATE: {
+            Id& target = id(pOperands[0]);
+            uint32_t member = pOperands[1];
+            uint32_t value = wordCount > 4 ? pOperands[3] : 0;
+
+            if (pOperands[2] == DECORATION_OFFSET || pOperands[2] == DECORATION_MATRIX_STRIDE) {
+                std::vector<uint32_t>& values = pOperands[2] == DECORATION_OFFSET ? target.memberOffsets : target.memberMatrixStrides;
+                values.resize(std::max<size_t>(values.size(), member + 1), 0);
+                values[member] = value;
+            } else if (pOperands[2] == DECORATION_BUILT_IN) {
+                target.builtIn = true; // gl_PerVertex and friends
+            }
+            break;
+        }
+        }
+
+        offset += wordCount;
+    }
+
+    if (entryPointCount != 1) {
+        throw std::runtime_error("SPIR-V module needs exactly one entry point!");
+    }
+
+    for (uint32_t variableId : variables) {
+        const Id& variable = m_ids[variableId];
+        uint32_t storageClass = Operand(variable, 2);
+        const Id& pointer = Type(Operand(variable, 0));
+        uint32_t typeId = Operand(pointer, 2);
+
+        switch (storageClass) {
+        case STORAGE_UNIFORM_CONSTANT:
+        case STORAGE_UNIFORM:
+        case STORAGE_STORAGE_BUFFER: {
+            if (!variable.hasBinding) {
+                break;
+            }
+
+            ReflectedBinding binding {};
+            binding.set = variable.set;
+            binding.binding = variable.binding;
+            binding.type = GetDescriptorType(typeId, storageClass);
+            binding.count = GetArrayLength(typeId);
+            binding.stages = m_stage;
+            m_bindings.push_back(binding);
+            break;
+        }
+        case STORAGE_PUSH_CONSTANT:
+            m_pushConstantSize = GetTypeSize(typeId, 0);
+            break;
+        case STORAGE_INPUT:
+            if (m_stage == VK_SHADER_STAGE_VERTEX_BIT && variable.hasLocation && !variable.builtIn && !Type(typeId).builtIn) {
+                m_inputs.push_back(ReflectedInput { variable.location, GetInputFormat(typeId) });
+            }
+            break;
+        }
+    }
+
+    std::sort(m_bindings.begin(), m_bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) { return a.set != b.set ? a.set < b.set : a.binding < b.binding; });
+    std::sort(m_inputs.begin(), m_inputs.end(), [](const ReflectedInput& a, const ReflectedInput& b) { return a.location < b.location; });
+}
+
+const ShaderReflection::Id& ShaderReflection::Type(uint32_t id) const
+{
+    if (id >= m_ids.size() || m_ids[id].opcode == 0) {
+        throw std::runtime_error("SPIR-V references an undefined type!");
+    }
+
+    return m_ids[id];
+}
+
+uint32_t ShaderReflection::GetTypeSize(uint32_t typeId, uint32_t matrixStride) const
+{
+    const Id& type = Type(typeId);
+
+    switch (type.opcode) {
+    case OP_TYPE_INT:
+    case OP_TYPE_FLOAT:
+        return Operand(type, 1) / 8;
+    case OP_TYPE_VECTOR:
+        return Operand(type, 2) * GetTypeSize(Operand(type, 1), 0);
+    case OP_TYPE_MATRIX: {
+        // Columns are matrixStride apart in a block, a column vector's size otherwise.
+        uint32_t columnSize = matrixStride > 0 ? matrixStride : GetTypeSize(Operand(type, 1), 0);
+        return Operand(type, 2) * columnSize;
+    }
+    case OP_TYPE_ARRAY: {
+        uint32_t stride = type.arrayStride > 0 ? type.arrayStride : GetTypeSize(Operand(type, 1), matrixStride);
+        return GetArrayLength(typeId) * stride;
+    }
+    case OP_TYPE_RUNTIME_ARRAY:
+        return 0;
+    case OP_TYPE_STRUCT: {
+        // The member that ends last decides the size, members need not be declared in offset order.
+        uint32_t size = 0;
+        uint32_t memberCount = (m_words[type.offset] >> 16) - 2;
+
+        for (uint32_t member = 0; member < memberCount; member++) {
+            uint32_t offset = member < type.memberOffsets.size() ? type.memberOffsets[member] : 0;
+            uint32_t stride = member < type.memberMatrixStrides.size() ? type.memberMatrixStrides[member] : 0;
+            size = std::max(size, offset + GetTypeSize(Operand(type, 1 + member), stride));
+        }
+        return size;
+    }
+    default:
+        throw std::runtime_error("SPIR-V type has no size!");
+    }
+}
+
+uint32_t ShaderReflection::GetArrayLength(uint32_t typeId) const
+{
+    const Id& type = Type(typeId);
+
+    if (type.opcode == OP_TYPE_RUNTIME_ARRAY) {
+        return 0;
+    }
+    if (type.opcode != OP_TYPE_ARRAY) {
+        return 1;
+    }
+
+    // The length is a constant id, a specialization constant counts with its default value.
+    const Id& length = m_ids[Operand(type, 2)];
+
+    if (length.opcode != OP_CONSTANT && length.opcode != OP_SPEC_CONSTANT) {
+        throw std::runtime_error("SPIR-V array length is not a constant!");
+    }
+
+    return Operand(length, 2);
+}
+
+VkDescriptorType ShaderReflection::GetDescriptorType(uint32_t typeId, uint32_t storageClass) const
+{
+    const Id* pType = &Type(typeId);
+
+    while (pType->opcode == OP_TYPE_ARRAY || pType->opcode == OP_TYPE_RUNTIME_ARRAY) {
+        pType = &Type(Operand(*pType, 1));
+    }
+
+    if (storageClass == STORAGE_STORAGE_BUFFER) {
+        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
+    if (storageClass == STORAGE_UNIFORM) {
+        // Before SPIR-V 1.3 storage buffers are Uniform blocks decorated BufferBlock.
+        return pType->bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    }
+
+    switch (pType->opcode) {
+    case OP_TYPE_SAMPLER:
+        return VK_DESCRIPTOR_TYPE_SAMPLER;
+    case OP_TYPE_SAMPLED_IMAGE:
+        return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    case OP_TYPE_IMAGE: {
+        uint32_t dim = Operand(*pType, 2);
+        bool sampled = Operand(*pType, 6) == 1; // 2 is a storage image
+
+        if (dim == DIM_BUFFER) {
+            return sampled ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+        }
+        if (dim == DIM_SUBPASS_DATA) {
+            return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        }
+        return sampled ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    }
+    default:
+        throw std::runtime_error("unsupported SPIR-V descriptor type!");
+    }
+}
+
+VkFormat ShaderReflection::GetInputFormat(uint32_t typeId) const
+{
+    const Id& type = Type(typeId);
+    uint32_t componentCount = 1;
+    const Id* pComponent = &type;
+
+    if (type.opcode == OP_TYPE_VECTOR) {
+        componentCount = Operand(type, 2);
+        pComponent = &Type(Operand(type, 1));
+    }
+
+    if (Operand(*pComponent, 1) != 32 || componentCount > 4) {
+        throw std::runtime_error("unsupported vertex input type!");
+    }
+
+    static const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+    static const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+    static const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+    if (pComponent->opcode == OP_TYPE_FLOAT) {
+        return floatFormats[componentCount - 1];
+    }
+    if (pComponent->opcode == OP_TYPE_INT) {
+        return Operand(*pComponent, 2) ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];
+    }
+
+    throw std::runtime_error("unsupported vertex input type!");
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+struct ReflectedBinding {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type; // never a dynamic type, that is up to whoever binds the set
+    uint32_t count; // 0 for a runtime array
+    VkShaderStageFlags stages;
+};
+
+struct ReflectedInput {
+    uint32_t location;
+    VkFormat format;
+};
+
+/*
+ * Reads what a pipeline layout needs straight from a SPIR-V module: descriptor bindings, the size of the
+ * push constant block and, for vertex shaders, the input locations and formats. Only the few instructions
+ * that describe interface variables are decoded, the function bodies are skipped.
+ * Throws if the module is not valid SPIR-V or has more than one entry point.
+ */
+class ShaderReflection {
+public:
+    ShaderReflection(const std::vector<char>& binary);
+    ~ShaderReflection() = default;
+    ShaderReflection(const ShaderReflection&) = delete;
+    ShaderReflection(ShaderReflection&&) = delete;
+    ShaderReflection& operator=(const ShaderReflection&) = delete;
+    ShaderReflection& operator=(ShaderReflection&&) = delete;
+
+public: // getter
+    VkShaderStageFlagBits GetStage() const { return m_stage; }
+    const std::vector<ReflectedBinding>& GetBindings() const { return m_bindings; } // sorted by set, then binding
+    uint32_t GetPushConstantSize() const { return m_pushConstantSize; } // 0 without a push constant block
+    const std::vector<ReflectedInput>& GetInputs() const { return m_inputs; } // sorted by location, built-ins left out
+
+private:
+    struct Id {
+        uint32_t opcode; // of the instruction defining the id, 0 if nothing does
+        uint32_t offset; // word offset of that instruction
+        uint32_t set;
+        uint32_t binding;
+        uint32_t location;
+        uint32_t arrayStride;
+        bool hasBinding;
+        bool hasLocation;
+        bool builtIn;
+        bool bufferBlock;
+        std::vector<uint32_t> memberOffsets;
+        std::vector<uint32_t> memberMatrixStrides;
+    };
+
+private:
+    uint32_t Operand(const Id& id, uint32_t index) const { return m_words[id.offset + 1 + index]; } // operand 0 follows the opcode word
+    const Id& Type(uint32_t id) const;
+    uint32_t GetTypeSize(uint32_t typeId, uint32_t matrixStride) const;
+    uint32_t GetArrayLength(uint32_t typeId) const;
+    VkDescriptorType GetDescriptorType(uint32_t typeId, uint32_t storageClass) const;
+    VkFormat GetInputFormat(uint32_t typeId) const;
+
+private:
+    std::vector<uint32_t> m_words;
+    std::vector<Id> m_ids; // indexed by result id
+    VkShaderStageFlagBits m_stage;
+    std::vector<ReflectedBinding> m_bindings;
+    uint32_t m_pushConstantSize { 0 };
+    std::vector<ReflectedInput> m_inputs;
+};
@@ -4,8 +4,9 @@
 #include "vk_surface.h"
 #include "vk_device.h"
 #include "query.h"
+#include "vk_deletion_queue.h"
 
-SwapChain::SwapChain(const Window* pWindow, const Surface* pSurface, const Device* pDevice)
+SwapChain::SwapChain(const Window* pWindow, const Surface* pSurface, const Device* pDevice, const SwapChain* pOldSwapChain)
     : p_window { pWindow }
     , p_surface { pSurface }
     , p_device { pDevice }
@@ -13,28 +14,31 @@ SwapChain::SwapChain(const Window* pWindow, const Surface* pSurface, const Devic
     SelectSurfaceFormat();
     SelectPresentMode();
     SelectCapabilities();
-    CreateSwapChain();
+    CreateSwapChain(pOldSwapChain);
     CreateImageViews();
     CreateDepthResources();
 }
 
 SwapChain::~SwapChain()
 {
-    vkDestroyImageView(p_device->GetDevice(), depthImageView, nullptr);
-    vkDestroyImage(p_device->GetDevice(), depthImage, nullptr);
-    vkFreeMemory(p_device->GetDevice(), depthImageMemory, nullptr);
+    // Frames in flight may still render into these, they go once those frames have retired.
+    DeletionQueue* deletionQueue = p_device->GetDeletionQueue();
+
+    deletionQueue->Push(VK_OBJECT_TYPE_IMAGE_VIEW, depthImageView);
+    deletionQueue->Push(VK_OBJECT_TYPE_IMAGE, depthImage);
+    deletionQueue->Push(depthImageAllocation);
     /*
      * VkImage will be implicitly destroyed when the VkSwapchainKHR is destroyed.
      */
     for (auto framebuffer : m_frameBuffers) {
-        vkDestroyFramebuffer(p_device->GetDevice(), framebuffer, nullptr);
+        deletionQueue->Push(VK_OBJECT_TYPE_FRAMEBUFFER, framebuffer);
     }
 
     for (auto imageView : m_imageViews) {
-        vkDestroyImageView(p_device->GetDevice(), imageView, nullptr);
+        deletionQueue->Push(VK_OBJECT_TYPE_IMAGE_VIEW, imageView);
     }
 
-    vkDestroySwapchainKHR(p_device->GetDevice(), m_swapChain, nullptr);
+    deletionQueue->Push(VK_OBJECT_TYPE_SWAPCHAIN_KHR, m_swapChain);
 }
 
 void SwapChain::CreateFrameBuffer(VkRenderPass renderPass)
@@ -118,7 +122,7 @@ void SwapChain::SelectCapabilities()
     m_currentTransform = capabilities.currentTransform;
 }
 
-void SwapChain::CreateSwapChain()
+void SwapChain::CreateSwapChain(const SwapChain* pOldSwapChain)
 {
     QueueFamilyIndices indices = p_device->GetQueueFamilyIndices();
     uint32_t queueFamilyIndices[] = { indices.graphicsFamily, indices.presentFamily };
@@ -137,7 +141,8 @@ void SwapChain::CreateSwapChain()
         createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
         createInfo.presentMode = m_presentMode;
         createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        // Handing over the retired swapchain lets the presentation engine reuse its resources.
+        createInfo.oldSwapchain = pOldSwapChain != nullptr ? pOldSwapChain->GetSwapChain() : VK_NULL_HANDLE;
 
         if (indices.graphicsFamily != indices.presentFamily) {
             createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
@@ -150,7 +155,8 @@ void SwapChain::CreateSwapChain()
         }
     }
 
-    CHECK_VK(vkCreateSwapchainKHR(p_device->GetDevice(), &createInfo, nullptr, &m_swapChain));
+    VkResult result = vkCreateSwapchainKHR(p_device->GetDevice(), &createInfo, nullptr, &m_swapChain);
+    CHECK_VK(result);
 }
 
 void SwapChain::CreateImageViews()
@@ -188,7 +194,7 @@ void SwapChain::CreateDepthResources()
 {
     VkFormat depthFormat = findDepthFormat();
 
-    p_device->CreateImage(m_extent.width, m_extent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+    p_device->CreateImage(m_extent.width, m_extent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageAllocation);
     depthImageView = p_device->CreateImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 }
 
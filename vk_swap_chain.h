@@ -1,12 +1,14 @@
 #pragma once
 
+#include "vk_memory_allocator.h"
+
 class Window;
 class Surface;
 class Device;
 
 class SwapChain {
 public:
-    SwapChain(const Window*, const Surface*, const Device*);
+    SwapChain(const Window*, const Surface*, const Device*, const SwapChain* pOldSwapChain);
     ~SwapChain();
     SwapChain(const SwapChain&) = delete;
     SwapChain(SwapChain&&) = delete;
@@ -28,7 +30,7 @@ private:
     void SelectSurfaceFormat();
     void SelectPresentMode();
     void SelectCapabilities();
-    void CreateSwapChain();
+    void CreateSwapChain(const SwapChain* pOldSwapChain);
     void CreateImageViews();
     void CreateDepthResources();
 
@@ -59,6 +61,6 @@ private:
     std::vector<VkFramebuffer> m_frameBuffers;
 
     VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
+    Allocation depthImageAllocation;
     VkImageView depthImageView;
 };
@@ -0,0 +1,463 @@
+#include "pch.h"
+#include "vk_upload_context.h"
+#include "vk_device.h"
+#include "vk_buffer.h"
+#include "vk_command_pool.h"
+#include "vk_command_buffer.h"
+
+UploadContext::UploadContext(const Device* pDevice)
+    : p_device { pDevice }
+{
+    m_transferFamily = p_device->GetQueueFamilyIndices().transferFamily;
+    m_graphicsFamily = p_device->GetQueueFamilyIndices().graphicsFamily;
+    m_queue = p_device->GetTransferQueue();
+
+    p_commandPool = new CommandPool { p_device, m_transferFamily };
+
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(p_device->GetPhysicalDevice(), &properties);
+
+    // vkCmdCopyBufferToImage needs offsets aligned to 4 and to the texel size, 16 covers every format used here.
+    m_copyAlignment = std::max(static_cast<VkDeviceSize>(16), properties.limits.optimalBufferCopyOffsetAlignment);
+}
+
+UploadContext::~UploadContext()
+{
+    SubmitBatch();
+
+    // The renderer and its frame fences are gone by now, so do not go through Collect.
+    vkDeviceWaitIdle(p_device->GetDevice());
+
+    for (Batch* batch : m_inFlightBatches) {
+        if (!batch->transferDone) {
+            ReleaseChunks(batch);
+        }
+        m_freeBatches.push_back(batch);
+    }
+    m_inFlightBatches.clear();
+
+    for (Batch* batch : m_freeBatches) {
+        vkDestroyFence(p_device->GetDevice(), batch->fence, nullptr);
+        vkDestroySemaphore(p_device->GetDevice(), batch->semaphore, nullptr);
+        delete batch;
+    }
+
+    for (StagingChunk& chunk : m_freeChunks) {
+        chunk.p_buffer->UnmapMemory();
+        delete chunk.p_buffer;
+    }
+
+    delete p_commandPool;
+}
+
+void UploadContext::UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* pData, VkDeviceSize size)
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    VkBuffer stagingBuffer;
+    uint8_t* pMapped;
+    VkDeviceSize stagingOffset = AllocateStaging(size, &stagingBuffer, &pMapped);
+    memcpy(pMapped, pData, static_cast<size_t>(size));
+
+    VkBufferCopy copyRegion {};
+    {
+        copyRegion.srcOffset = stagingOffset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+    }
+
+    vkCmdCopyBuffer(p_current->commandBuffer, stagingBuffer, dstBuffer, 1, &copyRegion);
+
+    if (IsDedicatedTransferQueue()) {
+        VkBufferMemoryBarrier barrier { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+        {
+            barrier.srcQueueFamilyIndex = m_transferFamily;
+            barrier.dstQueueFamilyIndex = m_graphicsFamily;
+            barrier.buffer = dstBuffer;
+            barrier.offset = dstOffset;
+            barrier.size = size;
+        }
+        p_current->bufferBarriers.push_back(barrier);
+    }
+
+    m_pendingCopyCount++;
+    m_uploadedBytes += size;
+}
+
+void UploadContext::UploadImage(VkImage dstImage, VkExtent3D extent, const void* pData, VkDeviceSize size)
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    VkBuffer stagingBuffer;
+    uint8_t* pMapped;
+    VkDeviceSize stagingOffset = AllocateStaging(size, &stagingBuffer, &pMapped);
+    memcpy(pMapped, pData, static_cast<size_t>(size));
+
+    // The copy itself is recorded on submit, so all images of a batch share one barrier per transition.
+    PendingImage pending {};
+    {
+        pending.stagingBuffer = stagingBuffer;
+        pending.image = dstImage;
+        pending.region.bufferOffset = stagingOffset;
+        pending.region.bufferRowLength = 0;
+        pending.region.bufferImageHeight = 0;
+        pending.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        pending.region.imageSubresource.mipLevel = 0;
+        pending.region.imageSubresource.baseArrayLayer = 0;
+        pending.region.imageSubresource.layerCount = 1;
+        pending.region.imageOffset = { 0, 0, 0 };
+        pending.region.imageExtent = extent;
+    }
+
+    m_pendingImages.push_back(pending);
+
+    m_pendingCopyCount++;
+    m_uploadedBytes += size;
+}
+
+void UploadContext::Submit(void)
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    SubmitBatch();
+}
+
+void UploadContext::RecordAcquireBarriers(VkCommandBuffer graphicsCommandBuffer, VkFence frameFence, std::vector<VkSemaphore>& waitSemaphores)
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    for (Batch* batch : m_inFlightBatches) {
+        if (batch->acquired) {
+            continue;
+        }
+
+        batch->acquired = true;
+        batch->acquireFence = frameFence;
+
+        if (!IsDedicatedTransferQueue()) {
+            continue;
+        }
+
+        // The semaphore wait covers CONSUMER_STAGES, starting the acquire there chains it after the wait.
+        vkCmdPipelineBarrier(graphicsCommandBuffer, CONSUMER_STAGES, CONSUMER_STAGES, 0, 0, nullptr,
+            static_cast<uint32_t>(batch->bufferBarriers.size()), batch->bufferBarriers.data(),
+            static_cast<uint32_t>(batch->imageBarriers.size()), batch->imageBarriers.data());
+
+        waitSemaphores.push_back(batch->semaphore);
+    }
+}
+
+void UploadContext::WaitIdle(void)
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    SubmitBatch();
+    Collect(true);
+}
+
+UploadStats UploadContext::GetStats() const
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+
+    UploadStats stats {};
+    stats.submitCount = m_submitCount;
+    stats.pendingCopyCount = m_pendingCopyCount;
+    stats.uploadedBytes = m_uploadedBytes;
+    stats.stagingChunkCount = static_cast<uint32_t>(m_freeChunks.size());
+    stats.dedicatedTransferQueue = IsDedicatedTransferQueue();
+
+    for (const Batch* batch : m_inFlightBatches) {
+        stats.stagingChunkCount += static_cast<uint32_t>(batch->chunks.size());
+    }
+
+    if (p_current != nullptr) {
+        stats.stagingChunkCount += static_cast<uint32_t>(p_current->chunks.size());
+    }
+
+    return stats;
+}
+
+UploadContext::Batch* UploadContext::BeginBatch(void)
+{
+    if (p_current != nullptr) {
+        return p_current;
+    }
+
+    Collect(false);
+
+    if (!m_freeBatches.empty()) {
+        p_current = m_freeBatches.back();
+        m_freeBatches.pop_back();
+
+        VkResult result = vkResetCommandBuffer(p_current->commandBuffer, 0);
+        CHECK_VK(result);
+    } else {
+        p_current = new Batch {};
+        p_current->commandBuffer = p_commandPool->AllocateCommandBuffer().GetHandle();
+
+        VkFenceCreateInfo fenceInfo { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        VkSemaphoreCreateInfo semaphoreInfo { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+        VkResult result = vkCreateFence(p_device->GetDevice(), &fenceInfo, nullptr, &p_current->fence);
+        CHECK_VK(result);
+
+        result = vkCreateSemaphore(p_device->GetDevice(), &semaphoreInfo, nullptr, &p_current->semaphore);
+        CHECK_VK(result);
+    }
+
+    p_current->transferDone = false;
+    p_current->acquired = false;
+    p_current->acquireFence = VK_NULL_HANDLE;
+
+    VkCommandBufferBeginInfo beginInfo { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    {
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    }
+
+    VkResult result = vkBeginCommandBuffer(p_current->commandBuffer, &beginInfo);
+    CHECK_VK(result);
+
+    return p_current;
+}
+
+void UploadContext::SubmitBatch(void)
+{
+    if (p_current == nullptr) {
+        return;
+    }
+
+    RecordPendingImages();
+
+    if (IsDedicatedTransferQueue()) {
+        // Release half of the ownership transfer, the graphics queue records the matching acquire.
+        std::vector<VkBufferMemoryBarrier> releaseBarriers = p_current->bufferBarriers;
+        for (VkBufferMemoryBarrier& barrier : releaseBarriers) {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+        }
+
+        for (VkBufferMemoryBarrier& barrier : p_current->bufferBarriers) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = CONSUMER_ACCESS;
+        }
+
+        vkCmdPipelineBarrier(p_current->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, static_cast<uint32_t>(releaseBarriers.size()), releaseBarriers.data(), 0, nullptr);
+    } else {
+        // One barrier makes every transfer write of the batch visible to the stages that consume uploaded data.
+        VkMemoryBarrier memoryBarrier { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        {
+            memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = CONSUMER_ACCESS;
+        }
+
+        vkCmdPipelineBarrier(p_current->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, CONSUMER_STAGES, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    VkResult result = vkEndCommandBuffer(p_current->commandBuffer);
+    CHECK_VK(result);
+
+    VkSubmitInfo submitInfo { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    {
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &p_current->commandBuffer;
+
+        // On the graphics queue, submission order already orders the batch before later frames.
+        if (IsDedicatedTransferQueue()) {
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &p_current->semaphore;
+        }
+    }
+
+    result = vkQueueSubmit(m_queue, 1, &submitInfo, p_current->fence);
+    CHECK_VK(result);
+
+    m_inFlightBatches.push_back(p_current);
+    p_current = nullptr;
+    m_pendingCopyCount = 0;
+    m_submitCount++;
+}
+
+VkDeviceSize UploadContext::AllocateStaging(VkDeviceSize size, VkBuffer* pBuffer, uint8_t** ppMapped)
+{
+    Batch* batch = BeginBatch();
+
+    if (!batch->chunks.empty()) {
+        StagingChunk& chunk = batch->chunks.back();
+        VkDeviceSize offset = (chunk.head + m_copyAlignment - 1) & ~(m_copyAlignment - 1);
+
+        if (offset + size <= chunk.size) {
+            chunk.head = offset + size;
+            *pBuffer = chunk.p_buffer->GetBuffer();
+            *ppMapped = chunk.p_mapped + offset;
+            return offset;
+        }
+    }
+
+    // Bound the staging memory a single batch can pin before its fence signals.
+    VkDeviceSize batchBytes = 0;
+    for (const StagingChunk& chunk : batch->chunks) {
+        batchBytes += chunk.size;
+    }
+
+    if (batchBytes + size > MAX_BATCH_STAGING_SIZE && !batch->chunks.empty()) {
+        SubmitBatch();
+        batch = BeginBatch();
+    }
+
+    StagingChunk chunk = AcquireChunk(size);
+    chunk.head = size;
+    batch->chunks.push_back(chunk);
+
+    *pBuffer = chunk.p_buffer->GetBuffer();
+    *ppMapped = chunk.p_mapped;
+    return 0;
+}
+
+UploadContext::StagingChunk UploadContext::AcquireChunk(VkDeviceSize minSize)
+{
+    for (auto it = m_freeChunks.begin(); it != m_freeChunks.end(); it++) {
+        if (it->size >= minSize) {
+            StagingChunk chunk = *it;
+            m_freeChunks.erase(it);
+            chunk.head = 0;
+            return chunk;
+        }
+    }
+
+    VkBufferCreateInfo createInfo { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    {
+        createInfo.size = std::max(static_cast<VkDeviceSize>(STAGING_CHUNK_SIZE), minSize);
+        createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    VkMemoryPropertyFlags memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    StagingChunk chunk {};
+    chunk.p_buffer = new Buffer { p_device, createInfo, memoryPropertyFlags };
+    chunk.p_buffer->MapMemory();
+    chunk.p_mapped = static_cast<uint8_t*>(chunk.p_buffer->GetMappedPtr());
+    chunk.size = createInfo.size;
+    chunk.head = 0;
+
+    return chunk;
+}
+
+void UploadContext::RecordPendingImages(void)
+{
+    if (m_pendingImages.empty()) {
+        return;
+    }
+
+    std::vector<VkImageMemoryBarrier> barriers(m_pendingImages.size());
+
+    for (size_t i = 0; i < m_pendingImages.size(); i++) {
+        barriers[i] = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+        {
+            barriers[i].srcAccessMask = 0;
+            barriers[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barriers[i].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].image = m_pendingImages[i].image;
+            barriers[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barriers[i].subresourceRange.baseMipLevel = 0;
+            barriers[i].subresourceRange.levelCount = 1;
+            barriers[i].subresourceRange.baseArrayLayer = 0;
+            barriers[i].subresourceRange.layerCount = 1;
+        }
+    }
+
+    vkCmdPipelineBarrier(p_current->commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    for (size_t i = 0; i < m_pendingImages.size(); i++) {
+        vkCmdCopyBufferToImage(p_current->commandBuffer, m_pendingImages[i].stagingBuffer, m_pendingImages[i].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &m_pendingImages[i].region);
+    }
+
+    for (VkImageMemoryBarrier& barrier : barriers) {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    if (IsDedicatedTransferQueue()) {
+        // Release and acquire must describe the same layout transition, the acquire is replayed on the graphics queue.
+        for (VkImageMemoryBarrier& barrier : barriers) {
+            barrier.srcQueueFamilyIndex = m_transferFamily;
+            barrier.dstQueueFamilyIndex = m_graphicsFamily;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            p_current->imageBarriers.push_back(barrier);
+
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+        }
+
+        vkCmdPipelineBarrier(p_current->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+    } else {
+        for (VkImageMemoryBarrier& barrier : barriers) {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+
+        vkCmdPipelineBarrier(p_current->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+    }
+
+    m_pendingImages.clear();
+}
+
+void UploadContext::ReleaseChunks(Batch* batch)
+{
+    // Oversized chunks were made for a single large upload, do not keep them around.
+    for (StagingChunk& chunk : batch->chunks) {
+        if (chunk.size > STAGING_CHUNK_SIZE) {
+            chunk.p_buffer->UnmapMemory();
+            delete chunk.p_buffer;
+        } else {
+            m_freeChunks.push_back(chunk);
+        }
+    }
+    batch->chunks.clear();
+}
+
+void UploadContext::Collect(bool wait)
+{
+    auto it = m_inFlightBatches.begin();
+    while (it != m_inFlightBatches.end()) {
+        Batch* batch = *it;
+
+        if (!batch->transferDone) {
+            if (wait) {
+                VkResult result = vkWaitForFences(p_device->GetDevice(), 1, &batch->fence, VK_TRUE, UINT64_MAX);
+                CHECK_VK(result);
+            } else if (vkGetFenceStatus(p_device->GetDevice(), batch->fence) != VK_SUCCESS) {
+                it++;
+                continue;
+            }
+
+            // Staging memory is free as soon as the copies finished, whoever consumes the data.
+            batch->transferDone = true;
+            ReleaseChunks(batch);
+        }
+
+        // The semaphore can only be signaled again after the graphics submit that waited on it completed.
+        if (IsDedicatedTransferQueue()) {
+            if (!batch->acquired) {
+                it++;
+                continue;
+            }
+
+            if (vkGetFenceStatus(p_device->GetDevice(), batch->acquireFence) != VK_SUCCESS) {
+                it++;
+                continue;
+            }
+        }
+
+        VkResult result = vkResetFences(p_device->GetDevice(), 1, &batch->fence);
+        CHECK_VK(result);
+
+        batch->bufferBarriers.clear();
+        batch->imageBarriers.clear();
+        m_freeBatches.push_back(batch);
+        it = m_inFlightBatches.erase(it);
+    }
+}
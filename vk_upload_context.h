@@ -0,0 +1,104 @@
+#pragma once
+
+class Device;
+class Buffer;
+class CommandPool;
+
+struct UploadStats {
+    uint32_t submitCount;
+    uint32_t pendingCopyCount;
+    uint32_t stagingChunkCount;
+    VkDeviceSize uploadedBytes;
+    bool dedicatedTransferQueue;
+};
+
+/*
+ * Records staging copies and layout transitions into one command buffer per batch.
+ * A batch is submitted once with a fence, and its staging chunks are recycled when the fence signals.
+ *
+ * With a dedicated transfer family, batches run on the transfer queue and release ownership of what
+ * they wrote. The graphics queue acquires it with RecordAcquireBarriers and waits on the batch semaphore
+ * only at the stages that read uploaded data.
+ */
+class UploadContext {
+public:
+    UploadContext(const Device*);
+    ~UploadContext();
+    UploadContext(const UploadContext&) = delete;
+    UploadContext(UploadContext&&) = delete;
+    UploadContext& operator=(const UploadContext&) = delete;
+    UploadContext& operator=(UploadContext&&) = delete;
+
+public:
+    void UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* pData, VkDeviceSize size);
+    void UploadImage(VkImage dstImage, VkExtent3D extent, const void* pData, VkDeviceSize size);
+    void Submit(void);
+    void RecordAcquireBarriers(VkCommandBuffer graphicsCommandBuffer, VkFence frameFence, std::vector<VkSemaphore>& waitSemaphores);
+    void WaitIdle(void); // waits for the copies only, batches stay in flight until a frame acquires them
+
+public: // getter
+    UploadStats GetStats() const;
+    bool IsDedicatedTransferQueue() const { return m_transferFamily != m_graphicsFamily; }
+
+public:
+    // Stages of the graphics queue that wait for uploaded data.
+    static constexpr VkPipelineStageFlags CONSUMER_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    static constexpr VkAccessFlags CONSUMER_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+private:
+    struct StagingChunk {
+        Buffer* p_buffer;
+        uint8_t* p_mapped;
+        VkDeviceSize size;
+        VkDeviceSize head;
+    };
+
+    struct PendingImage {
+        VkBuffer stagingBuffer;
+        VkImage image;
+        VkBufferImageCopy region;
+    };
+
+    struct Batch {
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        VkSemaphore semaphore;
+        std::vector<StagingChunk> chunks;
+        std::vector<VkBufferMemoryBarrier> bufferBarriers; // acquire side of the ownership transfer
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        bool transferDone;
+        bool acquired;
+        VkFence acquireFence; // frame fence of the graphics submit that waited on the semaphore
+    };
+
+private:
+    Batch* BeginBatch(void);
+    void SubmitBatch(void);
+    VkDeviceSize AllocateStaging(VkDeviceSize size, VkBuffer* pBuffer, uint8_t** ppMapped);
+    StagingChunk AcquireChunk(VkDeviceSize minSize);
+    void RecordPendingImages(void);
+    void ReleaseChunks(Batch*);
+    void Collect(bool wait);
+
+private:
+    const Device* p_device;
+
+private:
+    enum { STAGING_CHUNK_SIZE = 8 * 1024 * 1024 };
+    enum { MAX_BATCH_STAGING_SIZE = 64 * 1024 * 1024 };
+
+    CommandPool* p_commandPool;
+    VkQueue m_queue;
+    uint32_t m_transferFamily;
+    uint32_t m_graphicsFamily;
+    VkDeviceSize m_copyAlignment;
+    Batch* p_current { nullptr };
+    std::vector<Batch*> m_freeBatches;
+    std::vector<Batch*> m_inFlightBatches;
+    std::vector<StagingChunk> m_freeChunks;
+    std::vector<PendingImage> m_pendingImages;
+    uint32_t m_pendingCopyCount { 0 };
+    uint32_t m_submitCount { 0 };
+    VkDeviceSize m_uploadedBytes { 0 };
+    mutable std::mutex m_mutex;
+};
@@ -2,10 +2,10 @@
 #include "vk_window.h"
 #include "app.h"
 
-Window::Window(const char* title, App* pApp)
+Window::Window(const char* title, App* pApp, bool visible)
     : p_app { pApp }
 {
-    CreateGLFWWindow(title);
+    CreateGLFWWindow(title, visible);
 }
 
 Window::~Window()
@@ -26,10 +26,11 @@ void Window::framebufferResizeCallback(GLFWwindow* window, int width, int height
     app->SetResizedTrue();
 }
 
-void Window::CreateGLFWWindow(const char* title)
+void Window::CreateGLFWWindow(const char* title, bool visible)
 {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
     m_window = glfwCreateWindow(m_width, m_height, title, nullptr, nullptr);
     assert(m_window);
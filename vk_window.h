@@ -4,7 +4,7 @@ class App;
 
 class Window {
 public:
-    Window(const char* title, App*);
+    Window(const char* title, App*, bool visible = true);
     ~Window();
     Window(const Window&) = delete;
     Window(Window&&) = delete;
@@ -21,7 +21,7 @@ public: // getter setter
     inline void SetHeight(int height) { m_height = height; }
 
 private:
-    void CreateGLFWWindow(const char*);
+    void CreateGLFWWindow(const char*, bool visible);
 
 private:
     App* p_app;